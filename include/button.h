@@ -23,6 +23,26 @@ typedef struct
   uint32_t PinNumber;
 } Button;
 
+/* Index of each button in the edge queue */
+typedef enum
+{
+    BUTTON_PWR = 0,
+    BUTTON_M,
+    BUTTON_UP,
+    BUTTON_DOWN,
+    BUTTON_COUNT
+} ButtonId;
+
+/* One pin change as seen by the GPIOTE interrupt */
+typedef struct
+{
+  uint32_t Time; // msecs since boot (same clock as get_msecs())
+  ButtonId Id;
+  bool Pressed;
+} ButtonEdge;
+
+#define BUTTON_EDGE_QUEUE_SIZE  16    // must be a power of two
+
 /* Button */
 #define DEBOUNCE_TIME           5     // *10 ms
 #define LONGCLICK_TIME          200   // *10 ms
@@ -41,6 +61,13 @@ void InitButton(Button* button, uint32_t pin_number, nrf_gpio_pin_pull_t pull_co
 // Returns true if button is currently pressed
 bool PollButton(Button* button);
 
+// Start reporting pin changes of the buttons (indexed by ButtonId) through the edge queue
+void InitButtonEdges(Button* buttons[BUTTON_COUNT]);
+
+// Take the oldest edge from the queue, returns false if it is empty
+bool PopButtonEdge(ButtonEdge* edge);
+bool HasButtonEdges(void);
+
 bool ButtonClicked(Button* button);
 bool ButtonLongClicked(Button* button);
 bool ButtonDoubleClicked(Button* button);
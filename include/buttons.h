@@ -9,6 +9,9 @@
 #ifndef _BUTTON_H_
 #define _BUTTON_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 typedef enum
 {
   ONOFF_CLICK = 1,
@@ -50,10 +53,14 @@ void buttons_clear_onoff_click_long_click_event (void);
 void buttons_clear_onoff_long_click_event (void);
 uint32_t buttons_get_up_down_click_event (void);
 void buttons_clear_up_down_click_event (void);
+void buttons_init (void);
 void buttons_clock (void);
 buttons_events_t buttons_get_events (void);
 void buttons_clear_all_events(void);
 void buttons_set_events (buttons_events_t events);
+void buttons_set_repeating (buttons_events_t clicks); // the buttons of these click events repeat them while held
+uint32_t buttons_get_held_msecs (buttons_events_t click); // how long the button of this click event has been held
+bool buttons_is_idle (void); // no button down, bouncing or part of an unfinished gesture, and no events pending
 
 extern buttons_events_t buttons_events;
 
@@ -0,0 +1,47 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Watchdog check-in bookkeeping
+ *
+ * Every client must check in within its own deadline.  Clients that are only watched while they are doing
+ * something risky (i.e. waiting for a flash operation) are marked busy for that time and are ignored otherwise.
+ * The watchdog is only fed while nobody is overdue.
+ *
+ * Times are msecs from whatever clock the caller uses, so this can be driven by a fake clock on a PC.
+ */
+
+#define CHECKIN_MAX_CLIENTS 8
+#define CHECKIN_NONE -1
+
+typedef struct {
+  const char *name;
+  uint32_t deadline_msec;
+  bool only_when_busy; // only watched between checkin_busy(true) and checkin_busy(false)
+} checkin_client_t;
+
+typedef struct {
+  const checkin_client_t *clients;
+  uint8_t num_clients;
+  volatile uint32_t last[CHECKIN_MAX_CLIENTS]; // time of the last check in
+  volatile uint8_t busy; // bitmask of only_when_busy clients that are busy now
+} checkin_t;
+
+void checkin_init(checkin_t *c, const checkin_client_t *clients, uint8_t num_clients, uint32_t now);
+
+// May be called from ISRs
+void checkin(checkin_t *c, uint8_t client, uint32_t now);
+
+// Start or stop watching an only_when_busy client, the deadline counts from the start
+void checkin_busy(checkin_t *c, uint8_t client, bool busy, uint32_t now);
+
+// The first client (in table order) that missed its deadline, or CHECKIN_NONE
+int8_t checkin_overdue(const checkin_t *c, uint32_t now);
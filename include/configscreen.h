@@ -2,4 +2,4 @@
 
 void configscreen_show();
 
-extern Screen configScreen;
+extern const Screen configScreen;
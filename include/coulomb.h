@@ -0,0 +1,54 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Coulomb counting state of charge, fused with the voltage based SOC
+ *
+ * Every layer_2() update subtracts the charge drawn since the last one.  Under load the pack voltage sags, so the
+ * voltage based SOC (see soc.h) is only trusted after the current has been low for a while: then the count is
+ * pulled a little towards it on each update, which slowly cancels any drift.  The first rest after power on jumps
+ * straight to the voltage SOC, because we can't know what happened while we were off (i.e. charging).
+ *
+ * The capacity is learned from full cycles: charge drawn between resting near full and resting well below half,
+ * divided by the SOC drop the voltage curve saw over that time.
+ *
+ * Charge is in mA*s, so a 20Ah pack is 72000000.  The update is a handful of adds, shifts and one 32x32->64 bit
+ * multiply (the SOC uses a reciprocal of the capacity, computed only when it changes, as the M0 has no divider).
+ */
+
+#define COULOMB_MAS_PER_CURRENT_X5 20 // 0.2A for 100ms
+#define COULOMB_REST_CURRENT_X5 2 // at or below 0.4A the pack is resting
+#define COULOMB_REST_UPDATES 150 // 15s of rest before the voltage has recovered enough to trust
+#define COULOMB_CORRECTION_SHIFT 7 // per rest update move 1/128 of the way to the voltage SOC
+#define COULOMB_FULL_SOC 97 // resting at or above this (voltage SOC) starts a new cycle
+#define COULOMB_LEARN_SOC 40 // resting at or below this after a full start updates the capacity
+#define COULOMB_LEARN_SHIFT 2 // move 1/4 of the way to each new capacity measurement
+
+typedef struct {
+  uint32_t capacity_mas;
+  uint32_t remaining_mas;
+  uint32_t cycle_used_mas; // drawn since we last rested at full
+  uint32_t percent_mas; // capacity_mas / 100
+  uint32_t recip; // 2^32 * 1000 / capacity_mas
+  uint16_t rest_updates;
+  bool synced; // have we rested (and so trusted the voltage) since power on?
+  bool cycle_full; // did the current cycle start at full?
+  uint16_t soc_x10; // 0-1000
+} coulomb_t;
+
+// Start from a saved state, or from a guess if remaining_mas is 0 (it is replaced at the first rest anyway)
+void coulomb_init(coulomb_t *c, uint32_t capacity_mas, uint32_t remaining_mas);
+
+// Call every 100ms, volt_soc is the voltage based SOC (0-100)
+void coulomb_update(coulomb_t *c, uint8_t current_x5, uint8_t volt_soc);
+
+// A first guess for the capacity from the pack energy setting
+uint32_t coulomb_capacity_from_wh(uint32_t wh_x10, uint8_t cells);
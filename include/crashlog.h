@@ -0,0 +1,66 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Crash log
+ *
+ * When we fault, app_error_fault_handler() snapshots the registers and the top of the stack into a record in
+ * RAM the startup code leaves alone (.noinit).  Flash can't be written from the fault handler (fds needs
+ * SoftDevice events), so the record is committed to flash early on the next boot, which happens as soon as the
+ * user presses power on the fault screen.  The last CRASHLOG_MAX_RECORDS crashes are kept.
+ *
+ * Send "C" over the BLE serial service to dump the saved records, "CC" to erase them.
+ * tools/crash_dump.py receives them and symbolizes the addresses against the ELF.
+ */
+
+#define CRASHLOG_MAX_RECORDS 4
+#define CRASHLOG_STACK_WORDS 16
+#define CRASHLOG_VERSION_LEN 12
+
+#define CRASHLOG_MAGIC 0x43524153 // "CRAS", only set while the RAM copy still has to be saved
+
+typedef struct {
+  uint32_t magic;
+  uint32_t seq; // counts all the crashes ever saved, the newest record has the highest
+  uint32_t id; // FAULT_xxx or NRF_FAULT_ID_xxx
+  uint32_t pc;
+  uint32_t lr;
+  uint32_t info; // error code for errors, else whatever the fault handler was given
+  uint32_t file; // address of the file name string (in flash) for errors and asserts, else 0
+  uint32_t line;
+  uint32_t r0, r1, r2, r3, r12, psr; // stacked by the CPU, HardFaults only
+  uint32_t sp; // address of stack[0]
+  uint32_t uptime_msec;
+  uint32_t uart_rx_ok, uart_rx_bad;
+  uint32_t stack_unused; // stack high water mark, in bytes
+  char version[CRASHLOG_VERSION_LEN];
+  uint32_t stack[CRASHLOG_STACK_WORDS]; // from sp upwards, unused slots past the stack top are 0
+} crashlog_record_t;
+
+// Dump packets, each fits in one BLE notification
+#define CRASHLOG_PKT_RECORD 'C' // record index, word offset (uint8 each), up to 4 words of the record
+#define CRASHLOG_PKT_END 'E' // number of records sent
+
+// Called from the fault handler, info is interpreted the same way the fault screen does
+void crashlog_capture(uint32_t id, uint32_t pc, uint32_t info, uint32_t lr);
+
+// Save a crash captured before the last reset, call once fds is up
+void crashlog_save(void);
+
+// Returns false if the link has no room right now, the packet will be offered again later
+typedef bool (*crashlog_send_fn)(const uint8_t *data, uint16_t len);
+
+void crashlog_dump_start(crashlog_send_fn send);
+void crashlog_dump_stop(void);
+void crashlog_clear(void);
+
+// Push as many dump packets as the link will take (and erase if asked), call from the main loop only
+void crashlog_dump_service(void);
@@ -0,0 +1,14 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include "screen.h"
+
+extern const Screen diagScreen;
+
+void diagscreen_sample(); // call once a second, takes the rates shown on the diagnostics screen
+void diagscreen_update(); // call every tick, does nothing unless the diagnostics screen is shown and has news
@@ -12,6 +12,7 @@
 #include "lcd.h"
 // #include "lcd_configurations.h"
 #include "main.h"
+#include "tripstats.h"
 
 #define ADDRESS_KEY 0
 #define KEY 1
@@ -19,7 +20,7 @@
 // For compatible changes, just add new fields at the end of the table (they will be inited to 0xff for old eeprom images).  For incompatible
 // changes bump up EEPROM_MIN_COMPAT_VERSION and the user's EEPROM settings will be discarded.
 #define EEPROM_MIN_COMPAT_VERSION 0x10
-#define EEPROM_VERSION 0x11
+#define EEPROM_VERSION 0x16
 
 typedef struct eeprom_data
 {
@@ -62,6 +63,13 @@ typedef struct eeprom_data
   uint32_t ui32_odometer_x10;
   uint8_t ui8_walk_assist_feature_enabled;
   uint8_t ui8_walk_assist_level_factor[9];
+  uint8_t ui8_diagnostics_screen;
+  uint8_t ui8_battery_chemistry;
+  uint32_t ui32_soc_capacity_mas;
+  uint32_t ui32_soc_remaining_mas;
+  uint32_t ui32_odometer_remainder_mm;
+  uint32_t ui32_trip_x10;
+  tripstats_t trip_stats;
   //lcd_configurations_menu_t lcd_configurations_menu;
 
   // FIXME align to 32 bit value by end of structure and pack other fields
@@ -135,6 +143,8 @@ void eeprom_init_defaults(void);
 #define DEFAULT_VALUE_OFFROAD_POWER_LIMIT_ENABLED                   0
 #define DEFAULT_VALUE_OFFROAD_POWER_LIMIT_DIV25                     10 //10 * 25 = 250W
 #define DEFAULT_VALUE_ODOMETER_X10                                  0
+#define DEFAULT_VALUE_DIAGNOSTICS_SCREEN                            0 // hidden
+#define DEFAULT_VALUE_BATTERY_CHEMISTRY                             0 // Li-ion
 
 // *************************************************************************** //
 
@@ -8,4 +8,10 @@ void eeprom_hw_init(void);
 bool flash_write_words(const void *value, uint16_t length_words);
 bool flash_read_words(void *dest, uint16_t length_words);
 
+// Records other than our preferences (i.e. the crash log), file_id and key must not clash with the above
+bool flash_write_record(uint16_t file_id, uint16_t key, const void *value, uint16_t length_words);
+bool flash_read_record(uint16_t file_id, uint16_t key, void *dest, uint16_t length_words);
+void flash_delete_file(uint16_t file_id);
+uint32_t flash_get_write_count(void); // flash writes since boot
+
 
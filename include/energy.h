@@ -0,0 +1,33 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Battery energy integrator
+ *
+ * Exact fixed point: every 100ms sample adds its energy in mWs to a remainder that carries whole 0.1Wh units into
+ * a counter, so there is no division per sample and no precision is lost.  The counter holds over 40MWh, the
+ * remainder never exceeds one unit plus one sample.
+ */
+
+#define ENERGY_MWS_PER_WH_X10 360000 // 0.1Wh
+#define ENERGY_MWS_PER_POWER_X50 2 // 1/50 W for 100ms
+
+typedef struct {
+  uint32_t wh_x10;
+  uint32_t mws; // < ENERGY_MWS_PER_WH_X10 between calls
+} energy_t;
+
+void energy_reset(energy_t *e);
+
+// One 100ms sample of battery power in W x50 (current x5 * volts x10)
+void energy_add(energy_t *e, uint32_t power_x50);
+
+// 0.1Wh units used since the reset, rounded down
+uint32_t energy_wh_x10(const energy_t *e);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "app_error.h"
+#include "screen.h"
 
 // Standard app error codes
 #define FAULT_SOFTDEVICE 1
@@ -10,3 +11,5 @@
 #define FAULT_MISSEDTICK 5
 #define FAULT_LOSTRX 6
 #define FAULT_GCC_ASSERT 10
+
+extern const Screen faultScreen; // shown by the fault handler, so it must always fit
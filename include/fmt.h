@@ -0,0 +1,57 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+
+/**
+ * Small text formatter
+ *
+ * Formats numbers and strings straight into a destination buffer (normally a field's msg), comparing with the
+ * old contents as it goes, so one pass both builds the new string and tells if it differs from the old one.
+ * Output that doesn't fit is truncated like snprintf() does.  Numbers are converted by subtracting powers of
+ * ten, the M0 has no hardware divider.
+ *
+ * The typed functions cover what the screens show every tick, fmt_vformat() handles the printf subset used by
+ * the rarer messages: %% %c %s and %d %i %u %x with an optional '0' flag, width and 'l' modifier.
+ */
+
+typedef struct {
+  char *buf;
+  uint8_t size; // including the terminator
+  uint8_t len;
+  bool changed;
+} fmt_t;
+
+void fmt_begin(fmt_t *f, char *buf, uint8_t size);
+
+// Terminate the string, returns true if it is different from what was in the buffer before
+bool fmt_end(fmt_t *f);
+
+void fmt_char(fmt_t *f, char c);
+void fmt_str(fmt_t *f, const char *s);
+
+// Right aligned in width, padded with '0' if zero_pad (after the sign for negative numbers) or else spaces
+void fmt_uint(fmt_t *f, uint32_t num, uint8_t width, bool zero_pad);
+void fmt_int(fmt_t *f, int32_t num, uint8_t width, bool zero_pad);
+void fmt_hex(fmt_t *f, uint32_t num, uint8_t width, bool zero_pad);
+
+// num with its last div_digits digits after a decimal point, or only the integer part if hide_fraction
+void fmt_fixed(fmt_t *f, uint32_t num, uint8_t div_digits, bool hide_fraction);
+
+// "hh:mm"
+void fmt_time(fmt_t *f, uint8_t hours, uint8_t minutes);
+
+// " 3.7V", integer part right aligned in two characters
+void fmt_volts_x10(fmt_t *f, uint16_t volts_x10);
+
+// " 42%", right aligned in three characters
+void fmt_percent(fmt_t *f, uint16_t percent);
+
+void fmt_vformat(fmt_t *f, const char *format, va_list args);
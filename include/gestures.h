@@ -0,0 +1,100 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "buttons.h"
+
+/**
+ * Button gesture engine
+ *
+ * Turns debounced press/release edges into buttons_events_t bits.  Every button is described by a row in a
+ * table (which events it can produce and how long its long click is), so all buttons share one state machine.
+ * The engine only looks at the edges and times it is given, so it can be driven by a scripted trace on a PC.
+ *
+ * Supported gestures per button: click, long click, click + long click, double click and hold-to-repeat
+ * (clicks repeated while held, getting faster the longer the button is held).  Chords fire when all their
+ * buttons are held down until one of them reaches its long click time.
+ */
+
+#define GESTURE_MAX_BUTTONS 4
+
+typedef struct {
+  buttons_events_t click;
+  buttons_events_t click_long_click; // 0 if the button has no click + long click
+  buttons_events_t long_click;
+  buttons_events_t double_click; // 0 if the button has no double click (a second click is just a click)
+  uint16_t long_click_msec;
+} gesture_button_t;
+
+typedef struct {
+  uint8_t buttons; // bitmask of button indexes that must be held together
+  buttons_events_t event;
+} gesture_chord_t;
+
+typedef struct {
+  uint16_t quick_click_msec; // a press shorter than this may be the start of a click + long click
+  uint16_t second_press_msec; // how long we wait for the second press of a double click / click + long click
+  uint16_t click_long_click_msec; // how long the second press must be held for a click + long click
+  uint16_t repeat_delay_msec; // hold time before a repeating button starts repeating
+  uint16_t repeat_msec; // first repeat interval
+  uint16_t repeat_min_msec; // the interval is halved every repeat_accel_count repeats down to this
+  uint8_t repeat_accel_count;
+} gesture_timing_t;
+
+typedef struct {
+  const gesture_button_t *buttons;
+  uint8_t num_buttons;
+  const gesture_chord_t *chords;
+  uint8_t num_chords;
+  const gesture_timing_t *timing;
+} gesture_config_t;
+
+typedef struct {
+  uint8_t state;
+  uint32_t since; // when we entered this state
+  uint32_t next_repeat;
+  uint16_t repeat_interval;
+  uint8_t repeats;
+} gesture_button_state_t;
+
+typedef struct {
+  const gesture_config_t *config;
+  uint32_t now;
+  uint8_t pressed; // bitmask of buttons currently down
+  uint8_t repeating; // bitmask of buttons that repeat their click while held (instead of long clicks)
+  gesture_button_state_t buttons[GESTURE_MAX_BUTTONS];
+} gesture_engine_t;
+
+void gesture_init(gesture_engine_t *g, const gesture_config_t *config, uint32_t now);
+
+// A debounced press or release, events pending from this button block it from starting a new gesture
+void gesture_edge(gesture_engine_t *g, uint8_t button, bool pressed, uint32_t time, buttons_events_t *events);
+
+// Advance time, emitting events for gestures that timed out
+void gesture_update(gesture_engine_t *g, uint32_t now, buttons_events_t *events);
+
+// Abandon all gestures in progress, buttons that are still held are ignored until released
+void gesture_reset(gesture_engine_t *g);
+
+// Select which buttons repeat their click while held
+void gesture_set_repeating(gesture_engine_t *g, uint8_t buttons);
+
+// True if no button is down and no gesture is waiting to time out
+bool gesture_is_idle(const gesture_engine_t *g);
+
+// How long the button has been held in its current gesture (0 if released)
+uint32_t gesture_held_msec(const gesture_engine_t *g, uint8_t button);
+
+// Step multipliers for a value changed by a held button, the last entry whose dwell has passed applies
+typedef struct {
+  uint16_t dwell_msec;
+  uint8_t multiplier;
+} gesture_accel_step_t;
+
+uint8_t gesture_accel_multiplier(const gesture_accel_step_t *steps, uint8_t num_steps, uint32_t held_msec);
@@ -0,0 +1,64 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Time series for graph fields
+ *
+ * One ring of GRAPH_COLS columns per time scale, each column holding the min, max and average of the samples it
+ * covers.  Samples go into the 30s ring, and each finished column is folded into the column being built for the
+ * next slower ring, so the slower scales cost nothing extra per sample and never need the raw samples again.
+ *
+ * Samples are expected every 100ms:
+ *   GRAPH_30S   5 samples per column, 64 columns = 32s
+ *   GRAPH_5MIN  10 of those per column = 5min 20s
+ *   GRAPH_30MIN 6 of those per column = 32min
+ *
+ * Nothing here touches the display, so it can be tested on a PC.
+ */
+
+#define GRAPH_COLS 64
+
+typedef enum {
+  GRAPH_30S = 0,
+  GRAPH_5MIN,
+  GRAPH_30MIN,
+  GRAPH_SCALES
+} graph_scale_t;
+
+typedef struct {
+  uint16_t min, max, avg;
+} graph_column_t;
+
+typedef struct {
+  graph_column_t cols[GRAPH_COLS];
+  uint8_t head; // where the next finished column goes
+  uint8_t count; // valid columns, up to GRAPH_COLS
+
+  // the column being built
+  uint16_t min, max;
+  uint32_t sum;
+  uint8_t n;
+} graph_ring_t;
+
+typedef struct {
+  graph_ring_t rings[GRAPH_SCALES];
+} graph_t;
+
+void graph_init(graph_t *g);
+
+// Returns a bitmask of the scales (1 << graph_scale_t) that just finished a column
+uint8_t graph_add(graph_t *g, uint16_t value);
+
+// age 0 is the newest finished column, NULL if there is no such column yet
+const graph_column_t *graph_column(const graph_t *g, graph_scale_t scale, uint8_t age);
+
+// A rounded range that holds the newest num_cols columns, rounded so it only changes when the data moves a lot
+void graph_range(const graph_t *g, graph_scale_t scale, uint8_t num_cols, uint16_t *lo, uint16_t *hi);
@@ -13,6 +13,9 @@
 void lcd_init(void);
 void lcd_refresh(void); // Call to flush framebuffer to SPI device
 void lcd_set_backlight_intensity(uint8_t level);
+uint32_t lcd_get_spi_bytes(void); // bytes sent to the LCD since boot
+void lcd_scroll_left(int16_t x, int16_t y, int16_t w, int16_t h); // move an area one column left, its rightmost column keeps its pixels
+void lcd_move_pages(uint8_t dest, uint8_t src, uint8_t count); // copy whole 8 pixel high pages, i.e. to scroll a menu
 
 // A special color which means "do not draw", used to let fonts have transparent backgrounds (also to save the cost of rendering when we know the area is already blank)
 #define C_TRANSPARENT 0xC1C2
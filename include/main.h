@@ -27,6 +27,12 @@ uint32_t get_seconds(); // how many seconds since boot
 /// msecs since boot (note: will roll over every 50 days)
 uint32_t get_msecs();
 
+uint16_t get_wakeups_per_sec(); // how often we came out of sd_app_evt_wait() in the last second
+uint32_t get_avg_current_ua(); // estimated average MCU current (not counting backlight/LCD) in the last second
+uint8_t get_cpu_busy_percent(); // time spent outside sd_app_evt_wait() in the last second
+
+uint32_t stack_overflow_debug(void); // Returns # of unused bytes in stack
+
 extern Button buttonM, buttonDWN, buttonUP, buttonPWR;
 
 extern bool has_seen_motor; // true once we've received a packet from a real motor
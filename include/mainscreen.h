@@ -1,6 +1,7 @@
 #pragma once
 
 #include "screen.h"
+#include "tripstats.h"
 
 typedef struct l2_vars_struct
 {
@@ -30,16 +31,12 @@ typedef struct l2_vars_struct
   uint16_t ui16_pedal_power_filtered;
   uint8_t ui8_pedal_cadence_filtered;
   uint16_t ui16_battery_voltage_soc_x10;
-  uint32_t ui32_wh_sum_x5;
-  uint32_t ui32_wh_sum_counter;
-  uint32_t ui32_wh_x10;
 
   uint8_t ui8_assist_level;
   uint8_t ui8_number_of_assist_levels;
   uint16_t ui16_wheel_perimeter;
   uint8_t ui8_wheel_max_speed;
   uint8_t ui8_units_type;
-  uint32_t ui32_wh_x10_offset;
   uint32_t ui32_wh_x10_100_percent;
   uint8_t ui8_battery_soc_enable;
   uint8_t ui8_battery_soc_increment_decrement;
@@ -99,7 +96,6 @@ typedef struct l3_vars_struct
   uint8_t ui8_temperature_current_limiting_value;
   uint8_t ui8_motor_temperature;
   uint32_t ui32_wheel_speed_sensor_tick_counter;
-  uint32_t ui32_wheel_speed_sensor_tick_counter_offset;
   uint16_t ui16_pedal_torque_x10;
   uint16_t ui16_pedal_power_x10;
   uint16_t ui16_battery_voltage_filtered_x10;
@@ -110,8 +106,6 @@ typedef struct l3_vars_struct
   uint16_t ui16_pedal_power_filtered;
   uint8_t ui8_pedal_cadence_filtered;
   uint16_t ui16_battery_voltage_soc_x10;
-  uint32_t ui32_wh_sum_x5;
-  uint32_t ui32_wh_sum_counter;
   uint32_t ui32_wh_x10;
 
   uint8_t ui8_assist_level;
@@ -161,8 +155,28 @@ typedef struct l3_vars_struct
   uint8_t ui8_braking;
   uint8_t ui8_walk_assist;
   uint8_t ui8_offroad_mode;
+  uint8_t ui8_diagnostics_screen; // show the diagnostics screen in the screen loop
+  uint8_t ui8_battery_chemistry; // soc_chemistry_t, selects the volt_based_soc table
 
   uint8_t volt_based_soc; // a SOC generated only based on pack voltage
+  uint8_t fused_soc; // coulomb counting corrected by volt_based_soc at rest, see coulomb.h
+  uint32_t ui32_soc_capacity_mas; // learned pack capacity, 0 if not known yet
+  uint32_t ui32_soc_remaining_mas;
+
+  uint16_t ui16_wh_per_km_x10; // last 1km
+  uint16_t ui16_wh_per_km_10km_x10;
+  uint16_t ui16_wh_per_km_trip_x10;
+  uint16_t ui16_range_x10; // km left at the current assist level
+  uint32_t ui32_odometer_remainder_mm; // distance not yet counted in ui32_odometer_x10, see odometer.h
+
+  tripstats_t trip_stats; // copy of the live stats for the eeprom
+  uint32_t ui32_trip_moving_sec;
+  uint16_t ui16_trip_avg_speed_x10;
+  uint16_t ui16_trip_max_speed_x10;
+  uint16_t ui16_trip_avg_motor_power;
+  uint16_t ui16_trip_max_motor_power;
+  uint16_t ui16_trip_avg_human_power;
+  uint8_t ui8_trip_avg_cadence;
 } l3_vars_t;
 
 // deprecated FIXME, delete
@@ -180,7 +194,13 @@ void layer_2(void);
  */
 void copy_layer_2_layer_3_vars(void);
 
-extern Screen mainScreen, infoScreen;
+// Feed the graph fields, call every 100ms
+void graphs_sample(void);
+
+// Start a new trip (distance, statistics and trip efficiency) on the next layer_2() update
+void trip_reset(void);
+
+extern const Screen mainScreen, infoScreen, tripScreen, graphScreen;
 
 extern uint16_t ui16_m_battery_soc_watts_hour;
 
@@ -0,0 +1,54 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Screen mirroring
+ *
+ * After each lcd_refresh() the pages of the frameBuffer that were touched are marked pending.  When a
+ * client has asked for mirroring we send the pending pages as small packets over the BLE serial service
+ * (only in builds made with "make BLE_SERIAL=1").
+ * Only the newest content of a page is ever sent, so if the link is slower than the display we simply
+ * skip intermediate frames instead of queuing them.
+ *
+ * Packet format (fits in one default-MTU notification):
+ *   byte 0: bits 0-3 page number (0-15), bit 4 set if payload is RLE
+ *   byte 1: first column of this packet
+ *   raw payload: column bytes starting at the first column
+ *   RLE payload: (count, value) pairs, count 1-64
+ *
+ * The encoder/decoder does not depend on any hardware so it can be built and tested on a PC, see
+ * tools/mirror_receiver.py for the receiving side.
+ */
+
+#define MIRROR_PAGES 16
+#define MIRROR_PAGE_WIDTH 64
+#define MIRROR_MAX_PACKET 20 // BLE_NUS_MAX_DATA_LEN with the default MTU
+
+#define MIRROR_HDR_RLE 0x10
+
+// Returns false if the link has no room right now, the packet will be offered again later
+typedef bool (*mirror_send_fn)(const uint8_t *data, uint16_t len);
+
+void mirror_start(const uint8_t *fb, mirror_send_fn send);
+void mirror_stop(void);
+bool mirror_is_active(void);
+
+// Call with a bitmask of the pages changed by the last refresh
+void mirror_pages_changed(uint16_t pages);
+
+// Push as many pending packets as the link will take, call from the main loop only
+void mirror_service(void);
+
+// Encode columns of one page starting at col, returns the number of columns consumed
+uint8_t mirror_encode(const uint8_t *page_data, uint8_t page, uint8_t col, uint8_t *pkt, uint8_t *pktlen);
+
+// Apply one packet to a 16x64 byte buffer, returns false for malformed packets
+bool mirror_decode(const uint8_t *pkt, uint8_t len, uint8_t *fb);
@@ -0,0 +1,44 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Wheel distance accumulator
+ *
+ * The controller sends a 24 bit count of wheel sensor ticks since it powered up.  Every sample adds the ticks
+ * since the previous one times the wheel perimeter to a millimetre remainder, whole 100m units are carried out
+ * and the rest is kept, so no distance is ever dropped.  The remainder can be saved and restored across power
+ * cycles.
+ *
+ * A counter that goes backwards is either the 24 bit wrap (counted normally) or a controller reset, in which
+ * case the new count is the distance since the reset.  A jump larger than a wheel can turn between two samples
+ * is not trusted, we just resync to it.
+ */
+
+#define ODOMETER_TICK_MASK 0xffffff
+#define ODOMETER_MM_PER_STEP 100000 // 0.1km
+#define ODOMETER_MAX_TICKS 64 // more than any wheel turns in the 100ms between samples
+
+typedef struct {
+  uint32_t last_ticks;
+  uint32_t mm; // < ODOMETER_MM_PER_STEP between calls
+  bool synced; // false until we have seen the first count
+} odometer_t;
+
+void odometer_init(odometer_t *o, uint32_t remainder_mm);
+
+// Force the next sample to only resync, for when the tick count is known to be stale or replaced
+void odometer_resync(odometer_t *o);
+
+// Feed the current tick count, returns the number of whole 100m steps completed since the last call
+uint32_t odometer_update(odometer_t *o, uint32_t ticks, uint16_t perimeter_mm);
+
+// Distance travelled towards the next 100m step
+uint32_t odometer_remainder_mm(const odometer_t *o);
@@ -0,0 +1,84 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Profiler
+ *
+ * PROF_BEGIN(id)/PROF_END(id) mark the start and end of an interesting piece of code.  They compile to
+ * nothing unless the firmware is built with "make PROFILE=1".
+ *
+ * Each mark is timestamped with TIMER1 (1us resolution, extended to 32 bits in software) and appended to a
+ * ring buffer, and the time between the outermost begin/end of each id is added to per-id count, min, max
+ * and total.  Marks may nest and may come from ISRs (an ISR's marks simply show up inside whatever it
+ * interrupted).
+ *
+ * Send "P" over the BLE serial service to dump the stats and the ring, "PC" to clear them.
+ * tools/profile_dump.py receives the dump and prints a flame chart style summary.
+ */
+
+typedef enum {
+  PROF_LAYER_2 = 0,
+  PROF_PROCESS_RX,
+  PROF_COPY_LAYER3,
+  PROF_SCREEN_UPDATE,
+  PROF_MAIN_SCREEN_FIELDS,
+  PROF_RENDER_LAYOUTS,
+  PROF_RENDER_DRAWTEXT, // the renderers must stay in FieldVariant order
+  PROF_RENDER_FILL,
+  PROF_RENDER_MESH,
+  PROF_RENDER_SCROLLABLE,
+  PROF_RENDER_EDITABLE,
+  PROF_RENDER_GRAPH,
+  PROF_RENDER_END,
+  PROF_LCD_REFRESH,
+  PROF_FLASH_WRITE,
+  PROF_BLE_EVT,
+  PROF_SYS_EVT,
+  PROF_NUS_DATA,
+  PROF_COUNT
+} profile_id_t;
+
+#ifdef PROFILE
+
+#define PROF_BEGIN(id) profile_mark((id), false)
+#define PROF_END(id) profile_mark((id), true)
+
+#define PROFILE_RING_SIZE 256 // must be a power of two
+
+// Dump packet types, each packet fits in one BLE notification
+#define PROFILE_PKT_HEADER 'H' // number of ring entries (uint16), number of ids (uint8)
+#define PROFILE_PKT_NAME 'N' // id, name
+#define PROFILE_PKT_STATS 'S' // id, count, min, max, total (uint32 each, usecs)
+#define PROFILE_PKT_RING 'R' // up to 4 ring entries (uint32 each): bits 0-23 usecs, 24-30 id, 31 set for an end mark
+#define PROFILE_PKT_END 'E'
+
+#define PROFILE_RING_END 0x80000000
+
+// Returns false if the link has no room right now, the packet will be offered again later
+typedef bool (*profile_send_fn)(const uint8_t *data, uint16_t len);
+
+void profile_init(void);
+void profile_mark(profile_id_t id, bool end);
+void profile_clear(void);
+
+// Recording into the ring is paused while a dump is in progress
+void profile_dump_start(profile_send_fn send);
+void profile_dump_stop(void);
+
+// Push as many dump packets as the link will take, call from the main loop only
+void profile_dump_service(void);
+
+#else
+
+#define PROF_BEGIN(id) ((void) 0)
+#define PROF_END(id) ((void) 0)
+
+#endif
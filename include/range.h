@@ -0,0 +1,56 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Efficiency (Wh/km) and remaining range
+ *
+ * Every 100m we are given the energy used so far and keep the difference in a ring of the last 10km.  Running sums
+ * over the last 1km and the whole ring are updated by adding the new step and dropping the one that fell out of
+ * the window, so a step costs the same no matter how long the windows are.  The whole trip and each assist level
+ * also keep plain totals.
+ *
+ * Range uses the efficiency of the current assist level once it has seen at least 1km, else the 10km window, else
+ * the trip.
+ */
+
+#define RANGE_STEP_M 100
+#define RANGE_SHORT_STEPS 10 // 1km
+#define RANGE_LONG_STEPS 100 // 10km
+#define RANGE_LEVELS 10 // assist levels 0-9
+
+#define RANGE_MAX_KM_X10 9999 // what we show while coasting downhill
+
+typedef enum {
+  RANGE_SHORT = 0,
+  RANGE_LONG,
+  RANGE_TRIP
+} range_window_t;
+
+typedef struct {
+  uint16_t steps_wh_x10[RANGE_LONG_STEPS]; // energy used in each 100m step, oldest at head once full
+  uint8_t head;
+  uint8_t count;
+  uint32_t last_wh_x10;
+  uint32_t short_wh_x10, long_wh_x10;
+  uint32_t trip_wh_x10, trip_steps;
+  uint32_t level_wh_x10[RANGE_LEVELS], level_steps[RANGE_LEVELS];
+} range_t;
+
+// Start a new trip, wh_x10 is the energy used so far
+void range_reset(range_t *r, uint32_t wh_x10);
+
+// Call for every 100m travelled
+void range_step(range_t *r, uint32_t wh_x10, uint8_t assist_level);
+
+// Wh/km x10 over a window, 0 if we have not moved yet
+uint16_t range_wh_per_km_x10(const range_t *r, range_window_t window);
+
+// km x10 we can still ride with remaining_wh_x10 at this assist level, 0 if we have not moved yet
+uint16_t range_km_x10(const range_t *r, uint32_t remaining_wh_x10, uint8_t assist_level);
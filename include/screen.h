@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include "ugui.h"
 #include "buttons.h"
+#include "graph.h"
+#include "fmt.h"
 
 /**
  * Main screen notes
@@ -39,22 +41,28 @@
  * isDirty is true if the field needs to be redrawn in the gui (because data has changed)
  * datavariant is a union that depends on the opcode:
  *
- * drawText: font ptr, char msg[MAXSTRLEN]
+ * drawText: msg - fixed text, or buf - a MAX_FIELD_LEN buffer for text written with fieldPrintf() (see FIELD_DRAWTEXT_BUF)
+ * editable: ptr to a const description (label, target, limits...), so the FIELD_EDITABLE_... tables cost RAM only for state
  * fillBox: nothing - just fills box based on fore/back color
  * drawBat: soc - draw a bat icon with SOC
- * drawPlot: maxval - max value seen, points - an array of 64 previous data values, to be drawn as a plot, one per column
+ * drawGraph: target - the variable to sample, data - min/max/avg columns at several time scales (see graph.h).  A new
+ *   column scrolls the plot one pixel left and only the new column is drawn, the whole plot is only drawn again if the
+ *   range (auto scaled) or the time scale changes
 
  *
  * helper functions:
  * fieldPrintf(fieldptr, "str %d", 5) - sets the string for the specified fields, marks the field as dirty if the string changed
+ *   (only the printf subset of fmt_vformat() is supported, values shown every tick use fieldFormatBegin/End and the fmt_...() calls)
  * fieldSetSOC(fieldptr, 32) - sets state of charge and marks field as dirty if the soc changed
- * fieldAddPlot(fieldptr, value) - add a new data point to a plot field
+ * fieldGraphSample(fieldptr) - add a sample of the target variable to a graph field
  *
  * When new state is received from the controller, fieldX...() will be called to mark the various fields as dirty.  These functions
  * are cheap and can be called when each rx packet is parsed.  If any field changed in a user visible way the field will be internally
  * marked as dirty and later updateScreen() will show that new value
  *
- * screenShow(screenptr) - set the current screen
+ * screenShow(screenptr) - set the current screen, it is drawn by the next screenUpdate()
+ * fieldIsRendered(fieldptr) - false if the current screen doesn't show this field, so its producer can skip it.  Producers
+ *   run before each screenUpdate(), so a field that just became visible is filled in before it is drawn
  * screenUpdate() - redraw the minimum set of dirty fields (or the whole screen if the screen has changed).
  *   if any fields are blinking the blink animation will be serviced here as well.
  *
@@ -90,6 +98,7 @@ typedef enum {
   FieldMesh, // Fill with a mesh color
   FieldScrollable, // Contains a menu name and points to a submenu to optionally expand its place.  If at the root of a screen, submenu will be automatically expanded to fill remaining screen space
   FieldEditable, // An editable property with a human visible label and metadata for min/max/type of data and ptr to raw variable to render
+  FieldGraph, // A plot of a variable vs time
   FieldEnd // Marker record for the last entry in a scrollable submenu - never shown to user
 } FieldVariant;
 
@@ -102,19 +111,60 @@ typedef enum {
   EditEnum // Choose a string from a list
 } EditableType;
 
+/**
+ * The description of an editable, it never changes so the FIELD_EDITABLE_...() macros put it in flash
+ */
+typedef struct {
+  const char *label; // the label shown in the GUI for this item
+  void *target; // the data we are showing/manipulating
+  EditableType typ;
+  uint8_t size : 3; // sizeof for the specified target - we support 1 or 2 or 4
+  bool read_only : 1; // if true user can't really edit this
+
+  // the following parameters are particular to the editable type
+  union {
+
+    struct {
+      const char *units;
+      uint8_t div_digits: 4; // how many digits to divide by for fractions (i.e. 0 for integers, 1 for /10x, 2 for /100x, 3 /1000x
+      bool hide_fraction: 1; // if set, don't ever show the fractional part
+      uint32_t max_value, min_value; // min/max
+      uint32_t inc_step; // if zero, then 1 is assumed
+    } number;
+
+    struct {
+      // we assume *target is a uint8_t
+      const char * const *options; // An array of strings, with a NULL entry at the end to mark end of choices
+    } editEnum;
+  };
+} FieldEditableInfo;
+
+/**
+ * What a graph field plots, in flash like FieldEditableInfo
+ */
+typedef struct {
+  void *target; // the variable we sample, values above 65535 are clipped
+  graph_t *data;
+  uint8_t size : 3; // sizeof for the specified target - we support 1 or 2 or 4
+} FieldGraphInfo;
+
 /**
  * Ready to render data (normally populated by comms code) which might be used on multiple different screens
+ *
+ * Only the state that changes at run time lives here (16 bytes), descriptions are pointed to and text fields that
+ * are written point to their own buffer.
  */
 typedef struct Field {
   FieldVariant variant; //
   bool dirty : 1; // true if this data has changed and needs to be rerendered
   bool blink : 1; // if true, we should invoke the render function for this field every 500ms (or whatever the blink interval is) to possibly toggle animations on/off
   bool is_selected : 1; // if true this field is currently selected by the user (either in a scrollable or actively editing it)
-  // bool is_rendered : 1; // true if we're showing this field on the current screen (if false, some fieldPrintf work can be avoided
+  uint8_t rendered : 3; // how many layouts of the current screen show this field (at most 7), if 0 producers can skip formatting it
 
   union {
     struct {
-      char msg[MAX_FIELD_LEN];
+      const char *msg; // fixed text (or NULL)
+      char *buf; // if not NULL, the MAX_FIELD_LEN buffer fieldPrintf() writes, shown instead of msg
     } drawText;
 
     struct {
@@ -124,30 +174,15 @@ typedef struct Field {
       uint8_t selected; // the currently highlighted entry
     } scrollable;
 
+    const FieldEditableInfo *editable;
+
     struct {
-      const char *label; // the label shown in the GUI for this item
-      void *target; // the data we are showing/manipulating
-      const EditableType typ;
-      const uint8_t size : 3; // sizeof for the specified target - we support 1 or 2 or 4
-      bool read_only : 1; // if true user can't really edit this
-
-      // the following parameters are particular to the editable type
-      union {
-
-        struct {
-          const char *units;
-          const uint8_t div_digits: 4; // how many digits to divide by for fractions (i.e. 0 for integers, 1 for /10x, 2 for /100x, 3 /1000x
-          const bool hide_fraction: 1; // if set, don't ever show the fractional part
-          const uint32_t max_value, min_value; // min/max
-          const uint32_t inc_step; // if zero, then 1 is assumed
-        } number;
-
-        struct {
-          // we assume *target is a uint8_t
-          const char **options; // An array of strings, with a NULL entry at the end to mark end of choices
-        } editEnum;
-      };
-    } editable;
+      const FieldGraphInfo *info;
+      graph_scale_t scale : 2; // the time scale shown
+      bool redraw : 1; // the whole plot must be drawn again (i.e. the screen changed)
+      uint8_t pending; // columns of the shown scale added since we last drew
+      uint16_t lo, hi; // the range the plot was drawn with
+    } graph;
   };
 } Field;
 
@@ -157,21 +192,29 @@ typedef struct Field {
 
 #define FIELD_SCROLLABLE(lbl, arry) { .variant = FieldScrollable, .scrollable = { .label = lbl, .entries = arry } }
 
+// C99 allows anonymous constant structs and arrays - take advantage of that here to keep the descriptions in flash
 #define FIELD_EDITABLE_UINT(lbl, targ, unt, minv, maxv, ...) { .variant = FieldEditable, \
-  .editable = { .typ = EditUInt, .label = lbl, .target = targ, .size = sizeof(*targ),  \
+  .editable = &(const FieldEditableInfo) { .typ = EditUInt, .label = lbl, .target = targ, .size = sizeof(*targ),  \
       .number = { .units = unt, .max_value = maxv, .min_value = minv, ##__VA_ARGS__ } } }
 
 #define FIELD_READONLY_UINT(lbl, targ, unt, ...) { .variant = FieldEditable, \
-  .editable = { .read_only = true, .typ = EditUInt, .label = lbl, .target = targ, .size = sizeof(*targ),  \
+  .editable = &(const FieldEditableInfo) { .read_only = true, .typ = EditUInt, .label = lbl, .target = targ, .size = sizeof(*targ),  \
       .number = { .units = unt, ##__VA_ARGS__ } } }
 
-// C99 allows anonymous constant arrays - take advantage of that here to make declaring the various options easy
 #define FIELD_EDITABLE_ENUM(lbl, targ, ...) { .variant = FieldEditable, \
-  .editable = { .typ = EditEnum, .label = lbl, .target = targ, .size = sizeof(EditableType), \
-      .editEnum = { .options = (const char *[]){ __VA_ARGS__, NULL } } } }
+  .editable = &(const FieldEditableInfo) { .typ = EditEnum, .label = lbl, .target = targ, .size = sizeof(EditableType), \
+      .editEnum = { .options = (const char * const []){ __VA_ARGS__, NULL } } } }
 
 #define FIELD_DRAWTEXT(...) { .variant = FieldDrawText, .drawText = { __VA_ARGS__  } }
 
+// A text field written with fieldPrintf()/fieldFormatBegin(), with an optional initial string literal.  Each one
+// owns its buffer, so their RAM is counted at link time.  Only for fields at file scope (a compound literal in a
+// function is not static).
+#define FIELD_DRAWTEXT_BUF(...) { .variant = FieldDrawText, .drawText = { .buf = (char [MAX_FIELD_LEN]) { "" __VA_ARGS__ } } }
+
+#define FIELD_GRAPH(targ, dat, ...) { .variant = FieldGraph, \
+  .graph = { .info = &(const FieldGraphInfo) { .target = targ, .data = dat, .size = sizeof(*targ) }, ##__VA_ARGS__ } }
+
 #define FIELD_END { .variant = FieldEnd }
 
 
@@ -219,7 +262,7 @@ typedef struct {
 
   const UG_FONT *font; // If this field requires a font, use this.  Or if NULL auto select the biggest font that can hold the string
 
-  uint32_t old_editable; // a cache value only used for editable fields, used to compare against previous values and redraw if needed.
+  uint32_t old_editable; // a cache value only used for editable fields (in the resolved copy), used to compare against previous values and redraw if needed.
 
 } FieldLayout;
 
@@ -236,23 +279,58 @@ The top three handlers in the list above are handled by screen
 */
 typedef bool (*ButtonEventHandler)(buttons_events_t events);
 
+/**
+ * A full width band of fields shared by several screens (i.e. the battery bar at the top).  When the next screen
+ * shares it, the band is neither cleared nor drawn again, only its dirty fields are.
+ */
+typedef struct {
+  Coord y, height; // the band we own, a header starts at 0 and a footer ends at the bottom of the screen
+  FieldLayout fields[];
+} Subscreen;
+
+/**
+ * Screens and subscreens are const (kept in flash), when a screen is shown its layouts are copied to a small RAM
+ * cache with the shorthand sizes/positions resolved, and only that copy is rendered.
+ */
 typedef struct {
   void (*onExit)(); // If !NULL will be called when this screen is no longer visible
   ButtonEventHandler onPress; // or NULL for no handler
+  const Subscreen *header, *footer; // optional, our fields with y < 0 start below the header
   FieldLayout fields[];
 } Screen;
 
 // Standard vertical spacing for fonts
 #define FONT12_Y 14 // we want a little bit of extra space
 
-void panicScreenShow(Screen *screen);
-void screenShow(Screen *screen);
+#define MAX_RESOLVED_LAYOUTS 16 // header + body + footer of the biggest screen, including their NULL terminators
+
+void panicScreenShow(const Screen *screen);
+void screenShow(const Screen *screen);
 void screenUpdate();
 
+/// How many of the MAX_RESOLVED_LAYOUTS cache entries showing this screen takes
+int screenLayoutCount(const Screen *screen);
+
+/// True if the current screen shows this field
+bool fieldIsRendered(const Field *field);
+
 /// Return the current visible screen
-Screen *getCurrentScreen();
+const Screen *getCurrentScreen();
+
+/// Returns true if the next screenUpdate() has something to draw, or if anything on screen is blinking
+bool screenIsAnimating();
+
+/// Add a sample of the target variable to a graph field, call every 100ms (even while the graph is not shown)
+void fieldGraphSample(Field *field);
+
+/// Select which time scale a graph field shows
+void fieldGraphSetScale(Field *field, graph_scale_t scale);
 
 /// Returns true if the current screen handled the press
 bool screenOnPress(buttons_events_t events);
 
 void fieldPrintf(Field *field, const char *fmt, ...);
+
+/// Format straight into a FIELD_DRAWTEXT_BUF() field with the fmt_...() functions, the end marks the field dirty if it changed
+void fieldFormatBegin(Field *field, fmt_t *f);
+void fieldFormatEnd(Field *field, fmt_t *f);
@@ -0,0 +1,37 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Voltage based state of charge
+ *
+ * Each chemistry has a table of resting cell voltages at 0%, 10% ... 100%.  When the number of cells (or the
+ * chemistry) changes the table is scaled to pack voltages once, after that a voltage is turned into a SOC by
+ * integer piecewise linear interpolation between the two surrounding points, to 1% resolution.
+ */
+
+typedef enum {
+  SOC_CHEMISTRY_LI_ION = 0,
+  SOC_CHEMISTRY_LIFEPO4,
+  SOC_NUM_CHEMISTRIES
+} soc_chemistry_t;
+
+#define SOC_TABLE_POINTS 11 // 0% to 100% in 10% steps
+
+typedef struct {
+  uint16_t pack_x100[SOC_TABLE_POINTS]; // pack volts x100 at each point
+  uint8_t chemistry;
+  uint8_t cells; // 0 until scaled
+} soc_table_t;
+
+// Rescale the table if the chemistry or number of cells differ from the last call
+void soc_table_update(soc_table_t *t, soc_chemistry_t chemistry, uint8_t cells);
+
+// 0-100
+uint8_t soc_from_voltage(const soc_table_t *t, uint16_t pack_volts_x10);
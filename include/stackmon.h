@@ -0,0 +1,47 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Stack high water mark monitor
+ *
+ * At reset the whole stack is filled with STACKMON_FILL.  The stack grows down towards its limit, so the words
+ * just above the limit that still hold the fill pattern were never used.  Instead of counting them all on every
+ * check we remember how many there were last time (the watermark only ever moves down) and look at a small
+ * window just below the previous mark.  A sweep cursor also walks the rest of the untouched area one window per
+ * check, so a deep write that skipped over some words (i.e. a big local array) is still found eventually.
+ *
+ * The lowest STACKMON_CANARY_WORDS words are a guard: if any of them changed, the stack has already overflowed.
+ *
+ * This only looks at the memory it is given, so it can be tried out on a plain array on a PC.
+ */
+
+#define STACKMON_FILL 0xDEADBEEF // see gcc_startup_nrf51.S
+#define STACKMON_WINDOW_WORDS 8 // words looked at per check, near the mark and at the sweep cursor
+#define STACKMON_CANARY_WORDS 2
+
+typedef struct {
+  const volatile uint32_t *limit; // lowest word of the stack
+  uint32_t words; // size of the stack
+  uint32_t unused; // words above the limit that still hold the fill pattern (the high water mark)
+  uint32_t sweep; // where the background sweep looks next
+} stackmon_t;
+
+// Does one full scan, so we start from the real high water mark
+void stackmon_init(stackmon_t *m, const volatile uint32_t *limit, uint32_t words);
+
+// Look for deeper stack use, constant cost per call
+void stackmon_check(stackmon_t *m);
+
+// False if the guard words at the limit were overwritten
+bool stackmon_canary_ok(const stackmon_t *m);
+
+// Bytes of stack that have never been used
+uint32_t stackmon_unused_bytes(const stackmon_t *m);
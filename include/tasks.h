@@ -0,0 +1,74 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Cooperative task scheduler
+ *
+ * Tasks run to completion from the main loop.  Each task has a period and a phase (offset within the
+ * period), so slow jobs that share a period can be spread over different ticks instead of all landing on
+ * the same one.  When several tasks are due, the one with the lowest priority number runs first, and after
+ * each run we look again so a task that became due meanwhile can jump ahead of lower priority ones.
+ *
+ * Every run is timed with a free running counter and we keep the max/total run time per task, how often it
+ * went over its budget and how many of its periods were dropped because we were running behind.
+ *
+ * Both clocks are passed in, so the scheduler can be driven by a fake clock on a PC.
+ */
+
+typedef void (*task_fn)(void);
+
+typedef struct {
+  const char *name;
+  task_fn run;
+  uint16_t period_msec;
+  uint16_t phase_msec;
+  uint8_t priority; // lower runs first
+  uint32_t budget_ticks; // run time we expect to stay within, 0 for no budget
+
+  // bookkeeping, filled in by the scheduler
+  uint32_t next_due;
+  uint32_t runs;
+  uint32_t total_ticks;
+  uint32_t max_ticks;
+  uint32_t overruns; // runs that took longer than budget_ticks
+  uint32_t missed; // periods dropped because the task was started too late
+} task_t;
+
+#define TASKS_MAX 32
+
+#define TASK(n, fn, period, phase, prio, budget) \
+  { .name = (n), .run = (fn), .period_msec = (period), .phase_msec = (phase), .priority = (prio), .budget_ticks = (budget) }
+
+typedef uint32_t (*task_clock_fn)(void);
+
+// msecs: schedules the tasks, ticks: measures run times and wraps at ticks_mask (i.e. 0xffffff for the RTC)
+// num_tasks must not exceed TASKS_MAX
+void tasks_init(task_t *tasks, uint8_t num_tasks, task_clock_fn msecs, task_clock_fn ticks, uint32_t ticks_mask);
+
+// Run every task that is due, returns the number of task runs
+uint8_t tasks_run(void);
+
+// Move overdue tasks to their latest slot without counting the skipped periods as missed.  Use this when the
+// tick was slowed down on purpose (i.e. while idle), so the tasks run once per tick without looking late.
+void tasks_resync(void);
+
+// Reset the bookkeeping of all tasks (scheduling is not affected)
+void tasks_clear_stats(void);
+
+uint8_t tasks_count(void);
+const task_t *tasks_get(uint8_t index);
+const task_t *tasks_find(const char *name); // NULL if there is no such task
+
+// Average run time in ticks
+uint32_t tasks_avg_ticks(const task_t *task);
+
+// Dropped periods summed over all tasks
+uint32_t tasks_total_missed(void);
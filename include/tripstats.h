@@ -0,0 +1,64 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "energy.h"
+
+/**
+ * Trip statistics
+ *
+ * Fed one sample per layer_2() tick (100ms).  Everything is a running sum, count or maximum, so an update is a
+ * handful of adds and compares with no division and no sample buffers, the averages are only divided out when
+ * read.  Averages are over the time we were moving (pedalling for the cadence), so stops at traffic lights
+ * don't drag them down.
+ *
+ * An average halves its sum and count together when the sum gets close to overflowing, which keeps the average
+ * but gives the samples after that twice the weight.  That first happens after about 60 hours of riding, and is the
+ * only time an update divides (to make the count even first).
+ */
+
+#define TRIPSTATS_LEVELS 10 // assist levels 0-9
+#define TRIPSTATS_MOVING_SPEED_X10 20 // below 2km/h we are standing still
+#define TRIPSTATS_SUM_LIMIT 0x80000000UL
+
+typedef struct {
+  uint32_t sum;
+  uint32_t count;
+} tripstats_avg_t;
+
+typedef struct {
+  uint32_t moving_ds; // 0.1s units
+  uint16_t max_speed_x10;
+  uint16_t max_motor_power;
+  tripstats_avg_t speed_x10;
+  tripstats_avg_t motor_power;
+  tripstats_avg_t human_power;
+  tripstats_avg_t cadence;
+  uint32_t level_ds[TRIPSTATS_LEVELS]; // time moving in each assist level
+  energy_t level_energy[TRIPSTATS_LEVELS]; // battery energy used in each assist level
+} tripstats_t;
+
+typedef struct {
+  uint16_t speed_x10;
+  uint16_t motor_power; // W
+  uint16_t human_power; // W
+  uint8_t cadence; // rpm
+  uint8_t assist_level;
+  uint32_t power_x50; // battery power for the energy, see energy_add()
+} tripstats_sample_t;
+
+void tripstats_reset(tripstats_t *t);
+
+// Call every 100ms
+void tripstats_update(tripstats_t *t, const tripstats_sample_t *s);
+
+// 0 if there were no samples yet
+uint32_t tripstats_average(const tripstats_avg_t *a);
+
+uint32_t tripstats_moving_sec(const tripstats_t *t);
@@ -5,6 +5,8 @@ void uart_init(void);
 const uint8_t* uart_get_rx_buffer_rdy(void);
 uint8_t* uart_get_tx_buffer(void);
 void uart_send_tx_buffer(uint8_t* tx_buffer);
+uint32_t uart_get_rx_frames_ok(void);
+uint32_t uart_get_rx_frames_bad(void);
 
 #define UART_NUMBER_DATA_BYTES_TO_RECEIVE   25  // change this value depending on how many data bytes there is to receive ( Package = one start byte + data bytes + two bytes 16 bit CRC )
 #define UART_NUMBER_DATA_BYTES_TO_SEND      6   // change this value depending on how many data bytes there is to send ( Package = one start byte + data bytes + two bytes 16 bit CRC )
@@ -0,0 +1,46 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Hardware watchdog
+ *
+ * The WDT is only fed while every critical part of the firmware has checked in within its own deadline (see
+ * checkin.h), so a hung render or a stopped motor comms loop resets us just like a hung main loop would.  If the
+ * watchdog fires we note which client was overdue in RAM that survives the reset, and show it on the next boot.
+ */
+
+// Watchdog clients, in the order they are checked (most specific first, so the real culprit is reported)
+typedef enum {
+  WATCHDOG_FLASH = 0, // only watched while waiting for a flash operation
+  WATCHDOG_MOTOR, // layer_2() motor comms, from the gui timer ISR
+  WATCHDOG_RENDER, // screen_clock()
+  WATCHDOG_MAIN, // the main loop
+  WATCHDOG_NUM_CLIENTS
+} watchdog_client_t;
+
+// Call first thing in main, before the SoftDevice owns the POWER peripheral
+void watchdog_read_reset_reason(void);
+
+// Why we last reset, i.e. "power on" or "WDT render"
+const char *watchdog_reset_reason(void);
+
+// Start the hardware watchdog, it can't be stopped again
+void watchdog_init(void);
+
+void watchdog_checkin(watchdog_client_t client);
+void watchdog_busy(watchdog_client_t client, bool busy);
+
+// Feed the WDT if nobody is overdue, call at least every WATCHDOG_SERVICE_MSEC
+#define WATCHDOG_SERVICE_MSEC 100
+void watchdog_service(void);
+
+// Feed unconditionally, only for places that deliberately wait forever (the fault screen, powering off)
+void watchdog_feed(void);
@@ -9,16 +9,7 @@
 #include "stdio.h"
 
 #include "buttons.h"
-
-uint32_t ui32_onoff_button_state = 0;
-uint32_t ui32_onoff_button_state_counter = 0;
-uint32_t ui32_down_button_state = 0;
-uint32_t ui32_down_button_state_counter = 0;
-uint32_t ui32_up_button_state = 0;
-uint32_t ui32_up_button_state_counter = 0;
-uint32_t ui32_m_button_state = 0;
-uint32_t ui32_m_button_state_counter = 0;
-uint32_t ui32_m_clear_event = 0;
+#include "gestures.h"
 
 buttons_events_t buttons_events = 0;
 
@@ -44,24 +35,125 @@ uint32_t buttons_get_onoff_state (void)
 #else
 #include "main.h"
 
+/* Button levels are debounced from the timestamped GPIOTE edges (see PopButtonEdge()).  A level only counts
+ * once it has been stable for BUTTONS_DEBOUNCE_MSEC, then it is handed to the gesture engine with the time
+ * the level really changed.
+ */
+#define BUTTONS_DEBOUNCE_MSEC 10
+
+typedef struct {
+  bool raw; // level of the last edge
+  bool stable; // debounced level
+  uint32_t rawTime; // when raw last changed
+} button_debounce_t;
+
+static button_debounce_t debounce[BUTTON_COUNT];
+static Button *debounceButtons[BUTTON_COUNT] = { &buttonPWR, &buttonM, &buttonUP, &buttonDWN };
+
+/* One row per button, indexed by ButtonId */
+static const gesture_button_t gestures_buttons[BUTTON_COUNT] = {
+  [BUTTON_PWR] = { .click = ONOFF_CLICK, .click_long_click = ONOFF_CLICK_LONG_CLICK, .long_click = ONOFF_LONG_CLICK, .long_click_msec = 2000 },
+  [BUTTON_M] = { .click = M_CLICK, .click_long_click = M_CLICK_LONG_CLICK, .long_click = M_LONG_CLICK, .long_click_msec = 1000 },
+  [BUTTON_UP] = { .click = UP_CLICK, .click_long_click = UP_CLICK_LONG_CLICK, .long_click = UP_LONG_CLICK, .long_click_msec = 1000 },
+  [BUTTON_DOWN] = { .click = DOWN_CLICK, .click_long_click = DOWN_CLICK_LONG_CLICK, .long_click = DOWN_LONG_CLICK, .long_click_msec = 1000 },
+};
+
+static const gesture_chord_t gestures_chords[] = {
+  { .buttons = (1 << BUTTON_UP) | (1 << BUTTON_DOWN), .event = UPDOWN_CLICK },
+};
+
+static const gesture_timing_t gestures_timing = {
+  .quick_click_msec = 40, // only a very short tap starts a click + long click, so normal clicks are reported on release
+  .second_press_msec = 400,
+  .click_long_click_msec = 1000,
+  .repeat_delay_msec = 500,
+  .repeat_msec = 200,
+  .repeat_min_msec = 50,
+  .repeat_accel_count = 5,
+};
+
+static const gesture_config_t gestures_config = {
+  .buttons = gestures_buttons,
+  .num_buttons = BUTTON_COUNT,
+  .chords = gestures_chords,
+  .num_chords = sizeof(gestures_chords) / sizeof(gestures_chords[0]),
+  .timing = &gestures_timing,
+};
+
+static gesture_engine_t gestures;
+
+void buttons_init(void)
+{
+  for(int i = 0; i < BUTTON_COUNT; i++) {
+    debounce[i].raw = debounce[i].stable = PollButton(debounceButtons[i]);
+    debounce[i].rawTime = get_msecs();
+  }
+
+  gesture_init(&gestures, &gestures_config, get_msecs());
+  InitButtonEdges(debounceButtons);
+}
+
+// Accept the raw level if it has not changed for the debounce time as of 'now'
+static void buttons_settle(ButtonId id, uint32_t now)
+{
+  button_debounce_t *b = &debounce[id];
+
+  if(b->raw != b->stable && now - b->rawTime >= BUTTONS_DEBOUNCE_MSEC) {
+    b->stable = b->raw;
+    gesture_edge(&gestures, id, b->stable, b->rawTime, &buttons_events);
+  }
+}
+
+static void buttons_debounce(void)
+{
+  ButtonEdge edge;
+
+  // Edges are handled in order, so a short press between two of our calls is not lost
+  while(PopButtonEdge(&edge)) {
+    buttons_settle(edge.Id, edge.Time);
+    debounce[edge.Id].raw = edge.Pressed;
+    debounce[edge.Id].rawTime = edge.Time;
+  }
+
+  uint32_t now = get_msecs();
+  for(int i = 0; i < BUTTON_COUNT; i++) {
+    button_debounce_t *b = &debounce[i];
+
+    // Resync with the pin if we missed an edge (queue overflow, or interrupts blocked in a fault handler)
+    if(now - b->rawTime >= BUTTONS_DEBOUNCE_MSEC && PollButton(debounceButtons[i]) != b->raw) {
+      b->raw = !b->raw;
+      b->rawTime = now;
+    }
+
+    buttons_settle(i, now);
+  }
+
+  gesture_update(&gestures, now, &buttons_events);
+}
+
+static uint32_t buttons_get_state(ButtonId id)
+{
+  return debounce[id].stable;
+}
+
 uint32_t buttons_get_up_state (void)
 {
-  return PollButton(&buttonUP);
+  return buttons_get_state(BUTTON_UP);
 }
 
 uint32_t buttons_get_down_state (void)
 {
-  return PollButton(&buttonDWN);
+  return buttons_get_state(BUTTON_DOWN);
 }
 
 uint32_t buttons_get_onoff_state (void)
 {
-  return PollButton(&buttonPWR);
+  return buttons_get_state(BUTTON_PWR);
 }
 
 uint32_t buttons_get_m_state (void)
 {
-  return PollButton(&buttonM);
+  return buttons_get_state(BUTTON_M);
 }
 #endif
 
@@ -209,448 +301,46 @@ void buttons_set_events (buttons_events_t events)
 
 void buttons_clear_all_events (void)
 {
-  ui32_m_clear_event = 1;
   buttons_events = 0;
-  ui32_onoff_button_state = 0;
-  ui32_up_button_state = 0;
-  ui32_down_button_state = 0;
-  ui32_m_button_state = 0;
+  gesture_reset(&gestures); // require a new press
 }
 
-void buttons_clock (void)
+void buttons_set_repeating (buttons_events_t clicks)
 {
-  // needed if the event is not cleared anywhere else
-  buttons_clear_onoff_click_long_click_event();
+  uint8_t buttons = 0;
 
-  // exit if any button is pressed after clear event
-  if((ui32_m_clear_event) &&
-      (buttons_get_up_state() ||
-      buttons_get_down_state() ||
-      buttons_get_onoff_state()))
-  {
-    return;
-  }
-  else
-  {
-    ui32_m_clear_event = 0;
-  }
+  for(int i = 0; i < BUTTON_COUNT; i++)
+    if(gestures_buttons[i].click & clicks)
+      buttons |= 1 << i;
 
-  switch (ui32_onoff_button_state)
-  {
-    case 0:
-      if (!buttons_get_onoff_click_event() &&
-          !buttons_get_onoff_long_click_event() &&
-          !buttons_get_onoff_click_long_click_event() &&
-          buttons_get_onoff_state ())
-        {
-          ui32_onoff_button_state_counter = 0;
-          ui32_onoff_button_state = 1;
-        }
-    break;
-
-    case 1:
-      ui32_onoff_button_state_counter++;
-
-      // event long click
-      if (ui32_onoff_button_state_counter > 100) // 2 seconds
-      {
-        buttons_set_events(ONOFF_LONG_CLICK);
-        ui32_onoff_button_state = 2;
-        break;
-      }
-
-      // if button release
-      if (!buttons_get_onoff_state ())
-      {
-        // let's validade if will be a quick click + long click
-        if (ui32_onoff_button_state_counter <= 2) // 0.3 second
-        {
-          ui32_onoff_button_state_counter = 0;
-          ui32_onoff_button_state = 3;
-          break;
-        }
-        // event click
-        else
-        {
-          buttons_set_events(ONOFF_CLICK);
-          ui32_onoff_button_state = 0;
-          break;
-        }
-      }
-    break;
-
-    case 2:
-      // wait for button release
-      if (!buttons_get_onoff_state ())
-      {
-        ui32_onoff_button_state = 0;
-        break;
-      }
-    break;
-
-    case 3:
-      ui32_onoff_button_state_counter++;
-
-      // on next step, start counting for long click
-      if (buttons_get_onoff_state ())
-      {
-        ui32_onoff_button_state_counter = 0;
-        ui32_onoff_button_state = 4;
-        break;
-      }
-
-      // event click
-      if (ui32_onoff_button_state_counter > 20)
-      {
-        buttons_set_events(ONOFF_CLICK);
-        ui32_onoff_button_state = 0;
-        break;
-      }
-    break;
-
-    case 4:
-      ui32_onoff_button_state_counter++;
-
-      // event click, but this time it is: click + long click
-      if (ui32_onoff_button_state_counter > 50)
-      {
-        buttons_set_events(ONOFF_CLICK_LONG_CLICK);
-        ui32_onoff_button_state = 2;
-        break;
-      }
-
-      // button release
-      if (!buttons_get_onoff_state ())
-      {
-        buttons_set_events(ONOFF_CLICK);
-        ui32_onoff_button_state = 0;
-        break;
-      }
-    break;
-
-    default:
-      ui32_onoff_button_state = 0;
-    break;
-  }
+  gesture_set_repeating(&gestures, buttons);
+}
 
-  switch (ui32_m_button_state)
-  {
-    case 0:
-      if (!buttons_get_m_click_event() &&
-          !buttons_get_m_long_click_event() &&
-          !buttons_get_m_click_long_click_event() &&
-          buttons_get_m_state())
-        {
-          ui32_m_button_state_counter = 0;
-          ui32_m_button_state = 1;
-        }
-    break;
-
-    case 1:
-      ui32_m_button_state_counter++;
-
-      // event long click
-      if (ui32_m_button_state_counter++ > 100) // 2 seconds
-      {
-        buttons_set_events(M_LONG_CLICK);
-
-        ui32_m_button_state = 2;
-        ui32_m_button_state_counter = 0;
-        break;
-      }
-
-      // if button release
-      if (!buttons_get_m_state ())
-      {
-        // let's validade if will be a quick click + long click
-        if (ui32_m_button_state_counter <= 2) // 0.3 second
-        {
-          ui32_m_button_state_counter = 0;
-          ui32_m_button_state = 3;
-          break;
-        }
-        // event click
-        else
-        {
-          buttons_set_events(M_CLICK);
-          ui32_m_button_state = 0;
-          break;
-        }
-      }
-    break;
-
-    case 2:
-      // wait for button release
-      if (!buttons_get_m_state ())
-      {
-        ui32_m_button_state = 0;
-        break;
-      }
-    break;
-
-    case 3:
-      ui32_m_button_state_counter++;
-
-      // on next step, start counting for long click
-      if (buttons_get_m_state ())
-      {
-        ui32_m_button_state_counter = 0;
-        ui32_m_button_state = 4;
-        break;
-      }
-
-      // event click
-      if (ui32_m_button_state_counter > 20)
-      {
-        buttons_set_events(M_CLICK);
-        ui32_m_button_state = 0;
-        break;
-      }
-    break;
-
-    case 4:
-      ui32_m_button_state_counter++;
-
-      // event click, but this time it is: click + long click
-      if (ui32_m_button_state_counter > 50)
-      {
-        buttons_set_events(M_CLICK_LONG_CLICK);
-        ui32_m_button_state = 2;
-        break;
-      }
-
-      // button release
-      if (!buttons_get_m_state ())
-      {
-        buttons_set_events(M_CLICK);
-        ui32_m_button_state = 0;
-        break;
-      }
-    break;
-
-    default:
-      ui32_m_button_state = 0;
-    break;
-  }
+uint32_t buttons_get_held_msecs (buttons_events_t click)
+{
+  for(int i = 0; i < BUTTON_COUNT; i++)
+    if(gestures_buttons[i].click & click)
+      return gesture_held_msec(&gestures, i);
 
-  switch (ui32_up_button_state)
-  {
-    case 0:
-      if (!buttons_get_up_click_event() &&
-          !buttons_get_up_long_click_event() &&
-          !buttons_get_up_click_long_click_event() &&
-          !buttons_get_up_down_click_event() &&
-          buttons_get_up_state())
-        {
-          ui32_up_button_state_counter = 0;
-          ui32_up_button_state = 1;
-        }
-    break;
-
-    case 1:
-      ui32_up_button_state_counter++;
-
-      // event long click
-      if (ui32_up_button_state_counter++ > 100) // 2 seconds
-      {
-        // up and down button click
-        if (ui32_down_button_state == 1)
-        {
-          buttons_set_events(UPDOWN_CLICK);
-          ui32_down_button_state = 2;
-        }
-        else
-        {
-          buttons_set_events(UP_LONG_CLICK);
-        }
-
-        ui32_up_button_state = 2;
-        ui32_up_button_state_counter = 0;
-        break;
-      }
-
-      // if button release
-      if (!buttons_get_up_state ())
-      {
-        // let's validade if will be a quick click + long click
-        if (ui32_up_button_state_counter <= 2) // 0.3 second
-        {
-          ui32_up_button_state_counter = 0;
-          ui32_up_button_state = 3;
-          break;
-        }
-        // event click
-        else
-        {
-          buttons_set_events(UP_CLICK);
-          ui32_up_button_state = 0;
-          break;
-        }
-      }
-    break;
-
-    case 2:
-      // wait for button release
-      if (!buttons_get_up_state ())
-      {
-        ui32_up_button_state = 0;
-        break;
-      }
-    break;
-
-    case 3:
-      ui32_up_button_state_counter++;
-
-      // on next step, start counting for long click
-      if (buttons_get_up_state ())
-      {
-        ui32_up_button_state_counter = 0;
-        ui32_up_button_state = 4;
-        break;
-      }
-
-      // event click
-      if (ui32_up_button_state_counter > 20)
-      {
-        buttons_set_events(UP_CLICK);
-        ui32_up_button_state = 0;
-        break;
-      }
-    break;
-
-    case 4:
-      ui32_up_button_state_counter++;
-
-      // event click, but this time it is: click + long click
-      if (ui32_up_button_state_counter > 50)
-      {
-        buttons_set_events(UP_CLICK_LONG_CLICK);
-        ui32_up_button_state = 2;
-        break;
-      }
-
-      // button release
-      if (!buttons_get_up_state ())
-      {
-        buttons_set_events(UP_CLICK);
-        ui32_up_button_state = 0;
-        break;
-      }
-    break;
-
-    default:
-      ui32_up_button_state = 0;
-    break;
-  }
+  return 0;
+}
 
-  switch (ui32_down_button_state)
-  {
-    case 0:
-      if (!buttons_get_down_click_event() &&
-          !buttons_get_down_long_click_event() &&
-          !buttons_get_down_click_long_click_event() &&
-          !buttons_get_up_down_click_event() &&
-          buttons_get_down_state())
-        {
-          ui32_down_button_state_counter = 0;
-          ui32_down_button_state = 1;
-        }
-    break;
-
-    case 1:
-      ui32_down_button_state_counter++;
-
-      // event long click
-      if (ui32_down_button_state_counter++ > 100) // 2 seconds
-      {
-        // up and down button click
-        if (ui32_up_button_state == 1)
-        {
-          buttons_set_events(UPDOWN_CLICK);
-          ui32_up_button_state = 2;
-        }
-        else
-        {
-          buttons_set_events(DOWN_LONG_CLICK);
-        }
-
-        ui32_down_button_state = 2;
-        ui32_down_button_state_counter = 0;
-        break;
-      }
-
-
-      // if button release
-      if (!buttons_get_down_state ())
-      {
-        // let's validade if will be a quick click + long click
-        if (ui32_down_button_state_counter <= 2) // 0.3 second
-        {
-          ui32_down_button_state_counter = 0;
-          ui32_down_button_state = 3;
-          break;
-        }
-        // event click
-        else
-        {
-          buttons_set_events(DOWN_CLICK);
-          ui32_down_button_state = 0;
-          break;
-        }
-      }
-    break;
-
-    case 2:
-      // wait for button release
-      if (!buttons_get_down_state ())
-      {
-        ui32_down_button_state = 0;
-        break;
-      }
-    break;
-
-    case 3:
-      ui32_down_button_state_counter++;
-
-      // on next step, start counting for long click
-      if (buttons_get_down_state ())
-      {
-        ui32_down_button_state_counter = 0;
-        ui32_down_button_state = 4;
-        break;
-      }
-
-      // event click
-      if (ui32_down_button_state_counter > 15)
-      {
-        buttons_set_events(DOWN_CLICK);
-        ui32_down_button_state = 0;
-        break;
-      }
-    break;
-
-    case 4:
-      ui32_down_button_state_counter++;
-
-      // event click, but this time it is: click + long click
-      if (ui32_down_button_state_counter > 50)
-      {
-        buttons_set_events(DOWN_CLICK_LONG_CLICK);
-        ui32_down_button_state = 2;
-        break;
-      }
-
-      // button release
-      if (!buttons_get_down_state ())
-      {
-        buttons_set_events(DOWN_CLICK);
-        ui32_down_button_state = 0;
-        break;
-      }
-    break;
-
-    default:
-      ui32_down_button_state = 0;
-    break;
-  }
+bool buttons_is_idle (void)
+{
+  if(buttons_events || HasButtonEdges() || !gesture_is_idle(&gestures))
+    return false;
+
+  for(int i = 0; i < BUTTON_COUNT; i++)
+    if(debounce[i].raw != debounce[i].stable)
+      return false;
+
+  return true;
+}
+
+void buttons_clock (void)
+{
+  // needed if the event is not cleared anywhere else
+  buttons_clear_onoff_click_long_click_event();
+
+  buttons_debounce();
 }
@@ -0,0 +1,43 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "checkin.h"
+
+void checkin_init(checkin_t *c, const checkin_client_t *clients, uint8_t num_clients, uint32_t now) {
+  c->clients = clients;
+  c->num_clients = num_clients;
+  c->busy = 0;
+
+  for (uint8_t i = 0; i < num_clients; i++)
+    c->last[i] = now;
+}
+
+void checkin(checkin_t *c, uint8_t client, uint32_t now) {
+  c->last[client] = now;
+}
+
+void checkin_busy(checkin_t *c, uint8_t client, bool busy, uint32_t now) {
+  c->last[client] = now;
+
+  if (busy)
+    c->busy |= 1 << client;
+  else
+    c->busy &= ~(1 << client);
+}
+
+int8_t checkin_overdue(const checkin_t *c, uint32_t now) {
+  for (uint8_t i = 0; i < c->num_clients; i++) {
+    const checkin_client_t *client = &c->clients[i];
+
+    if (client->only_when_busy && !(c->busy & (1 << i)))
+      continue;
+
+    if (now - c->last[i] > client->deadline_msec)
+      return i;
+  }
+
+  return CHECKIN_NONE;
+}
@@ -15,6 +15,7 @@ static Field batteryMenus[] = {
     FIELD_EDITABLE_UINT("Current ramp", &l3_vars.ui8_ramp_up_amps_per_second_x10, "amps", 4, 255, .div_digits = 1),
     FIELD_EDITABLE_UINT("Low cut-off", &l3_vars.ui16_battery_low_voltage_cut_off_x10, "volts", 160, 630, .div_digits = 1),
     FIELD_EDITABLE_UINT("Number of cells", &l3_vars.ui8_battery_cells_number, "", 7, 14),
+    FIELD_EDITABLE_ENUM("Chemistry", &l3_vars.ui8_battery_chemistry, "Li-ion", "LiFePO4"),
     FIELD_EDITABLE_UINT("Resistance", &l3_vars.ui16_battery_pack_resistance_x1000, "mohm", 0, 1000),
     FIELD_READONLY_UINT("Voltage", &l3_vars.ui16_battery_voltage_soc_x10, "volts", .div_digits = 1),
     FIELD_END
@@ -84,6 +85,7 @@ static Field motorTempMenus[] = {
 
 static Field displayMenus[] = {
     FIELD_EDITABLE_UINT("Auto poweroff", &l3_vars.ui8_lcd_power_off_time_minutes, "mins", 0, 255),
+    FIELD_EDITABLE_ENUM("Diagnostics", &l3_vars.ui8_diagnostics_screen, "hide", "show"),
     // FIELD_EDITABLE_UINT("Reset to defaults", &ui8_reset_to_defaults_counter, "", 0, 255), // FIXME, make sure if the user incs to 10 we are doing the reset
     FIELD_END
 };
@@ -146,7 +148,7 @@ static void configExit() {
 //
 // Screens
 //
-Screen configScreen = {
+const Screen configScreen = {
     .onExit = configExit,
 
     .fields = {
@@ -0,0 +1,92 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "coulomb.h"
+
+#define MIN_CAPACITY_MAS (1000UL * 3600) // 1Ah, anything less is nonsense
+
+static void set_capacity(coulomb_t *c, uint32_t capacity_mas)
+{
+  if (capacity_mas < MIN_CAPACITY_MAS)
+    capacity_mas = MIN_CAPACITY_MAS;
+
+  c->capacity_mas = capacity_mas;
+  c->percent_mas = capacity_mas / 100;
+  c->recip = (((uint64_t) 1000 << 32) + capacity_mas - 1) / capacity_mas; // rounded up, so whole percents aren't shown 0.1% low
+
+  if (c->remaining_mas > capacity_mas)
+    c->remaining_mas = capacity_mas;
+}
+
+static void update_soc(coulomb_t *c)
+{
+  c->soc_x10 = ((uint64_t) c->remaining_mas * c->recip) >> 32;
+}
+
+void coulomb_init(coulomb_t *c, uint32_t capacity_mas, uint32_t remaining_mas)
+{
+  c->remaining_mas = remaining_mas ? remaining_mas : capacity_mas / 2;
+  c->cycle_used_mas = 0;
+  c->rest_updates = 0;
+  c->synced = false;
+  c->cycle_full = false;
+  set_capacity(c, capacity_mas);
+  update_soc(c);
+}
+
+// The voltage can be trusted, pull the count towards it and look for full cycles
+static void rested(coulomb_t *c, uint8_t volt_soc)
+{
+  uint32_t target = c->percent_mas * volt_soc;
+
+  if (!c->synced) {
+    c->remaining_mas = target;
+    c->synced = true;
+  }
+  else if (target > c->remaining_mas)
+    c->remaining_mas += (target - c->remaining_mas) >> COULOMB_CORRECTION_SHIFT;
+  else
+    c->remaining_mas -= (c->remaining_mas - target) >> COULOMB_CORRECTION_SHIFT;
+
+  if (volt_soc >= COULOMB_FULL_SOC) {
+    c->cycle_full = true;
+    c->cycle_used_mas = 0;
+  }
+  else if (c->cycle_full && volt_soc <= COULOMB_LEARN_SOC) {
+    // what we drew was (100 - volt_soc)% of the pack
+    uint32_t measured = c->cycle_used_mas / (100 - volt_soc) * 100;
+
+    if (measured > c->capacity_mas)
+      set_capacity(c, c->capacity_mas + ((measured - c->capacity_mas) >> COULOMB_LEARN_SHIFT));
+    else
+      set_capacity(c, c->capacity_mas - ((c->capacity_mas - measured) >> COULOMB_LEARN_SHIFT));
+
+    c->cycle_full = false; // once per cycle
+  }
+}
+
+void coulomb_update(coulomb_t *c, uint8_t current_x5, uint8_t volt_soc)
+{
+  uint32_t used = (uint32_t) current_x5 * COULOMB_MAS_PER_CURRENT_X5;
+
+  c->remaining_mas = c->remaining_mas > used ? c->remaining_mas - used : 0;
+  c->cycle_used_mas += used;
+
+  if (current_x5 > COULOMB_REST_CURRENT_X5)
+    c->rest_updates = 0;
+  else if (c->rest_updates < COULOMB_REST_UPDATES)
+    c->rest_updates++;
+  else
+    rested(c, volt_soc);
+
+  update_soc(c);
+}
+
+uint32_t coulomb_capacity_from_wh(uint32_t wh_x10, uint8_t cells)
+{
+  // Ah = Wh / (cells * 3.6V nominal), mA*s = Ah * 3600000
+  return cells ? wh_x10 * 100000 / cells : 0;
+}
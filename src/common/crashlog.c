@@ -0,0 +1,203 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "crashlog.h"
+#include "fault.h"
+#include "hardfault.h"
+#include "main.h"
+#include "uart.h"
+#include "eeprom_hw.h"
+
+#define FILE_ID 0x1002 // see eeprom_hw.c for the preferences file
+#define REC_KEY(slot) (0x3001 + (slot))
+
+#define RECORD_WORDS (sizeof(crashlog_record_t) / sizeof(uint32_t))
+
+extern uint32_t __StackTop;
+
+// Survives the reset that follows a fault, see gcc_nrf51.ld
+static crashlog_record_t pending __attribute__((section(".noinit")));
+
+static crashlog_send_fn sender;
+static volatile bool dumpRequested, stopRequested, clearRequested;
+static bool dumping;
+static uint8_t dumpSlot, dumpOffset, dumpCount;
+static crashlog_record_t dumpRecord;
+
+void crashlog_capture(uint32_t id, uint32_t pc, uint32_t info, uint32_t lr)
+{
+  crashlog_record_t *r = &pending;
+
+  if (r->magic == CRASHLOG_MAGIC)
+    return; // faulted again (i.e. while drawing the fault screen) before the first one was saved, keep the first
+
+  memset(r, 0, sizeof(*r));
+  r->id = id;
+  r->pc = pc;
+  r->lr = lr;
+  r->info = info;
+
+  const uint32_t *sp = __builtin_frame_address(0);
+
+  switch (id)
+  {
+  case FAULT_HARDFAULT:
+    if (info) { // null if the stack overflowed, we have no registers then
+      const HardFault_stack_t *hs = (const HardFault_stack_t *) info;
+
+      r->r0 = hs->r0;
+      r->r1 = hs->r1;
+      r->r2 = hs->r2;
+      r->r3 = hs->r3;
+      r->r12 = hs->r12;
+      r->lr = hs->lr;
+      r->psr = hs->psr;
+      sp = (const uint32_t *) hs; // the frame the CPU stacked, followed by what the failing code had pushed
+    }
+    break;
+
+  case FAULT_SOFTDEVICE:
+  case FAULT_NRFASSERT:
+  case FAULT_GCC_ASSERT:
+  case NRF_FAULT_ID_SDK_ERROR:
+  case NRF_FAULT_ID_SDK_ASSERT:
+    if (info) { // assert_info_t starts just like error_info_t
+      const error_info_t *einfo = (const error_info_t *) info;
+
+      r->file = (uint32_t) einfo->p_file_name;
+      r->line = einfo->line_num;
+      if (id != NRF_FAULT_ID_SDK_ASSERT)
+        r->info = einfo->err_code;
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  r->sp = (uint32_t) sp;
+  for (uint8_t i = 0; i < CRASHLOG_STACK_WORDS && sp + i < &__StackTop; i++)
+    r->stack[i] = sp[i];
+
+  r->uptime_msec = get_msecs();
+  r->uart_rx_ok = uart_get_rx_frames_ok();
+  r->uart_rx_bad = uart_get_rx_frames_bad();
+  r->stack_unused = stack_overflow_debug();
+  strncpy(r->version, VERSION_STRING, CRASHLOG_VERSION_LEN);
+
+  r->magic = CRASHLOG_MAGIC;
+}
+
+// The newest saved record's seq (0 if there are none)
+static uint32_t newest_seq(void)
+{
+  uint32_t seq = 0;
+
+  for (uint8_t slot = 0; slot < CRASHLOG_MAX_RECORDS; slot++) {
+    crashlog_record_t r = { 0 };
+
+    if (flash_read_record(FILE_ID, REC_KEY(slot), &r, RECORD_WORDS) && r.seq > seq)
+      seq = r.seq;
+  }
+
+  return seq;
+}
+
+void crashlog_save(void)
+{
+  if (pending.magic != CRASHLOG_MAGIC)
+    return;
+
+  // The oldest record is replaced
+  pending.seq = newest_seq() + 1;
+  pending.magic = 0;
+  flash_write_record(FILE_ID, REC_KEY(pending.seq % CRASHLOG_MAX_RECORDS), &pending, RECORD_WORDS);
+}
+
+void crashlog_dump_start(crashlog_send_fn send)
+{
+  sender = send;
+  dumpRequested = true;
+}
+
+void crashlog_dump_stop(void)
+{
+  stopRequested = true;
+}
+
+void crashlog_clear(void)
+{
+  clearRequested = true;
+}
+
+// Load the next saved record into dumpRecord, returns false once all slots have been looked at
+static bool next_record(void)
+{
+  while (dumpSlot < CRASHLOG_MAX_RECORDS) {
+    memset(&dumpRecord, 0, sizeof(dumpRecord));
+    bool found = flash_read_record(FILE_ID, REC_KEY(dumpSlot), &dumpRecord, RECORD_WORDS);
+
+    dumpSlot++;
+    if (found) {
+      dumpOffset = 0;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void crashlog_dump_service(void)
+{
+  if (stopRequested) {
+    stopRequested = false;
+    dumping = false;
+  }
+
+  if (clearRequested) {
+    clearRequested = false;
+    flash_delete_file(FILE_ID);
+  }
+
+  if (dumpRequested) {
+    dumpRequested = false;
+    dumping = true;
+    dumpSlot = dumpCount = 0;
+    dumpOffset = RECORD_WORDS; // nothing loaded yet
+  }
+
+  if (!dumping)
+    return;
+
+  uint8_t pkt[19];
+
+  for (;;) {
+    if (dumpOffset >= RECORD_WORDS && !next_record()) {
+      pkt[0] = CRASHLOG_PKT_END;
+      pkt[1] = dumpCount;
+      if (sender(pkt, 2))
+        dumping = false;
+      return;
+    }
+
+    uint8_t n = RECORD_WORDS - dumpOffset;
+    if (n > 4)
+      n = 4;
+
+    pkt[0] = CRASHLOG_PKT_RECORD;
+    pkt[1] = dumpCount;
+    pkt[2] = dumpOffset;
+    memcpy(&pkt[3], (const uint32_t *) &dumpRecord + dumpOffset, n * sizeof(uint32_t));
+
+    if (!sender(pkt, 3 + n * sizeof(uint32_t)))
+      return; // link is full, the same packet is built again on a later call
+
+    dumpOffset += n;
+    if (dumpOffset >= RECORD_WORDS)
+      dumpCount++;
+  }
+}
@@ -97,6 +97,8 @@ const eeprom_data_t m_eeprom_data_defaults =
         DEFAULT_VALUE_WALK_ASSIST_LEVEL_FACTOR_7,
         DEFAULT_VALUE_WALK_ASSIST_LEVEL_FACTOR_8,
         DEFAULT_VALUE_WALK_ASSIST_LEVEL_FACTOR_9 },
+        .ui8_diagnostics_screen = DEFAULT_VALUE_DIAGNOSTICS_SCREEN,
+        .ui8_battery_chemistry = DEFAULT_VALUE_BATTERY_CHEMISTRY,
 #if 0
   .lcd_configurations_menu = {
     .ui8_item_number = 1,
@@ -123,8 +125,29 @@ void eeprom_init()
   // Perform whatever migrations we need to update old eeprom formats
   if(m_eeprom_data.eeprom_version < EEPROM_VERSION) {
 
-    m_eeprom_data.ui8_lcd_backlight_on_brightness = m_eeprom_data_defaults.ui8_lcd_backlight_on_brightness;
-    m_eeprom_data.ui8_lcd_backlight_off_brightness = m_eeprom_data_defaults.ui8_lcd_backlight_off_brightness;
+    if(m_eeprom_data.eeprom_version < 0x11) {
+      m_eeprom_data.ui8_lcd_backlight_on_brightness = m_eeprom_data_defaults.ui8_lcd_backlight_on_brightness;
+      m_eeprom_data.ui8_lcd_backlight_off_brightness = m_eeprom_data_defaults.ui8_lcd_backlight_off_brightness;
+    }
+
+    if(m_eeprom_data.eeprom_version < 0x12)
+      m_eeprom_data.ui8_diagnostics_screen = m_eeprom_data_defaults.ui8_diagnostics_screen;
+
+    if(m_eeprom_data.eeprom_version < 0x13)
+      m_eeprom_data.ui8_battery_chemistry = m_eeprom_data_defaults.ui8_battery_chemistry;
+
+    if(m_eeprom_data.eeprom_version < 0x14) {
+      m_eeprom_data.ui32_soc_capacity_mas = 0; // learn it again
+      m_eeprom_data.ui32_soc_remaining_mas = 0;
+    }
+
+    if(m_eeprom_data.eeprom_version < 0x15)
+      m_eeprom_data.ui32_odometer_remainder_mm = 0;
+
+    if(m_eeprom_data.eeprom_version < 0x16) {
+      m_eeprom_data.ui32_trip_x10 = 0;
+      tripstats_reset(&m_eeprom_data.trip_stats);
+    }
 
     m_eeprom_data.eeprom_version = EEPROM_VERSION;
   }
@@ -261,6 +284,18 @@ void eeprom_init_variables(void)
       m_eeprom_data.ui8_walk_assist_level_factor[7];
   p_l3_output_vars->ui8_walk_assist_level_factor[8] =
       m_eeprom_data.ui8_walk_assist_level_factor[8];
+  p_l3_output_vars->ui8_diagnostics_screen =
+      m_eeprom_data.ui8_diagnostics_screen;
+  p_l3_output_vars->ui8_battery_chemistry =
+      m_eeprom_data.ui8_battery_chemistry;
+  p_l3_output_vars->ui32_soc_capacity_mas =
+      m_eeprom_data.ui32_soc_capacity_mas;
+  p_l3_output_vars->ui32_soc_remaining_mas =
+      m_eeprom_data.ui32_soc_remaining_mas;
+  p_l3_output_vars->ui32_odometer_remainder_mm =
+      m_eeprom_data.ui32_odometer_remainder_mm;
+  p_l3_output_vars->ui32_trip_x10 = m_eeprom_data.ui32_trip_x10;
+  p_l3_output_vars->trip_stats = m_eeprom_data.trip_stats;
 
 #if 0
   p_lcd_configurations_menu->ui8_item_number = m_eeprom_data.lcd_configurations_menu.ui8_item_number;
@@ -398,6 +433,18 @@ void eeprom_write_variables(void)
       p_l3_output_vars->ui8_walk_assist_level_factor[7];
   m_eeprom_data.ui8_walk_assist_level_factor[8] =
       p_l3_output_vars->ui8_walk_assist_level_factor[8];
+  m_eeprom_data.ui8_diagnostics_screen =
+      p_l3_output_vars->ui8_diagnostics_screen;
+  m_eeprom_data.ui8_battery_chemistry =
+      p_l3_output_vars->ui8_battery_chemistry;
+  m_eeprom_data.ui32_soc_capacity_mas =
+      p_l3_output_vars->ui32_soc_capacity_mas;
+  m_eeprom_data.ui32_soc_remaining_mas =
+      p_l3_output_vars->ui32_soc_remaining_mas;
+  m_eeprom_data.ui32_odometer_remainder_mm =
+      p_l3_output_vars->ui32_odometer_remainder_mm;
+  m_eeprom_data.ui32_trip_x10 = p_l3_output_vars->ui32_trip_x10;
+  m_eeprom_data.trip_stats = p_l3_output_vars->trip_stats;
 #if 0
   m_eeprom_data.lcd_configurations_menu.ui8_item_number = p_lcd_configurations_menu->ui8_item_number;
   m_eeprom_data.lcd_configurations_menu.ui8_item_visible_start_index = p_lcd_configurations_menu->ui8_item_visible_start_index;
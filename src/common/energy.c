@@ -0,0 +1,30 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "energy.h"
+
+void energy_reset(energy_t *e)
+{
+  e->wh_x10 = 0;
+  e->mws = 0;
+}
+
+void energy_add(energy_t *e, uint32_t power_x50)
+{
+  e->mws += power_x50 * ENERGY_MWS_PER_POWER_X50;
+
+  // the most the motor reports (255 x5 amps at 100.0V) is 510000mWs per sample, so with what is left over from
+  // the last call this loops at most twice
+  while (e->mws >= ENERGY_MWS_PER_WH_X10) {
+    e->mws -= ENERGY_MWS_PER_WH_X10;
+    e->wh_x10++;
+  }
+}
+
+uint32_t energy_wh_x10(const energy_t *e)
+{
+  return e->wh_x10;
+}
@@ -8,6 +8,8 @@
 #include "main.h"
 #include "nrf_nvic.h"
 #include "nrf_delay.h"
+#include "watchdog.h"
+#include "crashlog.h"
 
 /* Note: we currently don't use-funwind-tables because it adds about 8K to text.  But if we ever need better crash reports, turn them on and use the functions
  * in unwind.h to derive the PC of the failing function and a stack trace.
@@ -16,13 +18,13 @@
 */
 
 Field faultHeading = FIELD_DRAWTEXT(.msg = "FAULT");
-Field faultCode = FIELD_DRAWTEXT();
+Field faultCode = FIELD_DRAWTEXT_BUF();
 Field addrHeading = FIELD_DRAWTEXT(.msg = "PC");
-Field addrCode = FIELD_DRAWTEXT();
+Field addrCode = FIELD_DRAWTEXT_BUF();
 Field infoHeading = FIELD_DRAWTEXT(.msg = "Info");
-Field infoCode = FIELD_DRAWTEXT();
+Field infoCode = FIELD_DRAWTEXT_BUF();
 
-Screen faultScreen = {
+const Screen faultScreen = {
     .fields = {
     { .height = -1, .color = ColorInvert, .field = &faultHeading, .font = &MY_FONT_8X12 },
 
@@ -63,7 +65,7 @@ void __attribute__((noreturn)) __assert_func(const char *file, int line,
 void HardFault_process  ( HardFault_stack_t *   p_stack ) {
   uint32_t pc = !p_stack ? 0 : p_stack->pc;
 
-  app_error_fault_handler(FAULT_GCC_ASSERT, pc, (uint32_t) &p_stack);
+  app_error_fault_handler(FAULT_HARDFAULT, pc, (uint32_t) p_stack);
 }
 
 /**@brief Function for assert macro callback.
@@ -94,6 +96,9 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name)
  */
 void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info)
 {
+  // first, before drawing the fault screen gives us a chance to fault again
+  crashlog_capture(id, pc, info, (uint32_t) __builtin_return_address(0));
+
   /*
    UG_FontSelect(&MY_FONT_8X12);
    char buf[32];
@@ -172,6 +177,7 @@ void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info)
       sd_nvic_SystemReset();
 
     nrf_delay_ms(20);
+    watchdog_feed(); // keep the fault on screen until the user has read it
     buttons_clock(); // Note: this is done _after_ button events is checked to provide a 20ms debounce
   }
 }
@@ -0,0 +1,210 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "fmt.h"
+
+#define MAX_DIGITS 10 // 4294967295
+
+static const uint32_t powers[MAX_DIGITS - 1] = { 1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10 };
+
+// Most significant digit first, returns the number of digits
+static uint8_t decimal(uint32_t num, char *digits) {
+  uint8_t n = 0;
+
+  for (uint8_t i = 0; i < MAX_DIGITS - 1; i++) {
+    char d = '0';
+    while (num >= powers[i]) {
+      num -= powers[i];
+      d++;
+    }
+
+    if (n || d != '0')
+      digits[n++] = d;
+  }
+  digits[n++] = '0' + num;
+
+  return n;
+}
+
+static void pad(fmt_t *f, char c, uint8_t width, uint8_t len) {
+  while (width-- > len)
+    fmt_char(f, c);
+}
+
+static void digits_out(fmt_t *f, const char *digits, uint8_t n) {
+  for (uint8_t i = 0; i < n; i++)
+    fmt_char(f, digits[i]);
+}
+
+void fmt_begin(fmt_t *f, char *buf, uint8_t size) {
+  f->buf = buf;
+  f->size = size;
+  f->len = 0;
+  f->changed = false;
+}
+
+bool fmt_end(fmt_t *f) {
+  if (f->buf[f->len] != '\0') {
+    f->buf[f->len] = '\0';
+    f->changed = true;
+  }
+
+  return f->changed;
+}
+
+void fmt_char(fmt_t *f, char c) {
+  if (f->len + 1 >= f->size)
+    return; // keep room for the terminator
+
+  if (f->buf[f->len] != c) {
+    f->buf[f->len] = c;
+    f->changed = true;
+  }
+  f->len++;
+}
+
+void fmt_str(fmt_t *f, const char *s) {
+  while (*s)
+    fmt_char(f, *s++);
+}
+
+void fmt_uint(fmt_t *f, uint32_t num, uint8_t width, bool zero_pad) {
+  char digits[MAX_DIGITS];
+  uint8_t n = decimal(num, digits);
+
+  pad(f, zero_pad ? '0' : ' ', width, n);
+  digits_out(f, digits, n);
+}
+
+void fmt_int(fmt_t *f, int32_t num, uint8_t width, bool zero_pad) {
+  if (num >= 0) {
+    fmt_uint(f, num, width, zero_pad);
+    return;
+  }
+
+  char digits[MAX_DIGITS];
+  uint8_t n = decimal(0 - (uint32_t) num, digits);
+
+  if (zero_pad) {
+    fmt_char(f, '-');
+    pad(f, '0', width, n + 1);
+  }
+  else {
+    pad(f, ' ', width, n + 1);
+    fmt_char(f, '-');
+  }
+  digits_out(f, digits, n);
+}
+
+void fmt_hex(fmt_t *f, uint32_t num, uint8_t width, bool zero_pad) {
+  char digits[8];
+  uint8_t n = 0;
+
+  for (int8_t shift = 28; shift >= 0; shift -= 4) {
+    uint8_t nibble = (num >> shift) & 0xf;
+    if (n || nibble || !shift)
+      digits[n++] = nibble < 10 ? '0' + nibble : 'a' - 10 + nibble;
+  }
+
+  pad(f, zero_pad ? '0' : ' ', width, n);
+  digits_out(f, digits, n);
+}
+
+void fmt_fixed(fmt_t *f, uint32_t num, uint8_t div_digits, bool hide_fraction) {
+  char digits[MAX_DIGITS];
+  uint8_t n = decimal(num, digits);
+
+  // leading zeros so there is always a digit before the point
+  uint8_t lead = n <= div_digits ? div_digits + 1 - n : 0;
+  uint8_t total = lead + n;
+  uint8_t point = total - div_digits;
+
+  for (uint8_t i = 0; i < total; i++) {
+    if (i == point) {
+      if (hide_fraction)
+        return;
+      fmt_char(f, '.');
+    }
+    fmt_char(f, i < lead ? '0' : digits[i - lead]);
+  }
+}
+
+void fmt_time(fmt_t *f, uint8_t hours, uint8_t minutes) {
+  fmt_uint(f, hours, 2, true);
+  fmt_char(f, ':');
+  fmt_uint(f, minutes, 2, true);
+}
+
+void fmt_volts_x10(fmt_t *f, uint16_t volts_x10) {
+  // one digit after the point always fits, so only the integer part needs padding
+  if (volts_x10 < 100)
+    fmt_char(f, ' ');
+  fmt_fixed(f, volts_x10, 1, false);
+  fmt_char(f, 'V');
+}
+
+void fmt_percent(fmt_t *f, uint16_t percent) {
+  fmt_uint(f, percent, 3, false);
+  fmt_char(f, '%');
+}
+
+void fmt_vformat(fmt_t *f, const char *format, va_list args) {
+  for (; *format; format++) {
+    if (*format != '%') {
+      fmt_char(f, *format);
+      continue;
+    }
+
+    format++;
+    bool zero_pad = *format == '0';
+    if (zero_pad)
+      format++;
+
+    uint8_t width = 0;
+    while (*format >= '0' && *format <= '9')
+      width = width * 10 + (*format++ - '0');
+
+    bool is_long = *format == 'l';
+    if (is_long)
+      format++;
+
+    switch (*format) {
+    case 'd':
+    case 'i':
+      fmt_int(f, is_long ? va_arg(args, long) : va_arg(args, int), width, zero_pad);
+      break;
+
+    case 'u':
+      fmt_uint(f, is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned), width, zero_pad);
+      break;
+
+    case 'x':
+      fmt_hex(f, is_long ? va_arg(args, unsigned long) : va_arg(args, unsigned), width, zero_pad);
+      break;
+
+    case 'c':
+      fmt_char(f, (char) va_arg(args, int));
+      break;
+
+    case 's': {
+      const char *s = va_arg(args, const char *);
+      uint8_t len = 0;
+      while (s[len] && len < width)
+        len++;
+      pad(f, ' ', width, len);
+      fmt_str(f, s);
+      break;
+    }
+
+    case '\0':
+      return; // a lone '%' at the end
+
+    default: // '%' and anything we don't know are copied
+      fmt_char(f, *format);
+      break;
+    }
+  }
+}
@@ -0,0 +1,221 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "gestures.h"
+
+typedef enum {
+  GESTURE_IDLE = 0,
+  GESTURE_DOWN, // first press, waiting for release or long click
+  GESTURE_WAIT_SECOND, // quick click released, waiting for a possible second press
+  GESTURE_SECOND_DOWN, // second press, waiting for release or click + long click
+  GESTURE_REPEAT, // held repeating button
+  GESTURE_WAIT_RELEASE // gesture done (or ignored), nothing more until released
+} gesture_state_t;
+
+static void set_state(gesture_button_state_t *b, gesture_state_t state, uint32_t time) {
+  b->state = state;
+  b->since = time;
+}
+
+// All the events this button can produce, including chords it is part of
+static buttons_events_t button_events(const gesture_config_t *c, uint8_t button) {
+  const gesture_button_t *d = &c->buttons[button];
+  buttons_events_t events = d->click | d->click_long_click | d->long_click | d->double_click;
+
+  for (uint8_t i = 0; i < c->num_chords; i++)
+    if (c->chords[i].buttons & (1 << button))
+      events |= c->chords[i].event;
+
+  return events;
+}
+
+// Called when a button reached its long click time, returns true if that completed a chord
+static bool check_chords(gesture_engine_t *g, uint8_t button, buttons_events_t *events) {
+  const gesture_config_t *c = g->config;
+
+  for (uint8_t i = 0; i < c->num_chords; i++) {
+    const gesture_chord_t *chord = &c->chords[i];
+    if (!(chord->buttons & (1 << button)))
+      continue;
+
+    bool all = true;
+    for (uint8_t b = 0; b < c->num_buttons; b++)
+      if ((chord->buttons & (1 << b)) && g->buttons[b].state != GESTURE_DOWN)
+        all = false;
+
+    if (all) {
+      *events |= chord->event;
+      for (uint8_t b = 0; b < c->num_buttons; b++)
+        if (chord->buttons & (1 << b))
+          set_state(&g->buttons[b], GESTURE_WAIT_RELEASE, g->now);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void update_button(gesture_engine_t *g, uint8_t button, buttons_events_t *events) {
+  const gesture_button_t *d = &g->config->buttons[button];
+  const gesture_timing_t *t = g->config->timing;
+  gesture_button_state_t *b = &g->buttons[button];
+  uint32_t held = g->now - b->since;
+
+  switch (b->state) {
+  case GESTURE_DOWN:
+    if (held >= d->long_click_msec) {
+      if (!check_chords(g, button, events)) {
+        *events |= d->long_click;
+        set_state(b, GESTURE_WAIT_RELEASE, g->now);
+      }
+    }
+    break;
+
+  case GESTURE_WAIT_SECOND:
+    if (held >= t->second_press_msec) {
+      *events |= d->click;
+      set_state(b, GESTURE_IDLE, g->now);
+    }
+    break;
+
+  case GESTURE_SECOND_DOWN:
+    if (d->click_long_click && held >= t->click_long_click_msec) {
+      *events |= d->click_long_click;
+      set_state(b, GESTURE_WAIT_RELEASE, g->now);
+    }
+    break;
+
+  case GESTURE_REPEAT:
+    while ((int32_t) (g->now - b->next_repeat) >= 0) {
+      *events |= d->click;
+      b->repeats++;
+      if (t->repeat_accel_count && b->repeats % t->repeat_accel_count == 0 && b->repeat_interval / 2 >= t->repeat_min_msec)
+        b->repeat_interval /= 2;
+      b->next_repeat += b->repeat_interval;
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void gesture_update(gesture_engine_t *g, uint32_t now, buttons_events_t *events) {
+  // Never go back in time, an edge can be reported a little after we already looked at 'now'
+  if ((int32_t) (now - g->now) > 0)
+    g->now = now;
+
+  for (uint8_t i = 0; i < g->config->num_buttons; i++)
+    update_button(g, i, events);
+}
+
+void gesture_edge(gesture_engine_t *g, uint8_t button, bool pressed, uint32_t time, buttons_events_t *events) {
+  const gesture_config_t *c = g->config;
+  const gesture_button_t *d = &c->buttons[button];
+  gesture_button_state_t *b = &g->buttons[button];
+
+  gesture_update(g, time, events); // handle anything that timed out before this edge
+
+  if (pressed)
+    g->pressed |= 1 << button;
+  else
+    g->pressed &= ~(1 << button);
+
+  uint32_t held = g->now - b->since;
+
+  switch (b->state) {
+  case GESTURE_IDLE:
+    if (!pressed)
+      break;
+
+    if (*events & button_events(c, button))
+      set_state(b, GESTURE_WAIT_RELEASE, g->now); // previous event from this button not handled yet
+    else if (g->repeating & (1 << button)) {
+      *events |= d->click;
+      set_state(b, GESTURE_REPEAT, g->now);
+      b->repeats = 0;
+      b->repeat_interval = c->timing->repeat_msec;
+      b->next_repeat = g->now + c->timing->repeat_delay_msec;
+    }
+    else
+      set_state(b, GESTURE_DOWN, g->now);
+    break;
+
+  case GESTURE_DOWN:
+    if (pressed)
+      break;
+
+    if ((d->double_click && held < d->long_click_msec) ||
+        (d->click_long_click && held < c->timing->quick_click_msec))
+      set_state(b, GESTURE_WAIT_SECOND, g->now);
+    else {
+      *events |= d->click;
+      set_state(b, GESTURE_IDLE, g->now);
+    }
+    break;
+
+  case GESTURE_WAIT_SECOND:
+    if (pressed)
+      set_state(b, GESTURE_SECOND_DOWN, g->now);
+    break;
+
+  case GESTURE_SECOND_DOWN:
+    if (!pressed) {
+      *events |= d->double_click ? d->double_click : d->click;
+      set_state(b, GESTURE_IDLE, g->now);
+    }
+    break;
+
+  default: // repeat or wait for release
+    if (!pressed)
+      set_state(b, GESTURE_IDLE, g->now);
+    break;
+  }
+}
+
+void gesture_reset(gesture_engine_t *g) {
+  for (uint8_t i = 0; i < g->config->num_buttons; i++)
+    set_state(&g->buttons[i], (g->pressed & (1 << i)) ? GESTURE_WAIT_RELEASE : GESTURE_IDLE, g->now);
+}
+
+void gesture_set_repeating(gesture_engine_t *g, uint8_t buttons) {
+  g->repeating = buttons;
+}
+
+bool gesture_is_idle(const gesture_engine_t *g) {
+  if (g->pressed)
+    return false;
+
+  for (uint8_t i = 0; i < g->config->num_buttons; i++)
+    if (g->buttons[i].state != GESTURE_IDLE)
+      return false;
+
+  return true;
+}
+
+uint32_t gesture_held_msec(const gesture_engine_t *g, uint8_t button) {
+  if (!(g->pressed & (1 << button)))
+    return 0;
+
+  return g->now - g->buttons[button].since;
+}
+
+void gesture_init(gesture_engine_t *g, const gesture_config_t *config, uint32_t now) {
+  g->config = config;
+  g->now = now;
+  g->pressed = 0;
+  g->repeating = 0;
+  gesture_reset(g);
+}
+
+uint8_t gesture_accel_multiplier(const gesture_accel_step_t *steps, uint8_t num_steps, uint32_t held_msec) {
+  uint8_t multiplier = 1;
+
+  for (uint8_t i = 0; i < num_steps && held_msec >= steps[i].dwell_msec; i++)
+    multiplier = steps[i].multiplier;
+
+  return multiplier;
+}
@@ -0,0 +1,114 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "graph.h"
+
+// How many inputs (samples, or columns of the scale below) make one column of each scale
+static const uint8_t inputs_per_col[GRAPH_SCALES] = { 5, 10, 6 };
+
+void graph_init(graph_t *g)
+{
+  memset(g, 0, sizeof(*g));
+}
+
+// Fold one input into the column being built, returns true if that finished the column
+static bool ring_add(graph_ring_t *r, uint8_t per_col, uint16_t min, uint16_t max, uint16_t avg)
+{
+  if (!r->n || min < r->min)
+    r->min = min;
+  if (!r->n || max > r->max)
+    r->max = max;
+  r->sum += avg;
+
+  if (++r->n < per_col)
+    return false;
+
+  graph_column_t *c = &r->cols[r->head];
+  c->min = r->min;
+  c->max = r->max;
+  c->avg = r->sum / per_col;
+
+  r->head = (r->head + 1) % GRAPH_COLS;
+  if (r->count < GRAPH_COLS)
+    r->count++;
+
+  r->n = 0;
+  r->sum = 0;
+  return true;
+}
+
+uint8_t graph_add(graph_t *g, uint16_t value)
+{
+  uint8_t finished = 0;
+  uint16_t min = value, max = value, avg = value;
+
+  for (uint8_t s = 0; s < GRAPH_SCALES; s++) {
+    if (!ring_add(&g->rings[s], inputs_per_col[s], min, max, avg))
+      break;
+
+    finished |= 1 << s;
+
+    // the column we just finished is the input for the next scale
+    const graph_column_t *c = graph_column(g, s, 0);
+    min = c->min;
+    max = c->max;
+    avg = c->avg;
+  }
+
+  return finished;
+}
+
+const graph_column_t *graph_column(const graph_t *g, graph_scale_t scale, uint8_t age)
+{
+  const graph_ring_t *r = &g->rings[scale];
+
+  if (age >= r->count)
+    return NULL;
+
+  return &r->cols[(r->head + GRAPH_COLS - 1 - age) % GRAPH_COLS];
+}
+
+void graph_range(const graph_t *g, graph_scale_t scale, uint8_t num_cols, uint16_t *lo, uint16_t *hi)
+{
+  uint16_t min = UINT16_MAX, max = 0;
+  const graph_column_t *c;
+
+  for (uint8_t age = 0; age < num_cols && (c = graph_column(g, scale, age)); age++) {
+    if (c->min < min)
+      min = c->min;
+    if (c->max > max)
+      max = c->max;
+  }
+
+  if (min > max) { // no data yet
+    min = 0;
+    max = 0;
+  }
+
+  // grid step of 1, 2 or 5 times a power of ten, big enough that four of them cover the data
+  uint32_t step = 1, decade = 1;
+  while (step * 4 < (uint32_t) (max - min)) {
+    if (step == decade)
+      step = 2 * decade;
+    else if (step == 2 * decade)
+      step = 5 * decade;
+    else
+      step = decade *= 10;
+  }
+
+  uint32_t l = min / step * step, h = (max + step - 1) / step * step;
+  if (h == l)
+    h += step;
+  if (h > UINT16_MAX) {
+    h = UINT16_MAX;
+    if (l >= h)
+      l = h - step;
+  }
+
+  *lo = l;
+  *hi = h;
+}
@@ -20,24 +20,37 @@
 #include "eeprom.h"
 #include "buttons.h"
 #include "adc.h"
+#include "profile.h"
 //
 // Fields - these might be shared my multiple screens
 //
-Field socField = FIELD_DRAWTEXT();
-Field batteryField = FIELD_DRAWTEXT();
-Field timeField = FIELD_DRAWTEXT();
+Field socField = FIELD_DRAWTEXT_BUF();
+Field batteryField = FIELD_DRAWTEXT_BUF();
+Field timeField = FIELD_DRAWTEXT_BUF();
 Field speedField = FIELD_READONLY_UINT("Speed", &l3_vars.ui16_wheel_speed_x10, "kph", .div_digits = 1, .hide_fraction = true);
 Field assistLevelField = FIELD_READONLY_UINT("Assist", &l3_vars.ui8_assist_level, "");
 Field maxPowerField = FIELD_READONLY_UINT("Motor Pwr", &l3_vars.ui16_battery_power_filtered, "W");
 Field humanPowerField = FIELD_READONLY_UINT("Human Pwr", &l3_vars.ui16_pedal_power_filtered, "W");
 //Field whiteFillField = { .variant = FieldFill };
 //Field meshFillField = { .variant = FieldMesh };
-Field warnField = FIELD_DRAWTEXT();
+Field warnField = FIELD_DRAWTEXT_BUF();
 
-Field tripTimeField = FIELD_DRAWTEXT();
+Field tripTimeField = FIELD_DRAWTEXT_BUF();
 Field tripDistanceField = FIELD_READONLY_UINT("Trip", &l3_vars.ui32_trip_x10, "km", .div_digits = 1);
 Field odoField = FIELD_READONLY_UINT("ODO", &l3_vars.ui32_odometer_x10, "km", .div_digits = 1);
-Field motorTempField = FIELD_DRAWTEXT();
+Field motorTempField = FIELD_DRAWTEXT_BUF();
+Field efficiencyField = FIELD_READONLY_UINT("Wh/km", &l3_vars.ui16_wh_per_km_x10, "Wh/km", .div_digits = 1);
+Field rangeField = FIELD_READONLY_UINT("Range", &l3_vars.ui16_range_x10, "km", .div_digits = 1);
+Field movingTimeField = FIELD_DRAWTEXT_BUF();
+Field avgSpeedField = FIELD_READONLY_UINT("Avg speed", &l3_vars.ui16_trip_avg_speed_x10, "kph", .div_digits = 1);
+Field maxSpeedField = FIELD_READONLY_UINT("Max speed", &l3_vars.ui16_trip_max_speed_x10, "kph", .div_digits = 1);
+Field avgMotorPowerField = FIELD_READONLY_UINT("Avg motor", &l3_vars.ui16_trip_avg_motor_power, "W");
+Field maxMotorPowerField = FIELD_READONLY_UINT("Max motor", &l3_vars.ui16_trip_max_motor_power, "W");
+Field avgHumanPowerField = FIELD_READONLY_UINT("Avg human", &l3_vars.ui16_trip_avg_human_power, "W");
+Field avgCadenceField = FIELD_READONLY_UINT("Avg cadence", &l3_vars.ui8_trip_avg_cadence, "rpm");
+static graph_t motorPowerGraph;
+Field motorPowerGraphField = FIELD_GRAPH(&l3_vars.ui16_battery_power_filtered, &motorPowerGraph);
+Field graphTitleField = FIELD_DRAWTEXT_BUF();
 
 static uint8_t ui8_walk_assist_state = 0;
 
@@ -50,6 +63,8 @@ void temperature(void);
 void time(void);
 void battery_soc(void), battery_display();
 void trip_time(void);
+void trip_stats(void);
+void graph_title(void);
 
 
 bool mainscreen_onpress(buttons_events_t events) {
@@ -99,35 +114,59 @@ bool mainscreen_onpress(buttons_events_t events) {
   return false;
 }
 
+// click + long M to start a new trip (just holding M shows the field labels)
+static bool tripscreen_onpress(buttons_events_t events) {
+  if (events & M_CLICK_LONG_CLICK)
+  {
+    trip_reset();
+    return true;
+  }
+
+  return false;
+}
+
 
 
 
 /**
  * Appears at the bottom of all screens, includes status msgs or critical fault alerts
- * FIXME - get rid of this nasty define - instead add the concept of Subscreens, so that the battery bar
- * at the top and the status bar at the bottom can be shared across all screens
  */
-#define STATUS_BAR \
-{ \
-    .x = 4, .y = 114, \
-    .width = 0, .height = -1, \
-    .field = &warnField, \
-    .font = &FONT_5X12, \
-}
+static const Subscreen statusBar = {
+    .y = 114, .height = SCREEN_HEIGHT - 114,
+
+    .fields = {
+    {
+        .x = 4, .y = 114,
+        .width = 0, .height = -1,
+        .field = &warnField,
+        .font = &FONT_5X12,
+    },
+    {
+        .field = NULL
+    } }
+};
+
+static const Subscreen batteryBar = {
+    .y = 0, .height = 12,
+
+    .fields = {
+    {
+        .x = 0, .y = 0,
+        .width = -1, .height = -1,
+        .field = &batteryField,
+        .font = &MY_FONT_BATTERY,
+    },
+    {
+        .x = 32, .y = 0,
+        .width = -5, .height = -1,
+        .font = &FONT_5X12,
+        .field = &socField
+    },
+    {
+        .field = NULL
+    } }
+};
 
-#define BATTERY_BAR \
-    { \
-        .x = 0, .y = 0, \
-        .width = -1, .height = -1, \
-        .field = &batteryField, \
-        .font = &MY_FONT_BATTERY, \
-    }, \
-    { \
-        .x = 32, .y = 0, \
-        .width = -5, .height = -1, \
-        .font = &FONT_5X12, \
-        .field = &socField \
-    }
 /*
 {
     .x = 32, .y = 0,
@@ -139,11 +178,12 @@ bool mainscreen_onpress(buttons_events_t events) {
 //
 // Screens
 //
-Screen mainScreen = {
+const Screen mainScreen = {
     .onPress = mainscreen_onpress,
+    .header = &batteryBar,
+    .footer = &statusBar,
 
     .fields = {
-    BATTERY_BAR,
     {
         .x = 0, .y = -1,
         .width = 0, .height = -1,
@@ -176,17 +216,17 @@ Screen mainScreen = {
         .modifier = ModNoLabel,
         .border = BorderNone
     },
-    STATUS_BAR,
     {
         .field = NULL
     } }
 };
 
-Screen infoScreen = {
-    // .onPress = mainscreen_onpress,
+const Screen infoScreen = {
+    .onPress = tripscreen_onpress,
+    .header = &batteryBar,
+    .footer = &statusBar,
 
     .fields = {
-    BATTERY_BAR,
     {
         .x = 0, .y = -1,
         .width = 0, .height = -1,
@@ -219,7 +259,22 @@ Screen infoScreen = {
         .modifier = ModNoLabel,
         .border = BorderBottom
     },
-    STATUS_BAR,
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &efficiencyField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &rangeField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
     {
         .field = NULL
     } }
@@ -227,8 +282,122 @@ Screen infoScreen = {
 
 
 
+// M to change the time scale
+static bool graphscreen_onpress(buttons_events_t events) {
+  if (events & M_CLICK)
+  {
+    fieldGraphSetScale(&motorPowerGraphField, (motorPowerGraphField.graph.scale + 1) % GRAPH_SCALES);
+    return true;
+  }
+
+  return false;
+}
+
+const Screen graphScreen = {
+    .onPress = graphscreen_onpress,
+    .footer = &statusBar,
+
+    .fields = {
+    {
+        .x = 0, .y = 0,
+        .width = 0, .height = -1,
+        .field = &graphTitleField,
+        .font = &FONT_5X12,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -2,
+        .width = 0, .height = 98,
+        .field = &motorPowerGraphField,
+        .border = BorderBottom
+    },
+    {
+        .field = NULL
+    } }
+};
+
+// No battery bar, we need the whole screen
+const Screen tripScreen = {
+    .onPress = tripscreen_onpress,
+    .footer = &statusBar,
+
+    .fields = {
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &tripDistanceField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &movingTimeField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &avgSpeedField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &maxSpeedField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &avgMotorPowerField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &maxMotorPowerField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &avgHumanPowerField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .x = 0, .y = -1,
+        .width = 0, .height = -1,
+        .field = &avgCadenceField,
+        .font = &FONT_5X12,
+        .modifier = ModNoLabel,
+        .border = BorderBottom
+    },
+    {
+        .field = NULL
+    } }
+};
+
+
+
+// Fill in the fields of the main screens, each producer skips its field if it isn't on the current screen
 void lcd_main_screen(void)
 {
+  PROF_BEGIN(PROF_MAIN_SCREEN_FIELDS);
+
   time();
   walk_assist_state();
 //  offroad_mode();
@@ -238,6 +407,10 @@ void lcd_main_screen(void)
   battery_display();
   brake();
   trip_time();
+  trip_stats();
+  graph_title();
+
+  PROF_END(PROF_MAIN_SCREEN_FIELDS);
 
 #if 0
   // ui32_m_draw_graphs_2 == 1 every 3.5 seconds, set on timer interrupt
@@ -371,18 +544,6 @@ void mainscreen_show(void) {
 
 void screen_clock(void)
 {
-  static uint8_t ui8_counter_100ms = 0;
-
-  // every 100ms
-  if(ui8_counter_100ms++ >= 4)
-  {
-    ui8_counter_100ms = 0;
-
-    // receive data from layer 2 to layer 3
-    // send data from layer 3 to layer 2
-    copy_layer_2_layer_3_vars();
-  }
-
   // update_menu_flashing_state();
 
 #if 0
@@ -449,11 +610,64 @@ void screen_clock(void)
 
 void trip_time(void)
 {
+  if (!fieldIsRendered(&tripTimeField))
+    return;
+
   struct_rtc_time_t *p_time;
 
   p_time = rtc_get_time_since_startup();
 
-  fieldPrintf(&tripTimeField, "%02d:%02d",  p_time->ui8_hours,  p_time->ui8_minutes);
+  fmt_t f;
+  fieldFormatBegin(&tripTimeField, &f);
+  fmt_time(&f, p_time->ui8_hours, p_time->ui8_minutes);
+  fieldFormatEnd(&tripTimeField, &f);
+}
+
+
+
+
+void trip_stats(void)
+{
+  if (!fieldIsRendered(&movingTimeField))
+    return;
+
+  uint32_t sec = l3_vars.ui32_trip_moving_sec;
+
+  fmt_t f;
+  fieldFormatBegin(&movingTimeField, &f);
+  fmt_str(&f, "Mov ");
+  fmt_uint(&f, sec / 3600, 0, false);
+  fmt_char(&f, ':');
+  fmt_uint(&f, sec / 60 % 60, 2, true);
+  fieldFormatEnd(&movingTimeField, &f);
+}
+
+
+
+
+// The time scale and the top of the plot
+void graph_title(void)
+{
+  if (!fieldIsRendered(&graphTitleField))
+    return;
+
+  static const char * const names[GRAPH_SCALES] = { "30s", "5min", "30min" };
+  uint16_t lo, hi;
+
+  graph_range(&motorPowerGraph, motorPowerGraphField.graph.scale, GRAPH_COLS, &lo, &hi);
+
+  fmt_t f;
+  fieldFormatBegin(&graphTitleField, &f);
+  fmt_str(&f, names[motorPowerGraphField.graph.scale]);
+  fmt_char(&f, ' ');
+  fmt_uint(&f, hi, 0, false);
+  fmt_char(&f, 'W');
+  fieldFormatEnd(&graphTitleField, &f);
+}
+
+void graphs_sample(void)
+{
+  fieldGraphSample(&motorPowerGraphField);
 }
 
 
@@ -461,7 +675,13 @@ void trip_time(void)
 
 void brake(void)
 {
-  fieldPrintf(&warnField, l3_vars.ui8_braking ? "BRAKE" : (l3_vars.ui8_walk_assist ? "WALK" : (l3_vars.ui8_lights ? "LIGH" : "")));
+  if (!fieldIsRendered(&warnField))
+    return;
+
+  fmt_t f;
+  fieldFormatBegin(&warnField, &f);
+  fmt_str(&f, l3_vars.ui8_braking ? "BRAKE" : (l3_vars.ui8_walk_assist ? "WALK" : (l3_vars.ui8_lights ? "LIGH" : "")));
+  fieldFormatEnd(&warnField, &f);
 }
 
 
@@ -469,36 +689,60 @@ void brake(void)
 
 void battery_soc(void)
 {
+  if (!fieldIsRendered(&socField))
+    return;
+
+  fmt_t f;
+  fieldFormatBegin(&socField, &f);
   if (l3_vars.ui8_battery_soc_enable)
-    fieldPrintf(&socField, "%3d%%", ui16_m_battery_soc_watts_hour);
+    fmt_percent(&f, ui16_m_battery_soc_watts_hour);
   else
-    fieldPrintf(&socField, "%2u.%1uV", l3_vars.ui16_battery_voltage_soc_x10 / 10, l3_vars.ui16_battery_voltage_soc_x10 % 10);
+    fmt_volts_x10(&f, l3_vars.ui16_battery_voltage_soc_x10);
+  fieldFormatEnd(&socField, &f);
 }
 
 // Show our battery graphic
 void battery_display() {
-  uint8_t ui32_battery_bar_number = l3_vars.volt_based_soc / (90 / 5); // scale SOC so anything greater than 90% is 5 bars, and zero is zero.
+  if (!fieldIsRendered(&batteryField))
+    return;
+
+  uint8_t ui32_battery_bar_number = l3_vars.fused_soc / (90 / 5); // scale SOC so anything greater than 90% is 5 bars, and zero is zero.
 
-  fieldPrintf(&batteryField, "%d", ui32_battery_bar_number);
+  fmt_t f;
+  fieldFormatBegin(&batteryField, &f);
+  fmt_uint(&f, ui32_battery_bar_number, 0, false);
+  fieldFormatEnd(&batteryField, &f);
 }
 
 void temperature(void)
 {
+  if (!fieldIsRendered(&motorTempField))
+    return;
+
+  fmt_t f;
+  fieldFormatBegin(&motorTempField, &f);
   if(l3_vars.ui8_temperature_limit_feature_enabled)
   {
-    fieldPrintf(&motorTempField, "%dC", l3_vars.ui8_motor_temperature);
+    fmt_uint(&f, l3_vars.ui8_motor_temperature, 0, false);
+    fmt_char(&f, 'C');
   }
   else {
-    fieldPrintf(&motorTempField, "no temp");
+    fmt_str(&f, "no temp");
   }
+  fieldFormatEnd(&motorTempField, &f);
 }
 
 void time(void)
 {
-  struct_rtc_time_t *p_rtc_time = rtc_get_time();
+  if (!fieldIsRendered(&timeField))
+    return;
 
-  fieldPrintf(&timeField, "%02d:%02d",  p_rtc_time->ui8_hours,  p_rtc_time->ui8_minutes);
+  struct_rtc_time_t *p_rtc_time = rtc_get_time();
 
+  fmt_t f;
+  fieldFormatBegin(&timeField, &f);
+  fmt_time(&f, p_rtc_time->ui8_hours, p_rtc_time->ui8_minutes);
+  fieldFormatEnd(&timeField, &f);
 }
 
 
@@ -0,0 +1,156 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "mirror.h"
+
+#define NO_PAGE 0xff
+
+static const uint8_t *frame;
+static mirror_send_fn sender;
+
+// start/stop are requested from the BLE event handler, everything else runs in the main loop.  The last request
+// wins, and frame/sender are only taken over from the latched values in mirror_service()
+static volatile bool startRequested, stopRequested;
+static const uint8_t * volatile requestedFrame;
+static volatile mirror_send_fn requestedSender;
+
+static uint16_t pendingPages;
+static uint8_t curPage = NO_PAGE, curCol;
+
+// A packet the link refused, offered again before we encode anything new
+static uint8_t staged[MIRROR_MAX_PACKET], stagedLen, stagedCols;
+
+void mirror_start(const uint8_t *fb, mirror_send_fn send) {
+  requestedFrame = fb;
+  requestedSender = send;
+  stopRequested = false; // i.e. "M0" "M1" from a client restarting the mirror
+  startRequested = true;
+}
+
+void mirror_stop(void) {
+  startRequested = false;
+  stopRequested = true;
+}
+
+bool mirror_is_active(void) {
+  return (sender != NULL || startRequested) && !stopRequested;
+}
+
+void mirror_pages_changed(uint16_t pages) {
+  pendingPages |= pages;
+}
+
+uint8_t mirror_encode(const uint8_t *page_data, uint8_t page, uint8_t col, uint8_t *pkt, uint8_t *pktlen) {
+  const uint8_t maxPayload = MIRROR_MAX_PACKET - 2;
+  uint8_t avail = MIRROR_PAGE_WIDTH - col;
+
+  // How many columns would fit as RLE pairs?
+  uint8_t rleCols = 0, rleLen = 0;
+  while (rleCols < avail && rleLen + 2 <= maxPayload) {
+    uint8_t val = page_data[col + rleCols], run = 1;
+    while (rleCols + run < avail && page_data[col + rleCols + run] == val)
+      run++;
+
+    pkt[2 + rleLen++] = run;
+    pkt[2 + rleLen++] = val;
+    rleCols += run;
+  }
+
+  uint8_t rawCols = avail < maxPayload ? avail : maxPayload;
+
+  pkt[1] = col;
+  if (rleCols > rawCols) {
+    pkt[0] = page | MIRROR_HDR_RLE;
+    *pktlen = 2 + rleLen;
+    return rleCols;
+  }
+
+  pkt[0] = page;
+  memcpy(&pkt[2], &page_data[col], rawCols);
+  *pktlen = 2 + rawCols;
+  return rawCols;
+}
+
+bool mirror_decode(const uint8_t *pkt, uint8_t len, uint8_t *fb) {
+  if (len < 2)
+    return false;
+
+  uint8_t page = pkt[0] & 0x0f, col = pkt[1];
+  uint8_t *dest = fb + page * MIRROR_PAGE_WIDTH;
+
+  if (pkt[0] & MIRROR_HDR_RLE) {
+    if (len & 1)
+      return false;
+
+    for (uint8_t i = 2; i < len; i += 2) {
+      uint8_t run = pkt[i];
+      if (run == 0 || col + run > MIRROR_PAGE_WIDTH)
+        return false;
+      memset(&dest[col], pkt[i + 1], run);
+      col += run;
+    }
+  }
+  else {
+    if (col + (len - 2) > MIRROR_PAGE_WIDTH)
+      return false;
+    memcpy(&dest[col], &pkt[2], len - 2);
+  }
+
+  return true;
+}
+
+// Pick the next pending page, searching round robin so one busy page can't starve the others
+static bool next_page(void) {
+  if (!pendingPages)
+    return false;
+
+  uint8_t page = curPage == NO_PAGE ? 0 : (curPage + 1) % MIRROR_PAGES;
+  while (!(pendingPages & (1 << page)))
+    page = (page + 1) % MIRROR_PAGES;
+
+  // Clear now: if the page is drawn to while we are sending it, it will be marked again and resent
+  pendingPages &= ~(1 << page);
+  curPage = page;
+  curCol = 0;
+  return true;
+}
+
+void mirror_service(void) {
+  if (stopRequested) {
+    stopRequested = false;
+    sender = NULL;
+  }
+
+  if (startRequested) {
+    startRequested = false;
+    frame = requestedFrame;
+    sender = requestedSender;
+    pendingPages = (1 << MIRROR_PAGES) - 1; // client needs a full frame first
+    curPage = NO_PAGE;
+    stagedLen = 0;
+  }
+
+  if (!sender)
+    return;
+
+  for (;;) {
+    if (!stagedLen) {
+      if (curPage == NO_PAGE || curCol >= MIRROR_PAGE_WIDTH) {
+        if (!next_page())
+          return;
+      }
+
+      stagedCols = mirror_encode(&frame[curPage * MIRROR_PAGE_WIDTH], curPage, curCol, staged, &stagedLen);
+    }
+
+    if (!sender(staged, stagedLen))
+      return; // link is full, try again on a later tick
+
+    curCol += stagedCols;
+    stagedLen = 0;
+  }
+}
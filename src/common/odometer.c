@@ -0,0 +1,49 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "odometer.h"
+
+void odometer_init(odometer_t *o, uint32_t remainder_mm)
+{
+  o->mm = remainder_mm < ODOMETER_MM_PER_STEP ? remainder_mm : 0;
+  odometer_resync(o);
+}
+
+void odometer_resync(odometer_t *o)
+{
+  o->synced = false;
+}
+
+uint32_t odometer_update(odometer_t *o, uint32_t ticks, uint16_t perimeter_mm)
+{
+  uint32_t delta;
+
+  ticks &= ODOMETER_TICK_MASK;
+  delta = (ticks - o->last_ticks) & ODOMETER_TICK_MASK; // also right across the 24 bit wrap
+
+  if (!o->synced)
+    delta = 0;
+  else if (delta > ODOMETER_MAX_TICKS)
+    delta = ticks <= ODOMETER_MAX_TICKS ? ticks : 0; // controller reset: it counted from 0 again
+
+  o->last_ticks = ticks;
+  o->synced = true;
+
+  // one or two passes for real wheels, bounded by ODOMETER_MAX_TICKS * 65535mm in any case
+  o->mm += delta * perimeter_mm;
+  uint32_t steps = 0;
+  while (o->mm >= ODOMETER_MM_PER_STEP) {
+    o->mm -= ODOMETER_MM_PER_STEP;
+    steps++;
+  }
+
+  return steps;
+}
+
+uint32_t odometer_remainder_mm(const odometer_t *o)
+{
+  return o->mm;
+}
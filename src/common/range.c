@@ -0,0 +1,93 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "range.h"
+
+void range_reset(range_t *r, uint32_t wh_x10)
+{
+  memset(r, 0, sizeof(*r));
+  r->last_wh_x10 = wh_x10;
+}
+
+void range_step(range_t *r, uint32_t wh_x10, uint8_t assist_level)
+{
+  uint32_t delta = wh_x10 - r->last_wh_x10;
+  r->last_wh_x10 = wh_x10;
+
+  if (delta > UINT16_MAX)
+    delta = UINT16_MAX;
+
+  // the step falling out of the 1km window is RANGE_SHORT_STEPS back from the new one
+  if (r->count >= RANGE_SHORT_STEPS)
+    r->short_wh_x10 -= r->steps_wh_x10[(r->head + RANGE_LONG_STEPS - RANGE_SHORT_STEPS) % RANGE_LONG_STEPS];
+  r->short_wh_x10 += delta;
+
+  // the one falling out of the 10km window is the one we overwrite
+  if (r->count >= RANGE_LONG_STEPS)
+    r->long_wh_x10 -= r->steps_wh_x10[r->head];
+  else
+    r->count++;
+  r->long_wh_x10 += delta;
+
+  r->steps_wh_x10[r->head] = delta;
+  r->head = (r->head + 1) % RANGE_LONG_STEPS;
+
+  r->trip_wh_x10 += delta;
+  r->trip_steps++;
+
+  if (assist_level < RANGE_LEVELS) {
+    r->level_wh_x10[assist_level] += delta;
+    r->level_steps[assist_level]++;
+  }
+}
+
+// steps are 0.1km, so Wh/km x10 is wh_x10 * 10 / steps
+static uint16_t efficiency(uint32_t wh_x10, uint32_t steps)
+{
+  if (!steps)
+    return 0;
+
+  uint32_t eff = (uint64_t) wh_x10 * 10 / steps;
+  return eff > UINT16_MAX ? UINT16_MAX : eff;
+}
+
+uint16_t range_wh_per_km_x10(const range_t *r, range_window_t window)
+{
+  switch (window) {
+  case RANGE_SHORT:
+    return efficiency(r->short_wh_x10, r->count < RANGE_SHORT_STEPS ? r->count : RANGE_SHORT_STEPS);
+  case RANGE_LONG:
+    return efficiency(r->long_wh_x10, r->count);
+  default:
+    return efficiency(r->trip_wh_x10, r->trip_steps);
+  }
+}
+
+uint16_t range_km_x10(const range_t *r, uint32_t remaining_wh_x10, uint8_t assist_level)
+{
+  uint32_t wh_x10, steps;
+
+  if (assist_level < RANGE_LEVELS && r->level_steps[assist_level] >= RANGE_SHORT_STEPS) {
+    wh_x10 = r->level_wh_x10[assist_level];
+    steps = r->level_steps[assist_level];
+  }
+  else if (r->count >= RANGE_SHORT_STEPS) {
+    wh_x10 = r->long_wh_x10;
+    steps = r->count;
+  }
+  else {
+    wh_x10 = r->trip_wh_x10;
+    steps = r->trip_steps;
+  }
+
+  if (!steps)
+    return 0;
+
+  // km x10 = remaining Wh / (Wh per step) since a step is 0.1km
+  uint64_t km_x10 = wh_x10 ? (uint64_t) remaining_wh_x10 * steps / wh_x10 : RANGE_MAX_KM_X10;
+  return km_x10 > RANGE_MAX_KM_X10 ? RANGE_MAX_KM_X10 : km_x10;
+}
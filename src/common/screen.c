@@ -29,20 +29,26 @@
 #include "lcd.h"
 #include "ugui.h"
 #include "fonts.h"
+#include "gestures.h"
+#include "profile.h"
+#include "fmt.h"
 
 extern UG_GUI gui;
 
-// If true, the scroll position changed and force a complete redraw
-// FIXME - heading shouldn't be redrawn
+// If true, a different scrollable is expanded (or we started editing) and all its rows must be laid out and drawn again
 // FIXME - currently limited to one scrollable per screen
 static bool forceScrollableRelayout;
 
 // If the user is editing an editable, this will be it
 static Field *curActiveEditable = NULL;
 
+// While editing, holding UP/DOWN repeats the click and takes bigger steps the longer it is held
+static const gesture_accel_step_t editAccel[] = { { 0, 1 }, { 2000, 10 }, { 4000, 100 } };
+
 #define MAX_SCROLLABLE_DEPTH 3 // How deep can we nest scrollables in our stack
 
 static Field *scrollableStack[MAX_SCROLLABLE_DEPTH];
+
 int scrollableStackPtr = 0; // Points to where to push the next entry (so if zero, stack is empty)
 
 // Returns true if we decided to draw something
@@ -57,9 +63,9 @@ static bool blinkOn;
 #define heading_font &FONT_5X12
 #define scrollable_font &FONT_5X12
 
-static const UG_FONT const *editable_label_font = &FONT_5X12;
-static const UG_FONT const *editable_value_font = &FONT_5X12;
-static const UG_FONT const *editable_units_font = &FONT_5X12;
+static const UG_FONT * const editable_label_font = &FONT_5X12;
+static const UG_FONT * const editable_value_font = &FONT_5X12;
+static const UG_FONT * const editable_units_font = &FONT_5X12;
 
 
 static UG_COLOR getBackColor(const FieldLayout *layout)
@@ -91,12 +97,15 @@ static UG_COLOR getForeColor(const FieldLayout *layout)
 static bool renderDrawText(FieldLayout *layout)
 {
   Field *field = layout->field;
+  const char *msg = field->drawText.buf ? field->drawText.buf : field->drawText.msg;
+  if (!msg)
+    msg = "";
 
   const UG_FONT *font = layout->font;
   assert(font); // dynamic font selection not yet supported
 
   // how many pixels does our rendered string
-  UG_S16 strwidth = (font->char_width + gui.char_h_space) * strlen(field->drawText.msg);
+  UG_S16 strwidth = (font->char_width + gui.char_h_space) * strlen(msg);
 
   UG_S16 width = layout->width;
   UG_S16 height = layout->height;
@@ -113,7 +122,7 @@ static bool renderDrawText(FieldLayout *layout)
   UG_FillFrame(layout->x, layout->y, layout->x + width - 1,
       layout->y + height - 1, back);
   UG_SetBackcolor(C_TRANSPARENT);
-  UG_PutString(x + 1, layout->y, field->drawText.msg);
+  UG_PutString(x + 1, layout->y, (char*) msg);
   return true;
 }
 
@@ -137,18 +146,26 @@ static bool renderMesh(FieldLayout *layout)
   return true;
 }
 
+static void drawMarker(const FieldLayout *layout, UG_COLOR color)
+{
+  // we size the cursor to be slightly shorter than the box it is in
+  UG_DrawLine(layout->x, layout->y + 2, layout->x, layout->y + layout->height - 3, color);
+}
+
 /**
  * If we are selected, highlight this item with a bar to the left (on color screens possibly draw a small
  * color pointer or at least color the line something nice.
+ *
+ * @return true if we drew the bar
  */
-static void drawSelectionMarker(FieldLayout *layout)
+static bool drawSelectionMarker(FieldLayout *layout)
 {
-  // Only consider doing this on items that might be animated - and when editing don't blink the selection cursor
-  // we size the cursor to be slightly shorter than the box it is in
-  if (layout->field && layout->field->is_selected && !curActiveEditable)
-    UG_DrawLine(layout->x, layout->y + 2, layout->x,
-        layout->y + layout->height - 3,
-        blinkOn ? getForeColor(layout) : getBackColor(layout));
+  // when editing don't blink the selection cursor
+  if (!layout->field || !layout->field->is_selected || curActiveEditable)
+    return false;
+
+  drawMarker(layout, blinkOn ? getForeColor(layout) : getBackColor(layout));
+  return true;
 }
 
 /**
@@ -200,11 +217,54 @@ static bool needsRender(FieldLayout *layout) {
   return false;
 }
 
+/**
+ * Copy layouts into dest with the shorthand sizes and positions worked out, so the renderers only ever see plain
+ * pixel rectangles.  Returns the entry after the NULL terminator.
+ */
+static FieldLayout *resolveLayouts(const FieldLayout *layouts, FieldLayout *dest, FieldLayout *destEnd, Coord maxy)
+{
+  for (const FieldLayout *layout = layouts; ; layout++, dest++)
+  {
+    assert(dest < destEnd); // raise MAX_RESOLVED_LAYOUTS
+    *dest = *layout;
+    if (!layout->field)
+      return dest + 1;
+
+    // a y <0 means, start just below the previous lowest point on the screen, -1 is immediately below, -2 has one blank line, -3 etc...
+    if (dest->y < 0)
+      dest->y = maxy + -dest->y - 1;
+
+    if (dest->width == 0)
+      dest->width = screenWidth - dest->x;
+
+    if (dest->height == 0)
+      dest->height = screenHeight - dest->y;
+
+    // Allow developer to use this shorthand for one row high text fields
+    if (dest->height == -1) {
+      assert(dest->font); // you must specify a font to use this feature
+      dest->height = dest->font->char_height;
+    }
+
+    // if user specified width in terms of characters, change it to pixels
+    if (dest->width < 0) {
+      assert(dest->font); // you must specify a font to use this feature
+      dest->width = -dest->width * (dest->font->char_width + gui.char_h_space);
+    }
+
+    // cache the highest Y we have seen (for entries that have y = -1 for auto assignment)
+    if (dest->y + dest->height > maxy)
+      maxy = dest->y + dest->height;
+  }
+}
+
+// layouts must already be resolved
 const bool renderLayouts(FieldLayout *layouts, bool forceRender)
 {
+  PROF_BEGIN(PROF_RENDER_LAYOUTS);
+
   bool didDraw = false; // we only render to hardware if something changed
 
-  Coord maxy = 0;
 
   bool didChangeForceLabels = false; // if we did label force/unforce we need to remember for the next render
   bool mpressed = buttons_get_m_state();
@@ -212,8 +272,11 @@ const bool renderLayouts(FieldLayout *layouts, bool forceRender)
   // For each field if that field is dirty (or the screen is) redraw it
   for (FieldLayout *layout = layouts; layout->field; layout++)
   {
-    if(forceRender) // tell the field it must redraw itself
+    if(forceRender) { // tell the field it must redraw itself
       layout->field->dirty = true;
+      if(layout->field->variant == FieldGraph)
+        layout->field->graph.redraw = true; // the incremental shortcuts assume the plot is still on screen
+    }
 
     if(layout->field->variant == FieldEditable) {
       forceLabels = mpressed && layout->modifier == ModNoLabel;
@@ -221,39 +284,19 @@ const bool renderLayouts(FieldLayout *layouts, bool forceRender)
     }
 
     // We always render dirty items, or items that might need to show blink animations
+    bool drew = false;
     if (needsRender(layout))
     {
-      if (layout->width == 0)
-        layout->width = screenWidth - layout->x;
-
-      if (layout->height == 0)
-        layout->height = screenHeight - layout->y;
-
-      // Allow developer to use this shorthand for one row high text fields
-      if (layout->height == -1) {
-        assert(layout->font); // you must specify a font to use this feature
-        layout->height = layout->font->char_height;
-      }
-
-      // if user specified width in terms of characters, change it to pixels
-      if(layout->width < 0) {
-        assert(layout->font); // you must specify a font to use this feature
-        layout->width = -layout->width * (layout->font->char_width + gui.char_h_space);
-      }
-
-      // a y <0 means, start just below the previous lowest point on the screen, -1 is immediately below, -2 has one blank line, -3 etc...
-      if(layout->y < 0)
-        layout->y = maxy + -layout->y - 1;
-
-      didDraw |= renderers[layout->field->variant](layout);
-
-      // After the renderer has run, cache the highest Y we have seen (for entries that have y = -1 for auto assignment)
-      if(layout->y + layout->height > maxy)
-        maxy = layout->y + layout->height;
+      PROF_BEGIN(PROF_RENDER_DRAWTEXT + layout->field->variant);
+      drew = renderers[layout->field->variant](layout);
+      PROF_END(PROF_RENDER_DRAWTEXT + layout->field->variant);
+    }
 
-      drawSelectionMarker(layout);
+    // The selection bar goes on top of what was just drawn, otherwise only its blink changes it
+    bool markerChanged = (drew || blinkChanged) && drawSelectionMarker(layout);
+    if (drew) // editables are asked every frame but usually leave their box (and so our border) alone
       drawBorder(layout);
-    }
+    didDraw |= drew || markerChanged;
   }
 
   // We clear the dirty bits in a separate pass because multiple layouts on the screen might share the same field
@@ -265,6 +308,7 @@ const bool renderLayouts(FieldLayout *layouts, bool forceRender)
   if(didChangeForceLabels)
     oldForceLabels = forceLabels;
 
+  PROF_END(PROF_RENDER_LAYOUTS);
   return didDraw;
 }
 
@@ -320,106 +364,158 @@ static bool exitScrollable()
   }
 }
 
-static bool renderActiveScrollable(FieldLayout *layout, Field *field)
+// The heading and visible rows of the expanded scrollable.  They are kept between frames (not shared with
+// collapsed scrollables) so a blink only toggles the selection bar and a scroll only draws the rows it exposes
+static FieldLayout expandedRows[MAX_SCROLLABLE_ROWS + 1];
+static int expandedFirst; // scrollable.first of the rows in expandedRows
+static Field heading = FIELD_DRAWTEXT_BUF(); // the label of the expanded scrollable
+
+static Field collapsedLabel = FIELD_DRAWTEXT_BUF(); // shared by all collapsed scrollables, so always drawn
+
+/**
+ * Move the selection bar to or from a row that is already on screen
+ *
+ * @return true if we drew something
+ */
+static bool setRowSelected(FieldLayout *r, bool selected)
+{
+  Field *entry = r->field;
+  if (entry->is_selected == selected)
+    return false;
+
+  entry->is_selected = selected;
+  if (entry->dirty)
+    return false; // the whole row is drawn anyway
+
+  if (selected)
+    return drawSelectionMarker(r);
+
+  drawMarker(r, getBackColor(r));
+  return true;
+}
+
+static bool renderExpandedScrollable(FieldLayout *layout, Field *field)
 {
   const Coord rowHeight = 32; // 3 data rows 32 pixels tall + one 32 pixel header
+  const int numDataRows = MAX_SCROLLABLE_ROWS - 1;
 
-  static FieldLayout rows[MAX_SCROLLABLE_ROWS + 1]; // Used to layout each of the currently visible rows + heading
+  static Field blankRows[MAX_SCROLLABLE_ROWS]; // Used to fill with blank space if necessary
 
-  Field *scrollable = getActiveScrollable();
-  bool weAreExpanded = scrollable == field;
+  FieldLayout *rows = expandedRows;
+  bool drew = false;
 
-  // If we are expanded show our heading and the current visible child elements
-  // Otherwise just show our label so that the user might select us to expand
-  if (weAreExpanded)
-  {
-    // FIXME - we shouldn't need to relayout scrollables on blink transition, but currently we share the static rows[] array when we really should not, because
-    // it is used _both_ in the drawing of expanded elements and the non expanded case.  This problem becomes apparant if you remove this blinkChanged check.
-    if (forceScrollableRelayout || blinkChanged)
-    {
-      static Field blankRows[MAX_SCROLLABLE_ROWS]; // Used to fill with blank space if necessary
-      static Field heading = FIELD_DRAWTEXT();
+  // How many rows the list moved up since we last drew it, rows that are still visible are moved in the framebuffer
+  // (only if they are whole 8 pixel pages) instead of being drawn again
+  int shift = field->scrollable.first - expandedFirst;
+  bool relayout = forceScrollableRelayout || shift <= -numDataRows || shift >= numDataRows
+      || layout->y % 8 || rowHeight % 8;
 
-      bool hasMoreRows = true; // Once we reach an invalid row we stop rendering and instead fill with blank space
+  int kept = relayout ? 0 : numDataRows - (shift < 0 ? -shift : shift); // data rows still showing the right entry
+  int keptRow = shift < 0 ? 1 - shift : 1; // where they are now
 
-      forceScrollableRelayout = false;
-      for (int i = 0; i < MAX_SCROLLABLE_ROWS; i++)
-      {
-        FieldLayout *r = rows + i;
-
-        r->x = layout->x;
-        r->y = layout->y + rowHeight * i;
-        r->width = layout->width;
-        r->height = rowHeight - 1; // Allow a 1 line gap between each row
-        r->border = BorderNone;
-
-        if (i == 0)
-        { // heading
-          fieldPrintf(&heading, "%s", field->scrollable.label);
-          r->field = &heading;
-          r->color = ColorNormal;
-          r->border = BorderBottom | BorderFat;
-          r->font = heading_font;
-        }
-        else
-        {
-          // visible menu rows, starting with where the user has scrolled to
-          const int entryNum = field->scrollable.first + i - 1;
-          Field *entry = &field->scrollable.entries[entryNum];
-
-          entry->dirty = true; // Force it to be redrawn
-          if (entry->variant == FieldEnd)
-            hasMoreRows = false;
-
-          // if the current row is valid, render that, otherwise render blank space
-          if (hasMoreRows)
-          {
-            r->field = entry;
-            entry->is_selected = (entryNum == field->scrollable.selected);
-          }
-          else
-          {
-            r->field = &blankRows[i];
-            r->field->variant = FieldFill;
-            r->color = ColorInvert; // black box for empty slots at end
-          }
-
-          r->field->dirty = true; // Force rerender
-        }
-
-        rows[MAX_SCROLLABLE_ROWS].field = NULL; // mark end of array (for rendering)
-      }
-    }
-  }
-  else
+  if (relayout)
   {
-    // Just draw our label (not highlighted) - show selection bar if necessary
-    FieldLayout *r = &rows[0];
+    forceScrollableRelayout = false;
 
+    FieldLayout *r = &rows[0];
     r->x = layout->x;
     r->y = layout->y;
     r->width = layout->width;
-    r->height = layout->height;
-    r->border = BorderNone;
-
-    static Field label = FIELD_DRAWTEXT();
-    fieldPrintf(&label, "%s", field->scrollable.label);
-    r->field = &label;
+    r->height = rowHeight - 1; // Allow a 1 line gap between each row
+    r->border = BorderBottom | BorderFat;
     r->color = ColorNormal;
-    r->font = scrollable_font;
+    r->font = heading_font;
+    r->field = &heading;
 
-    // If we are inside a scrollable and selected, blink
-    if (scrollable)
-      label.is_selected = field
-          == &scrollable->scrollable.entries[scrollable->scrollable.selected];
-    else
-      label.is_selected = false;
+    fieldPrintf(&heading, "%s", field->scrollable.label);
+    heading.dirty = true;
+
+    rows[MAX_SCROLLABLE_ROWS].field = NULL; // mark end of array (for rendering)
+  }
+  else if (shift && kept)
+  {
+    lcd_move_pages((layout->y + rowHeight * keptRow) / 8, (layout->y + rowHeight * (keptRow + shift)) / 8,
+        kept * rowHeight / 8);
+    memmove(&rows[keptRow], &rows[keptRow + shift], kept * sizeof(rows[0])); // with their cached editable values
+    drew = true;
+  }
+  expandedFirst = field->scrollable.first;
+
+  bool hasMoreRows = true; // Once we reach an invalid row we stop rendering and instead fill with blank space
+  for (int i = 1; i < MAX_SCROLLABLE_ROWS; i++)
+  {
+    FieldLayout *r = rows + i;
+
+    // visible menu rows, starting with where the user has scrolled to
+    const int entryNum = field->scrollable.first + i - 1;
+    if (hasMoreRows && field->scrollable.entries[entryNum].variant == FieldEnd)
+      hasMoreRows = false;
 
-    rows[1].field = NULL; // mark end of array (for rendering)
+    if (i < keptRow || i >= keptRow + kept)
+    {
+      r->x = layout->x;
+      r->width = layout->width;
+      r->height = rowHeight - 1;
+      r->border = BorderNone;
+
+      // if the current row is valid, render that, otherwise render blank space
+      if (hasMoreRows)
+      {
+        r->field = &field->scrollable.entries[entryNum];
+        r->color = ColorNormal;
+      }
+      else
+      {
+        r->field = &blankRows[i];
+        r->field->variant = FieldFill;
+        r->color = ColorInvert; // black box for empty slots at end
+      }
+
+      r->field->dirty = true; // Force rerender
+    }
+    r->y = layout->y + rowHeight * i;
+
+    if (hasMoreRows)
+      drew |= setRowSelected(r, entryNum == field->scrollable.selected);
   }
 
   // draw (or redraw if necessary) our current set of visible rows
-  return renderLayouts(rows, false);
+  drew |= renderLayouts(rows, false); // rows are built already resolved
+  return drew;
+}
+
+/**
+ * Just draw our label (not highlighted) so that the user might select us to expand.  The layout showing us
+ * draws the selection bar.
+ */
+static bool renderCollapsedScrollable(FieldLayout *layout, Field *field)
+{
+  if (!field->dirty)
+    return false; // we are only asked again to blink, and we don't
+
+  fieldPrintf(&collapsedLabel, "%s", field->scrollable.label);
+
+  FieldLayout rows[] = {
+    {
+      .x = layout->x, .y = layout->y, .width = layout->width, .height = layout->height,
+      .color = ColorNormal, .font = scrollable_font, .field = &collapsedLabel
+    },
+    {
+      .field = NULL // mark end of array (for rendering)
+    }
+  };
+
+  return renderLayouts(rows, true);
+}
+
+// If we are expanded show our heading and the current visible child elements
+// Otherwise just show our label so that the user might select us to expand
+static bool renderActiveScrollable(FieldLayout *layout, Field *field)
+{
+  if (getActiveScrollable() == field)
+    return renderExpandedScrollable(layout, field);
+  else
+    return renderCollapsedScrollable(layout, field);
 }
 
 static bool renderScrollable(FieldLayout *layout)
@@ -439,14 +535,14 @@ static bool renderScrollable(FieldLayout *layout)
 // Get the numeric value of an editable number, properly handling different possible byte encodings
 static int32_t getEditableNumber(Field *field)
 {
-  switch (field->editable.size)
+  switch (field->editable->size)
   {
   case 1:
-    return *(uint8_t*) field->editable.target;
+    return *(uint8_t*) field->editable->target;
   case 2:
-    return *(int16_t*) field->editable.target;
+    return *(int16_t*) field->editable->target;
   case 4:
-    return *(int32_t*) field->editable.target;
+    return *(int32_t*) field->editable->target;
   default:
     assert(0);
     return 0;
@@ -456,16 +552,16 @@ static int32_t getEditableNumber(Field *field)
 // Set the numeric value of an editable number, properly handling different possible byte encodings
 static void setEditableNumber(Field *field, uint32_t v)
 {
-  switch (field->editable.size)
+  switch (field->editable->size)
   {
   case 1:
-    *(uint8_t*) field->editable.target = (uint8_t) v;
+    *(uint8_t*) field->editable->target = (uint8_t) v;
     break;
   case 2:
-    *(uint16_t*) field->editable.target = (uint16_t) v;
+    *(uint16_t*) field->editable->target = (uint16_t) v;
     break;
   case 4:
-    *(uint32_t*) field->editable.target = (uint32_t) v;
+    *(uint32_t*) field->editable->target = (uint32_t) v;
     break;
   default:
     assert(0);
@@ -474,7 +570,7 @@ static void setEditableNumber(Field *field, uint32_t v)
 
 static int countEnumOptions(Field *s)
 {
-  const char **e = s->editable.editEnum.options;
+  const char * const *e = s->editable->editEnum.options;
 
   int n = 0;
   while (*e++)
@@ -483,30 +579,45 @@ static int countEnumOptions(Field *s)
   return n;
 }
 
+static void setActiveEditable(Field *f)
+{
+  curActiveEditable = f;
+  buttons_set_repeating(f ? (UP_CLICK | DOWN_CLICK) : 0);
+}
+
 /**
- * increment/decrement an editable
+ * increment/decrement an editable, multiplier is applied to the step size of numbers
  */
-static void changeEditable(bool increment)
+static void changeEditable(bool increment, int multiplier)
 {
   Field *f = curActiveEditable;
   assert(f);
 
   int v = getEditableNumber(f);
 
-  switch (f->editable.typ)
+  switch (f->editable->typ)
   {
   case EditUInt:
   {
-    int step = f->editable.number.inc_step;
+    int step = f->editable->number.inc_step;
 
     if (step == 0)
       step = 1;
 
-    v += step * (increment ? 1 : -1);
-    if (v < f->editable.number.min_value) // loop around
-      v = f->editable.number.max_value;
-    else if (v > f->editable.number.max_value)
-      v = f->editable.number.min_value;
+    int min = f->editable->number.min_value, max = f->editable->number.max_value;
+    int old = v;
+
+    v += step * multiplier * (increment ? 1 : -1);
+    if (multiplier > 1 && (v < min || v > max)) // big steps stop at the end, so the user doesn't fly past it
+      v = increment ? max : min;
+    else if (v < min) // loop around
+      v = max;
+    else if (v > max)
+      v = min;
+
+    if (multiplier > 1 && v == old) // already at the end, only a single step wraps around
+      return;
+
     setEditableNumber(f, v);
     break;
   }
@@ -544,81 +655,64 @@ static bool renderEditable(FieldLayout *layout)
   UG_COLOR back = getBackColor(layout), fore = getForeColor(layout);
   UG_SetForecolor(fore);
 
-  // If we are blinking right now, that's a good place to poll our buttons so that the user can press and hold to change a series of values
-  if (isActive && blinkChanged && !field->editable.read_only)
-  {
-    if (buttons_get_up_state())
-    {
-      changeEditable(true);
-    }
-
-    if (buttons_get_down_state())
-    {
-      changeEditable(false);
-    }
-  }
-
   // Get the value we are trying to show (it might be a num or an enum)
   uint32_t num = getEditableNumber(field);
+  bool valueChanged = num != layout->old_editable;
 
-  if(num != layout->old_editable) {
+  if(valueChanged)
     layout->old_editable = num;
-    dirty = true; // force a draw
-  }
 
   if(forceLabels != oldForceLabels)
     dirty = true;
 
-  if(!dirty)
-    return false; // We didn't actually change so don't try to draw anything
+  if(!dirty && !valueChanged && !(isActive && blinkChanged))
+    return false; // We didn't actually change (and have no cursor to blink) so don't try to draw anything
 
-  // fill our entire box with blankspace
-  UG_FillFrame(layout->x, layout->y, layout->x + width - 1,
-      layout->y + height - 1, back);
-  UG_SetBackcolor(C_TRANSPARENT); // we just cleared the background ourself, from now on allow fonts to overlap
-
-  // Show the label (if showing the conventional way - i.e. small and off to the top left.
   bool showLabel = layout->modifier != ModNoLabel;
-  if(showLabel) {
-    UG_FontSelect(editable_label_font);
-    UG_PutString(layout->x + 1, layout->y, (char*) field->editable.label);
+  const UG_FONT *valueFont = layout->font ? layout->font : editable_value_font;
+
+  if(!dirty && showLabel && !forceLabels) {
+    // Only the value changed (i.e. while the user holds a button to change it), just clear the value line
+    UG_S16 valueY = layout->y + FONT12_Y;
+    UG_FillFrame(layout->x, valueY, layout->x + width - 1, valueY + valueFont->char_height + 1, back);
+  }
+  else {
+    // fill our entire box with blankspace
+    UG_FillFrame(layout->x, layout->y, layout->x + width - 1,
+        layout->y + height - 1, back);
+
+    // Show the label (if showing the conventional way - i.e. small and off to the top left.
+    if(showLabel) {
+      UG_FontSelect(editable_label_font);
+      UG_SetBackcolor(C_TRANSPARENT);
+      UG_PutString(layout->x + 1, layout->y, (char*) field->editable->label);
     }
+  }
+  UG_SetBackcolor(C_TRANSPARENT); // we just cleared the background ourself, from now on allow fonts to overlap
 
   // Show the label in the middle of the box
   if(forceLabels) {
     UG_FontSelect(editable_label_font);
-    UG_S16 strwidth = (editable_label_font->char_width + gui.char_h_space) * strlen(field->editable.label);
-    UG_PutString(layout->x + (width - strwidth) / 2, layout->y + (height - editable_label_font->char_height) / 2, (char*) field->editable.label);
+    UG_S16 strwidth = (editable_label_font->char_width + gui.char_h_space) * strlen(field->editable->label);
+    UG_PutString(layout->x + (width - strwidth) / 2, layout->y + (height - editable_label_font->char_height) / 2, (char*) field->editable->label);
     }
 
   // draw editable value
   char msgbuf[MAX_FIELD_LEN];
   const char *msg;
-  switch (field->editable.typ)
+  switch (field->editable->typ)
   {
   case EditUInt:
   {
-    // properly handle div_digits
-    int divd = field->editable.number.div_digits;
-    if (divd == 0)
-      snprintf(msgbuf, sizeof(msgbuf), "%lu", num);
-    else
-    {
-      int div = 1;
-      while (divd--)
-        div *= 10; // pwrs of 10
-
-      if(field->editable.number.hide_fraction)
-        snprintf(msgbuf, sizeof(msgbuf), "%lu", num / div);
-      else
-        snprintf(msgbuf, sizeof(msgbuf), "%lu.%0*lu", num / div,
-          field->editable.number.div_digits, num % div);
-    }
+    fmt_t f;
+    fmt_begin(&f, msgbuf, sizeof(msgbuf));
+    fmt_fixed(&f, num, field->editable->number.div_digits, field->editable->number.hide_fraction);
+    fmt_end(&f);
     msg = msgbuf;
     break;
   }
   case EditEnum:
-    msg = field->editable.editEnum.options[num];
+    msg = field->editable->editEnum.options[num];
     break;
   default:
     assert(0);
@@ -627,7 +721,7 @@ static bool renderEditable(FieldLayout *layout)
 
   bool showValue = !forceLabels;
   if(showValue) {
-    const UG_FONT *font = layout->font ? layout->font : editable_value_font;
+    const UG_FONT *font = valueFont;
     UG_FontSelect(font);
 
     // how many pixels does our rendered string
@@ -657,21 +751,113 @@ static bool renderEditable(FieldLayout *layout)
   }
 
   // Put units in bottom right (unless we are showing the label)
-  bool showUnits = field->editable.typ == EditUInt && !showLabel && !forceLabels;
+  bool showUnits = field->editable->typ == EditUInt && !showLabel && !forceLabels;
   if(showUnits) {
-    int ulen = strlen(field->editable.number.units);
+    int ulen = strlen(field->editable->number.units);
     if(ulen) {
       const UG_FONT *font = editable_units_font;
       UG_S16 uwidth = (font->char_width + gui.char_h_space) * ulen;
 
       UG_FontSelect(editable_units_font);
-      UG_PutString(layout->x + width - uwidth, layout->y + layout->height - font->char_height - 1, (char*) field->editable.number.units);
+      UG_PutString(layout->x + width - uwidth, layout->y + layout->height - font->char_height - 1, (char*) field->editable->number.units);
     }
   }
 
   return true;
 }
 
+/**
+ * Draw one graph column: a line from min to max, with a notch at the average if the line is long enough to show it
+ */
+static void drawGraphColumn(FieldLayout *layout, const graph_column_t *col, UG_S16 x, UG_S16 top, UG_S16 bottom,
+    uint16_t lo, uint16_t hi)
+{
+  UG_FillFrame(x, top, x, bottom, getBackColor(layout));
+  if(!col)
+    return;
+
+  UG_S16 ys[3];
+  uint16_t values[3] = { col->min, col->max, col->avg };
+  for(int i = 0; i < 3; i++) {
+    uint16_t v = values[i] < lo ? lo : (values[i] > hi ? hi : values[i]);
+    ys[i] = bottom - (int32_t) (v - lo) * (bottom - top) / (hi - lo);
+  }
+
+  UG_DrawLine(x, ys[1], x, ys[0], getForeColor(layout));
+  if(ys[0] - ys[1] >= 2)
+    UG_DrawPixel(x, ys[2], getBackColor(layout));
+}
+
+static bool renderGraph(FieldLayout *layout)
+{
+  Field *field = layout->field;
+  graph_scale_t scale = field->graph.scale;
+
+  // stay inside the border
+  int fatness = (layout->border & BorderFat) ? 2 : 1;
+  UG_S16 left = layout->x + ((layout->border & BorderLeft) ? 1 : 0);
+  UG_S16 right = layout->x + layout->width - 1 - ((layout->border & BorderRight) ? 1 : 0); // the newest column
+  UG_S16 top = layout->y + ((layout->border & BorderTop) ? 1 : 0);
+  UG_S16 bottom = layout->y + layout->height - 1 - ((layout->border & BorderBottom) ? fatness : 0);
+  uint8_t cols = right - left + 1 < GRAPH_COLS ? right - left + 1 : GRAPH_COLS;
+
+  uint16_t lo, hi;
+  graph_range(field->graph.info->data, scale, cols, &lo, &hi);
+
+  if(lo != field->graph.lo || hi != field->graph.hi || field->graph.pending >= cols)
+    field->graph.redraw = true;
+
+  if(field->graph.redraw) {
+    UG_FillFrame(left, top, right, bottom, getBackColor(layout));
+    for(uint8_t age = 0; age < cols; age++)
+      drawGraphColumn(layout, graph_column(field->graph.info->data, scale, age), right - age, top, bottom, lo, hi);
+  }
+  else {
+    // oldest new column first, each one pushes the plot one pixel left
+    for(uint8_t age = field->graph.pending; age > 0; age--) {
+      lcd_scroll_left(right - cols + 1, top, cols, bottom - top + 1);
+      drawGraphColumn(layout, graph_column(field->graph.info->data, scale, age - 1), right, top, bottom, lo, hi);
+    }
+  }
+
+  field->graph.redraw = false;
+  field->graph.pending = 0;
+  field->graph.lo = lo;
+  field->graph.hi = hi;
+  return true;
+}
+
+void fieldGraphSample(Field *field)
+{
+  uint32_t value;
+
+  switch(field->graph.info->size) {
+  case 1:
+    value = *(uint8_t *) field->graph.info->target;
+    break;
+  case 2:
+    value = *(uint16_t *) field->graph.info->target;
+    break;
+  default:
+    value = *(uint32_t *) field->graph.info->target;
+    break;
+  }
+
+  uint8_t finished = graph_add(field->graph.info->data, value > UINT16_MAX ? UINT16_MAX : value);
+  if(finished & (1 << field->graph.scale)) {
+    if(field->graph.pending < UINT8_MAX)
+      field->graph.pending++;
+    field->dirty = true;
+  }
+}
+
+void fieldGraphSetScale(Field *field, graph_scale_t scale)
+{
+  field->graph.scale = scale;
+  field->graph.redraw = true;
+  field->dirty = true;
+}
+
 static bool renderEnd(FieldLayout *layout)
 {
   assert(0); // This should never be called I think
@@ -692,32 +878,31 @@ static bool onPressEditable(buttons_events_t events)
   bool handled = false;
   Field *s = curActiveEditable;
 
+  // UP/DOWN are repeated by the button layer while held, so users can press and hold to change a series of values
   if (events & UP_CLICK)
   {
-    // Note: we mark that we've handled this 'event' (so that other subsystems don't think they should) but really, we have already
-    // been calling changeEditable in our render function, where we check only on blinkChanged, so that users can press and hold to
-    // change values.
-    // changeEditable(true);
+    changeEditable(true, gesture_accel_multiplier(editAccel, sizeof(editAccel) / sizeof(editAccel[0]), buttons_get_held_msecs(UP_CLICK)));
     handled = true;
   }
 
   if (events & DOWN_CLICK)
   {
-    // changeEditable(false);
+    changeEditable(false, gesture_accel_multiplier(editAccel, sizeof(editAccel) / sizeof(editAccel[0]), buttons_get_held_msecs(DOWN_CLICK)));
     handled = true;
   }
 
   // Mark that we are no longer editing - click pwr button to exit
   if (events & ONOFF_CLICK)
   {
-    curActiveEditable = NULL;
+    setActiveEditable(NULL);
+    s->dirty = true; // redraw our position without the cursor
 
     handled = true;
   }
 
   if (handled)
   {
-    s->dirty = true; // redraw our position
+    // Note: a changed value is noticed by renderEditable itself, which then only redraws the value
 
     // If we are inside a scrollable, tell the GUI that scrollable also needs to be redrawn
     Field *scrollable = getActiveScrollable();
@@ -764,8 +949,7 @@ static bool onPressScrollable(buttons_events_t events)
     if (s->scrollable.selected < s->scrollable.first) // we need to scroll the whole list up some
       s->scrollable.first = s->scrollable.selected;
 
-    forceScrollableRender();
-    ;
+    scrollableStack[0]->dirty = true; // only the selection bar and the rows we scrolled to are drawn
     handled = true;
   }
 
@@ -783,7 +967,7 @@ static bool onPressScrollable(buttons_events_t events)
     if (s->scrollable.selected > lastVisibleRow) // we need to scroll the whole list down some
       s->scrollable.first = s->scrollable.selected - numDataRows + 1;
 
-    forceScrollableRender();
+    scrollableStack[0]->dirty = true; // only the selection bar and the rows we scrolled to are drawn
     handled = true;
   }
 
@@ -796,8 +980,8 @@ static bool onPressScrollable(buttons_events_t events)
     switch (clicked->variant)
     {
     case FieldEditable:
-      if(!clicked->editable.read_only) { // only start editing non read only fields
-        curActiveEditable = clicked;
+      if(!clicked->editable->read_only) { // only start editing non read only fields
+        setActiveEditable(clicked);
         curActiveEditable->dirty = true; // force redraw with highlighting
         handled = true;
         forceScrollableRender(); // FIXME, I'm not sure if this is really required
@@ -827,11 +1011,18 @@ static bool onPressScrollable(buttons_events_t events)
  * Used to map from FieldVariant enums to rendering functions
  */
 static const FieldRenderFn renderers[] = { renderDrawText, renderFill,
-    renderMesh, renderScrollable, renderEditable, renderEnd };
+    renderMesh, renderScrollable, renderEditable, renderGraph, renderEnd };
 
-static Screen *curScreen;
+static const Screen *curScreen;
 static bool screenDirty;
 
+// The layouts of the current screen as the renderers see them, resolved once when the screen is set
+static FieldLayout resolved[MAX_RESOLVED_LAYOUTS];
+static FieldLayout *resolvedHeader, *resolvedBody, *resolvedFooter; // header/footer NULL if the screen has none
+
+// The shared bands still showing on the LCD, a band only needs a full redraw if it isn't
+static const Subscreen *shownHeader, *shownFooter;
+
 bool screenOnPress(buttons_events_t events)
 {
   bool handled = false;
@@ -848,33 +1039,117 @@ bool screenOnPress(buttons_events_t events)
   return handled;
 }
 
-// A low level screen render that doesn't use soft device or call exit handlers (useful for the critical fault handler ONLY)
-void panicScreenShow(Screen *screen)
+static void countRendered(const FieldLayout *layouts, int delta)
 {
-  curActiveEditable = NULL;
+  for (const FieldLayout *layout = layouts; layout->field; layout++)
+  {
+    int rendered = layout->field->rendered + delta;
+    assert(rendered >= 0 && rendered <= 7); // rendered is 3 bits, a field can be on one screen at most 7 times
+    layout->field->rendered = rendered;
+  }
+}
+
+static void countScreenRendered(const Screen *screen, int delta)
+{
+  countRendered(screen->fields, delta);
+  if (screen->header)
+    countRendered(screen->header->fields, delta);
+  if (screen->footer)
+    countRendered(screen->footer->fields, delta);
+}
+
+static int countLayouts(const FieldLayout *layouts)
+{
+  int n = 1; // the NULL terminator is copied too
+  for (const FieldLayout *layout = layouts; layout->field; layout++)
+    n++;
+  return n;
+}
+
+int screenLayoutCount(const Screen *screen)
+{
+  return countLayouts(screen->fields) + (screen->header ? countLayouts(screen->header->fields) : 0) +
+      (screen->footer ? countLayouts(screen->footer->fields) : 0);
+}
+
+static void setScreen(const Screen *screen)
+{
+  if (curScreen)
+    countScreenRendered(curScreen, -1);
+  countScreenRendered(screen, 1);
+
+  const Subscreen *header = screen->header, *footer = screen->footer;
+  FieldLayout *next = resolved, *end = resolved + MAX_RESOLVED_LAYOUTS;
+
+  resolvedHeader = header ? next : NULL;
+  if (header)
+    next = resolveLayouts(header->fields, next, end, header->y);
+
+  resolvedBody = next;
+  next = resolveLayouts(screen->fields, next, end, header ? header->y + header->height : 0);
+
+  resolvedFooter = footer ? next : NULL;
+  if (footer)
+    resolveLayouts(footer->fields, next, end, footer->y);
+
+  setActiveEditable(NULL);
   scrollableStackPtr = 0; // new screen might not have one, we will find out when we render
   curScreen = screen;
   screenDirty = true;
+}
+
+// A low level screen render that doesn't use soft device or call exit handlers (useful for the critical fault handler ONLY)
+void panicScreenShow(const Screen *screen)
+{
+  setScreen(screen);
   screenUpdate(); // Force a draw immediately
 }
 
-void screenShow(Screen *screen)
+void screenShow(const Screen *screen)
 {
   if (curScreen && curScreen->onExit)
     curScreen->onExit();
 
-  panicScreenShow(screen);
+  // Drawn by the next screenUpdate(), so the producers get to fill in the fields that were hidden until now
+  setScreen(screen);
 }
 
-Screen *getCurrentScreen() {
+bool fieldIsRendered(const Field *field)
+{
+  return field->rendered != 0;
+}
+
+const Screen *getCurrentScreen() {
   return curScreen;
 }
 
+static bool layoutsAnimating(const FieldLayout *layouts) {
+  for (const FieldLayout *layout = layouts; layout->field; layout++)
+    if (layout->field->dirty || layout->field->blink)
+      return true;
+
+  return false;
+}
+
+bool screenIsAnimating() {
+  if (!curScreen)
+    return false;
+
+  if (screenDirty || curActiveEditable)
+    return true;
+
+  return layoutsAnimating(resolvedBody) ||
+      (resolvedHeader && layoutsAnimating(resolvedHeader)) ||
+      (resolvedFooter && layoutsAnimating(resolvedFooter));
+}
+
 void screenUpdate()
 {
   if (!curScreen)
     return;
 
+  PROF_BEGIN(PROF_SCREEN_UPDATE);
+
   bool didDraw = false; // we only render to hardware if something changed
 
   // Every 200ms toggle any blinking animations
@@ -886,15 +1161,26 @@ void screenUpdate()
     blinkOn = !blinkOn;
   }
 
+  const Subscreen *header = curScreen->header, *footer = curScreen->footer;
+  bool headerShown = header && header == shownHeader, footerShown = footer && footer == shownFooter;
   if (screenDirty)
   {
-    ; // clear screen (to prevent turds from old screen staying around)
-    UG_FillScreen(C_BLACK);
+    // clear screen (to prevent turds from old screen staying around), except for shared bands still showing
+    Coord top = headerShown ? header->y + header->height : 0;
+    Coord bottom = footerShown ? footer->y : screenHeight;
+    UG_FillFrame(0, top, screenWidth - 1, bottom - 1, C_BLACK);
     didDraw = true;
   }
 
   // For each field if that field is dirty (or the screen is) redraw it
-  didDraw |= renderLayouts(curScreen->fields, screenDirty);
+  if (resolvedHeader)
+    didDraw |= renderLayouts(resolvedHeader, !headerShown);
+  didDraw |= renderLayouts(resolvedBody, screenDirty);
+  if (resolvedFooter)
+    didDraw |= renderLayouts(resolvedFooter, !footerShown);
+
+  shownHeader = header;
+  shownFooter = footer;
 
   // flush the screen to the hardware
   if (didDraw)
@@ -903,19 +1189,30 @@ void screenUpdate()
   }
 
   screenDirty = false;
+
+  PROF_END(PROF_SCREEN_UPDATE);
+}
+
+void fieldFormatBegin(Field *field, fmt_t *f)
+{
+  assert(field->drawText.buf); // declare the field with FIELD_DRAWTEXT_BUF()
+  fmt_begin(f, field->drawText.buf, MAX_FIELD_LEN);
+}
+
+void fieldFormatEnd(Field *field, fmt_t *f)
+{
+  if (fmt_end(f))
+    field->dirty = true;
 }
 
 void fieldPrintf(Field *field, const char *fmt, ...)
 {
   va_list argp;
   va_start(argp, fmt);
-  char buf[sizeof(field->drawText.msg)] = "";
-  vsnprintf(buf, sizeof(buf), fmt, argp);
-  if (strcmp(buf, field->drawText.msg) != 0)
-  {
-    strcpy(field->drawText.msg, buf);
-    field->dirty = true;
-  }
+  fmt_t f;
+  fieldFormatBegin(field, &f);
+  fmt_vformat(&f, fmt, argp);
+  fieldFormatEnd(field, &f);
 
   va_end(argp);
 }
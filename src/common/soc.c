@@ -0,0 +1,48 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "soc.h"
+
+// Resting cell millivolts at 0%, 10% ... 100%
+static const uint16_t cell_mv[SOC_NUM_CHEMISTRIES][SOC_TABLE_POINTS] = {
+    // Samsung INR18650-25R at almost no current, about 0.08V for each 10%:
+    // https://endless-sphere.com/forums/download/file.php?id=183920&sid=b7fd7180ef87351cabe74a22f1d162d7
+    [SOC_CHEMISTRY_LI_ION] = { 3305, 3384, 3463, 3542, 3621, 3699, 3778, 3857, 3936, 4015, 4094 },
+    // typical LiFePO4 resting curve, very flat in the middle
+    [SOC_CHEMISTRY_LIFEPO4] = { 2500, 3000, 3200, 3220, 3250, 3260, 3270, 3300, 3320, 3350, 3400 },
+};
+
+void soc_table_update(soc_table_t *t, soc_chemistry_t chemistry, uint8_t cells)
+{
+  if (chemistry >= SOC_NUM_CHEMISTRIES) // before the compare, or a bad value would rebuild the table every call
+    chemistry = SOC_CHEMISTRY_LI_ION;
+
+  if (t->chemistry == chemistry && t->cells == cells)
+    return;
+
+  for (uint8_t i = 0; i < SOC_TABLE_POINTS; i++)
+    t->pack_x100[i] = ((uint32_t) cell_mv[chemistry][i] * cells + 5) / 10;
+
+  t->chemistry = chemistry;
+  t->cells = cells;
+}
+
+uint8_t soc_from_voltage(const soc_table_t *t, uint16_t pack_volts_x10)
+{
+  uint32_t v = (uint32_t) pack_volts_x10 * 10;
+
+  if (v <= t->pack_x100[0])
+    return 0;
+
+  for (uint8_t i = 1; i < SOC_TABLE_POINTS; i++) {
+    uint16_t lo = t->pack_x100[i - 1], hi = t->pack_x100[i];
+
+    if (v < hi) // rounded to the nearest percent
+      return (i - 1) * 10 + ((v - lo) * 10 + (hi - lo) / 2) / (hi - lo);
+  }
+
+  return 100;
+}
@@ -0,0 +1,53 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "stackmon.h"
+
+// Lower the mark to the lowest used word in [from, to)
+static void scan(stackmon_t *m, uint32_t from, uint32_t to) {
+  for (uint32_t i = from; i < to; i++)
+    if (m->limit[i] != STACKMON_FILL) {
+      m->unused = i;
+      return;
+    }
+}
+
+void stackmon_init(stackmon_t *m, const volatile uint32_t *limit, uint32_t words) {
+  m->limit = limit;
+  m->words = words;
+  m->unused = words;
+  m->sweep = 0;
+  scan(m, 0, words);
+}
+
+void stackmon_check(stackmon_t *m) {
+  // Just below the mark is where deeper use shows up first
+  uint32_t below = m->unused > STACKMON_WINDOW_WORDS ? m->unused - STACKMON_WINDOW_WORDS : 0;
+  scan(m, below, m->unused);
+
+  // And one window of the rest
+  if (m->sweep >= below)
+    m->sweep = 0;
+
+  uint32_t end = m->sweep + STACKMON_WINDOW_WORDS;
+  if (end > below)
+    end = below;
+
+  scan(m, m->sweep, end);
+  m->sweep = end;
+}
+
+bool stackmon_canary_ok(const stackmon_t *m) {
+  for (uint32_t i = 0; i < STACKMON_CANARY_WORDS && i < m->words; i++)
+    if (m->limit[i] != STACKMON_FILL)
+      return false;
+
+  return true;
+}
+
+uint32_t stackmon_unused_bytes(const stackmon_t *m) {
+  return m->unused * sizeof(uint32_t);
+}
@@ -21,6 +21,13 @@
 #include "buttons.h"
 #include "adc.h"
 #include "fault.h"
+#include "profile.h"
+#include "soc.h"
+#include "coulomb.h"
+#include "energy.h"
+#include "range.h"
+#include "odometer.h"
+#include "tripstats.h"
 
 static uint8_t ui8_m_usart1_received_first_package = 0;
 uint16_t ui16_m_battery_soc_watts_hour;
@@ -388,7 +395,7 @@ void l2_low_pass_filter_battery_voltage_current_power(void)
 
   // battery power
   l2_vars.ui16_battery_power_filtered_x50 = l2_vars.ui16_battery_current_filtered_x5 * l2_vars.ui16_battery_voltage_filtered_x10;
-  l2_vars.ui16_battery_power_filtered = l2_vars.ui16_battery_power_filtered_x50 / 50;
+  l2_vars.ui16_battery_power_filtered = ((uint32_t) l2_vars.ui16_battery_current_filtered_x5 * l2_vars.ui16_battery_voltage_filtered_x10) / 50; // x50 overflows above about 1300W
 
   // loose resolution under 200W
   if(l2_vars.ui16_battery_power_filtered < 200)
@@ -516,70 +523,77 @@ void l2_calc_battery_voltage_soc(void)
 }
 
 
+static energy_t energy; // used since power on, copy_layer_2_layer_3_vars() adds l3_vars.ui32_wh_x10_offset
+
 void l2_calc_wh(void)
 {
-  static uint8_t ui8_1s_timmer_counter = 0;
-  uint32_t ui32_temp = 0;
+  // not ui16_battery_power_filtered_x50, which overflows above about 1300W
+  energy_add(&energy, (uint32_t) l2_vars.ui16_battery_current_filtered_x5 * l2_vars.ui16_battery_voltage_filtered_x10);
+}
 
-  if(l2_vars.ui16_battery_power_filtered_x50 > 0)
-  {
-    l2_vars.ui32_wh_sum_x5 += l2_vars.ui16_battery_power_filtered_x50 / 10;
-    l2_vars.ui32_wh_sum_counter++;
-  }
 
-  // calc at 1s rate
-  if(ui8_1s_timmer_counter < 10)
-  {
-    ui8_1s_timmer_counter = 0;
 
-    // avoid zero divisison
-    if(l2_vars.ui32_wh_sum_counter != 0)
-    {
-      ui32_temp = l2_vars.ui32_wh_sum_counter / 36;
-      ui32_temp = (ui32_temp * (l2_vars.ui32_wh_sum_x5 / l2_vars.ui32_wh_sum_counter)) / 500;
-    }
+static coulomb_t coulomb;
+static volatile bool coulomb_running; // once first_time_management() has started it from the saved state
 
-    l2_vars.ui32_wh_x10 = l2_vars.ui32_wh_x10_offset + ui32_temp;
-  }
-  ui8_1s_timmer_counter++;
+static void l2_calc_coulomb_soc(void)
+{
+  if (coulomb_running)
+    coulomb_update(&coulomb, l2_vars.ui8_battery_current_x5, l3_vars.volt_based_soc);
 }
 
+static range_t range;
 
+static odometer_t odometer;
+static volatile bool odometer_running; // set once the controller is sending real tick counts
 
 static void l2_calc_odometer(void)
 {
-  uint32_t uint32_temp;
-  static uint8_t ui8_1s_timmer_counter;
+  if (!odometer_running)
+    return;
+
+  uint32_t steps = odometer_update(&odometer, l2_vars.ui32_wheel_speed_sensor_tick_counter, l2_vars.ui16_wheel_perimeter);
 
-  // calc at 1s rate
-  if (ui8_1s_timmer_counter++ >= 10)
+  // update all distance variables for each 100 meters traveled
+  while (steps--)
   {
-    ui8_1s_timmer_counter = 0;
+    l3_vars.ui32_odometer_x10 += 1;
+    l3_vars.ui32_trip_x10 += 1;
+    range_step(&range, energy_wh_x10(&energy), l2_vars.ui8_assist_level);
+  }
+}
 
-    uint32_temp = (l2_vars.ui32_wheel_speed_sensor_tick_counter - l3_vars.ui32_wheel_speed_sensor_tick_counter_offset)
-        * ((uint32_t) l2_vars.ui16_wheel_perimeter);
-    // avoid division by 0
-    if (uint32_temp > 100000) { uint32_temp /= 100000;}  // milimmeters to 0.1kms
-    else { uint32_temp = 0; }
 
-    // now store the value on the global variable
-    // l2_vars.ui16_odometer_distance_x10 = (uint16_t) uint32_temp;
+static tripstats_t trip_stats;
+static volatile bool trip_stats_running; // once first_time_management() has restored the saved trip
+static volatile bool trip_reset_requested;
 
-    // calculate how many revolutions since last reset and convert to distance traveled
-    uint32_t ui32_temp = (l3_vars.ui32_wheel_speed_sensor_tick_counter - l3_vars.ui32_wheel_speed_sensor_tick_counter_offset) * ((uint32_t) l3_vars.ui16_wheel_perimeter);
+void trip_reset(void)
+{
+  trip_reset_requested = true;
+}
 
-    // if traveled distance is more than 100 meters update all distance variables and reset
-    if (ui32_temp >= 100000) // 100000 -> 100000 mm -> 0.1 km
-    {
-      // update all distance variables
-      // l3_vars.ui16_distance_since_power_on_x10 += 1;
-      l3_vars.ui32_odometer_x10 += 1;
-      l3_vars.ui32_trip_x10 += 1;
+static void l2_calc_trip_stats(void)
+{
+  if (!trip_stats_running)
+    return;
 
-      // reset the always incrementing value (up to motor controller power reset) by setting the offset to current value
-      l3_vars.ui32_wheel_speed_sensor_tick_counter_offset = l3_vars.ui32_wheel_speed_sensor_tick_counter;
-    }
+  if (trip_reset_requested)
+  {
+    trip_reset_requested = false;
+    tripstats_reset(&trip_stats);
+    l3_vars.ui32_trip_x10 = 0;
+    range_reset(&range, energy_wh_x10(&energy));
   }
+
+  tripstats_sample_t sample = {
+      .speed_x10 = l2_vars.ui16_wheel_speed_x10,
+      .motor_power = l2_vars.ui16_battery_power_filtered,
+      .human_power = l2_vars.ui16_pedal_power_filtered,
+      .cadence = l2_vars.ui8_pedal_cadence_filtered,
+      .assist_level = l2_vars.ui8_assist_level,
+      .power_x50 = (uint32_t) l2_vars.ui16_battery_current_filtered_x5 * l2_vars.ui16_battery_voltage_filtered_x10 };
+  tripstats_update(&trip_stats, &sample);
 }
 
 
@@ -625,6 +639,18 @@ uint8_t first_time_management(void)
       l3_vars.ui32_wh_x10_offset = 0;
     }
 
+    // until we have learned the capacity, guess it from the battery energy the user entered
+    uint32_t capacity = l3_vars.ui32_soc_capacity_mas ? l3_vars.ui32_soc_capacity_mas :
+        coulomb_capacity_from_wh(l3_vars.ui32_wh_x10_100_percent, l3_vars.ui8_battery_cells_number);
+    coulomb_init(&coulomb, capacity, l3_vars.ui32_soc_remaining_mas);
+    coulomb_running = true;
+
+    odometer_init(&odometer, l3_vars.ui32_odometer_remainder_mm);
+    odometer_running = true;
+
+    trip_stats = l3_vars.trip_stats;
+    trip_stats_running = true;
+
     if (l3_vars.ui8_offroad_feature_enabled &&
       l3_vars.ui8_offroad_enabled_on_startup)
     {
@@ -674,7 +700,11 @@ void layer_2(void)
   //if(!ui32_g_layer_2_can_execute)
   //  return;
 
+  PROF_BEGIN(PROF_LAYER_2);
+
+  PROF_BEGIN(PROF_PROCESS_RX);
   process_rx();
+  PROF_END(PROF_PROCESS_RX);
   send_tx_package();
 
   /************************************************************************************************/
@@ -686,12 +716,16 @@ void layer_2(void)
   l2_calc_battery_voltage_soc();
   l2_calc_odometer();
   l2_calc_wh();
+  l2_calc_coulomb_soc();
+  l2_calc_trip_stats();
 
   // graphs_measurements_update();
   /************************************************************************************************/
 
   first_time_management();
   calc_battery_soc_watts_hour();
+
+  PROF_END(PROF_LAYER_2);
 }
 
 
@@ -701,6 +735,8 @@ void layer_2(void)
  */
 void copy_layer_2_layer_3_vars(void)
 {
+  PROF_BEGIN(PROF_COPY_LAYER3);
+
   l3_vars.ui16_adc_battery_voltage = l2_vars.ui16_adc_battery_voltage;
   l3_vars.ui8_battery_current_x5 = l2_vars.ui8_battery_current_x5;
   l3_vars.ui8_throttle = l2_vars.ui8_throttle;
@@ -724,12 +760,9 @@ void copy_layer_2_layer_3_vars(void)
   l3_vars.ui16_pedal_power_filtered = l2_vars.ui16_pedal_power_filtered;
   l3_vars.ui8_pedal_cadence_filtered = l2_vars.ui8_pedal_cadence_filtered;
   l3_vars.ui16_battery_voltage_soc_x10 = l2_vars.ui16_battery_voltage_soc_x10;
-  l3_vars.ui32_wh_sum_x5 = l2_vars.ui32_wh_sum_x5;
-  l3_vars.ui32_wh_sum_counter = l2_vars.ui32_wh_sum_counter;
-  l3_vars.ui32_wh_x10 = l2_vars.ui32_wh_x10;
+  l3_vars.ui32_wh_x10 = l3_vars.ui32_wh_x10_offset + energy_wh_x10(&energy);
   l3_vars.ui8_braking = l2_vars.ui8_braking;
 
-  l2_vars.ui32_wh_x10_offset = l3_vars.ui32_wh_x10_offset;
   l2_vars.ui16_battery_pack_resistance_x1000 = l3_vars.ui16_battery_pack_resistance_x1000;
   l2_vars.ui8_assist_level = l3_vars.ui8_assist_level;
   l2_vars.ui8_assist_level_factor[0] = l3_vars.ui8_assist_level_factor[0];
@@ -786,19 +819,39 @@ void copy_layer_2_layer_3_vars(void)
   l2_vars.ui8_offroad_power_limit_div25 = l3_vars.ui8_offroad_power_limit_div25;
 
   // Some l3 vars are derived only from other l3 vars
-  uint32_t ui32_battery_cells_number_x10 = (uint32_t) (l3_vars.ui8_battery_cells_number * 10);
-
-  uint8_t volt_based_soc;
-  if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_90))) { volt_based_soc = 95; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_80))) { volt_based_soc = 85; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_70))) { volt_based_soc = 75; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_60))) { volt_based_soc = 65; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_50))) { volt_based_soc = 55; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_40))) { volt_based_soc = 45; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_30))) { volt_based_soc = 35; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_20))) { volt_based_soc = 25; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_10))) { volt_based_soc = 15; }
-  else if(l3_vars.ui16_battery_voltage_soc_x10 > ((uint16_t) ((float) ui32_battery_cells_number_x10 * LI_ION_CELL_VOLTS_0))) { volt_based_soc = 5; }
-  else { volt_based_soc = 0; }
-  l3_vars.volt_based_soc = volt_based_soc;
+  static soc_table_t soc_table;
+  soc_table_update(&soc_table, l3_vars.ui8_battery_chemistry, l3_vars.ui8_battery_cells_number);
+  l3_vars.volt_based_soc = soc_from_voltage(&soc_table, l3_vars.ui16_battery_voltage_soc_x10);
+
+  if(coulomb_running) {
+    l3_vars.ui32_soc_capacity_mas = coulomb.capacity_mas;
+    l3_vars.ui32_soc_remaining_mas = coulomb.remaining_mas;
+    l3_vars.fused_soc = (coulomb.soc_x10 + 5) / 10;
+  }
+  else
+    l3_vars.fused_soc = l3_vars.volt_based_soc;
+
+  if(odometer_running)
+    l3_vars.ui32_odometer_remainder_mm = odometer_remainder_mm(&odometer);
+
+  if(trip_stats_running) {
+    // a layer_2() update in the middle of this copy only makes the saved copy a sample out of step
+    l3_vars.trip_stats = trip_stats;
+    l3_vars.ui32_trip_moving_sec = tripstats_moving_sec(&trip_stats);
+    l3_vars.ui16_trip_avg_speed_x10 = tripstats_average(&trip_stats.speed_x10);
+    l3_vars.ui16_trip_max_speed_x10 = trip_stats.max_speed_x10;
+    l3_vars.ui16_trip_avg_motor_power = tripstats_average(&trip_stats.motor_power);
+    l3_vars.ui16_trip_max_motor_power = trip_stats.max_motor_power;
+    l3_vars.ui16_trip_avg_human_power = tripstats_average(&trip_stats.human_power);
+    l3_vars.ui8_trip_avg_cadence = tripstats_average(&trip_stats.cadence);
+  }
+
+  // remaining Wh at the nominal 3.6V per cell
+  uint32_t remaining_wh_x10 = l3_vars.ui32_soc_remaining_mas / 100000 * l3_vars.ui8_battery_cells_number;
+  l3_vars.ui16_wh_per_km_x10 = range_wh_per_km_x10(&range, RANGE_SHORT);
+  l3_vars.ui16_wh_per_km_10km_x10 = range_wh_per_km_x10(&range, RANGE_LONG);
+  l3_vars.ui16_wh_per_km_trip_x10 = range_wh_per_km_x10(&range, RANGE_TRIP);
+  l3_vars.ui16_range_x10 = range_km_x10(&range, remaining_wh_x10, l3_vars.ui8_assist_level);
+
+  PROF_END(PROF_COPY_LAYER3);
 }
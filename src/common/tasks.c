@@ -0,0 +1,124 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "tasks.h"
+
+static task_t *table;
+static uint8_t count;
+static task_clock_fn get_msecs_fn, get_ticks_fn;
+static uint32_t mask;
+
+void tasks_init(task_t *tasks, uint8_t num_tasks, task_clock_fn msecs, task_clock_fn ticks, uint32_t ticks_mask) {
+  table = tasks;
+  count = num_tasks;
+  get_msecs_fn = msecs;
+  get_ticks_fn = ticks;
+  mask = ticks_mask;
+
+  // Keep the table in priority order (insertion sort, stable so equal priorities keep their order)
+  for (uint8_t i = 1; i < count; i++) {
+    task_t t = table[i];
+    uint8_t j = i;
+    for (; j > 0 && table[j - 1].priority > t.priority; j--)
+      table[j] = table[j - 1];
+    table[j] = t;
+  }
+
+  uint32_t now = get_msecs_fn();
+  for (uint8_t i = 0; i < count; i++)
+    table[i].next_due = now + table[i].phase_msec;
+
+  tasks_clear_stats();
+}
+
+static bool is_due(const task_t *t, uint32_t now) {
+  return (int32_t) (now - t->next_due) >= 0;
+}
+
+static void run_task(task_t *t, uint32_t now) {
+  // Schedule the next run on the task's own grid, dropping any periods we are too late for
+  t->next_due += t->period_msec;
+  while (is_due(t, now)) {
+    t->next_due += t->period_msec;
+    t->missed++;
+  }
+
+  uint32_t start = get_ticks_fn();
+  t->run();
+  uint32_t elapsed = (get_ticks_fn() - start) & mask;
+
+  t->runs++;
+  t->total_ticks += elapsed;
+  if (elapsed > t->max_ticks)
+    t->max_ticks = elapsed;
+  if (t->budget_ticks && elapsed > t->budget_ticks)
+    t->overruns++;
+}
+
+uint8_t tasks_run(void) {
+  uint32_t ran = 0; // each task runs at most once per call, so a slow task can't starve the others
+  uint8_t runs = 0;
+
+  for (uint8_t i = 0; i < count;) {
+    uint32_t now = get_msecs_fn();
+    if (!(ran & (1UL << i)) && is_due(&table[i], now)) {
+      run_task(&table[i], now);
+      ran |= 1UL << i;
+      runs++;
+      i = 0; // time has passed, higher priority tasks may be due now
+    }
+    else
+      i++;
+  }
+
+  return runs;
+}
+
+void tasks_resync(void) {
+  uint32_t now = get_msecs_fn();
+
+  for (uint8_t i = 0; i < count; i++) {
+    task_t *t = &table[i];
+    while (is_due(t, now - t->period_msec))
+      t->next_due += t->period_msec;
+  }
+}
+
+void tasks_clear_stats(void) {
+  for (uint8_t i = 0; i < count; i++) {
+    task_t *t = &table[i];
+    t->runs = t->total_ticks = t->max_ticks = t->overruns = t->missed = 0;
+  }
+}
+
+uint8_t tasks_count(void) {
+  return count;
+}
+
+const task_t *tasks_get(uint8_t index) {
+  return index < count ? &table[index] : NULL;
+}
+
+const task_t *tasks_find(const char *name) {
+  for (uint8_t i = 0; i < count; i++)
+    if (strcmp(table[i].name, name) == 0)
+      return &table[i];
+
+  return NULL;
+}
+
+uint32_t tasks_avg_ticks(const task_t *task) {
+  return task->runs ? task->total_ticks / task->runs : 0;
+}
+
+uint32_t tasks_total_missed(void) {
+  uint32_t missed = 0;
+  for (uint8_t i = 0; i < count; i++)
+    missed += table[i].missed;
+  return missed;
+}
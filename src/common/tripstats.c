@@ -0,0 +1,64 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "tripstats.h"
+
+void tripstats_reset(tripstats_t *t)
+{
+  memset(t, 0, sizeof(*t));
+}
+
+static void average_add(tripstats_avg_t *a, uint32_t value)
+{
+  if (a->sum >= TRIPSTATS_SUM_LIMIT) {
+    // an odd count would lose half a sample from the count but not from the sum, so drop an average one first
+    if (a->count & 1) {
+      a->sum -= a->sum / a->count;
+      a->count--;
+    }
+    a->sum >>= 1;
+    a->count >>= 1;
+  }
+
+  a->sum += value;
+  a->count++;
+}
+
+void tripstats_update(tripstats_t *t, const tripstats_sample_t *s)
+{
+  uint8_t level = s->assist_level < TRIPSTATS_LEVELS ? s->assist_level : TRIPSTATS_LEVELS - 1;
+
+  // energy counts even when standing, the motor can be on at the start of a hill
+  energy_add(&t->level_energy[level], s->power_x50);
+
+  if (s->speed_x10 < TRIPSTATS_MOVING_SPEED_X10)
+    return;
+
+  t->moving_ds++;
+  t->level_ds[level]++;
+
+  average_add(&t->speed_x10, s->speed_x10);
+  average_add(&t->motor_power, s->motor_power);
+  average_add(&t->human_power, s->human_power);
+  if (s->cadence)
+    average_add(&t->cadence, s->cadence);
+
+  if (s->speed_x10 > t->max_speed_x10)
+    t->max_speed_x10 = s->speed_x10;
+  if (s->motor_power > t->max_motor_power)
+    t->max_motor_power = s->motor_power;
+}
+
+uint32_t tripstats_average(const tripstats_avg_t *a)
+{
+  return a->count ? (a->sum + a->count / 2) / a->count : 0;
+}
+
+uint32_t tripstats_moving_sec(const tripstats_t *t)
+{
+  return t->moving_ds / 10;
+}
@@ -22,6 +22,9 @@ struct uart_rx_buff_typedef
 uart_rx_buff_typedef* uart_rx_buffer;
 volatile uint8_t* uart_rx_data_rdy;
 
+// Received packets since boot (for the diagnostics screen), bad ones failed their CRC or had a UART error
+static volatile uint32_t rx_frames_ok, rx_frames_bad;
+
 uint8_t uart_buffer0_tx[UART_NUMBER_START_BYTES + UART_NUMBER_DATA_BYTES_TO_SEND + UART_NUMBER_CRC_BYTES];
 
 /* Function prototype */
@@ -73,12 +76,27 @@ const uint8_t* uart_get_rx_buffer_rdy(void)
 
     if (((((uint16_t) rx_rdy[UART_NUMBER_DATA_BYTES_TO_RECEIVE + 2]) << 8)
         + ((uint16_t) rx_rdy[UART_NUMBER_DATA_BYTES_TO_RECEIVE + 1])) != crc_rx)
+    {
       rx_rdy = NULL;  // Invalidate buffer if CRC not OK
+      rx_frames_bad++;
+    }
+    else
+      rx_frames_ok++;
   }
 
   return rx_rdy;
 }
 
+uint32_t uart_get_rx_frames_ok(void)
+{
+  return rx_frames_ok;
+}
+
+uint32_t uart_get_rx_frames_bad(void)
+{
+  return rx_frames_bad;
+}
+
 /**
  * @brief Returns pointer to TX buffer
  */
@@ -115,6 +133,7 @@ static void uart_event_handler(nrf_drv_uart_event_t *p_event, void *p_context)
     // assert(p_event->data.error.error_mask & (UART_ERRORSRC_OVERRUN_Msk | UART_ERRORSRC_FRAMING_Msk | UART_ERRORSRC_BREAK_Msk));
 
     uart_rx_state_machine = 0;
+    rx_frames_bad++;
     APP_ERROR_CHECK(nrf_drv_uart_rx(&uart0, &uart_rx_buffer->uart_rx_data[0], 1));
     break;
 
@@ -19,9 +19,11 @@
 #include "ble_dis.h"
 #include "fds.h"
 #include "mainscreen.h"
+#include "mirror.h"
+#include "profile.h"
+#include "crashlog.h"
 
-// define to enable the (not yet used) serial service
-// #define BLE_SERIAL
+// BLE_SERIAL (build with "make BLE_SERIAL=1") enables the serial service and the debug commands in nus_data_handler()
 // define to able reporting speed and cadence via bluetooth
 #define BLE_CSC
 // define to enable reporting battery SOC via bluetooth
@@ -103,6 +105,124 @@ static void gap_params_init(void)
 
 
 #ifdef BLE_SERIAL
+extern uint8_t frameBuffer[16][64];
+
+/**@brief Send one packet over the serial service, returns false if the SoftDevice has no room for it right now.
+ *
+ * @param[in] on_gone  Called if the client went away, so the sender stops trying.
+ */
+static bool nus_try_send(const uint8_t *data, uint16_t len, void (*on_gone)(void))
+{
+  uint32_t err_code = ble_nus_string_send(&m_nus, (uint8_t *) data, len);
+
+  if (err_code == NRF_SUCCESS)
+    return true;
+
+  if (err_code == BLE_ERROR_NO_TX_PACKETS)
+    return false;
+
+  // Disconnected or notifications turned off, no point in trying any further
+  if ((err_code == NRF_ERROR_INVALID_STATE) ||
+      (err_code == BLE_ERROR_GATTS_SYS_ATTR_MISSING))
+  {
+    on_gone();
+    return false;
+  }
+
+  APP_ERROR_HANDLER(err_code);
+  return false;
+}
+
+/**@brief Send one screen mirror packet.
+ */
+static bool mirror_send(const uint8_t *data, uint16_t len)
+{
+  return nus_try_send(data, len, mirror_stop);
+}
+
+/**@brief Send one crash log dump packet.
+ */
+static bool crashlog_send(const uint8_t *data, uint16_t len)
+{
+  return nus_try_send(data, len, crashlog_dump_stop);
+}
+
+// One shot replies need no cleanup, if there was no room the client just asks again
+static void reply_gone(void)
+{
+}
+
+/**@brief Reply to an 'R' request with the efficiency and range, all little endian uint16:
+ *        'R', Wh/km x10 over 1km, 10km and the trip, range km x10, fused SOC (uint8)
+ */
+static void range_send(void)
+{
+  uint16_t values[] = { l3_vars.ui16_wh_per_km_x10, l3_vars.ui16_wh_per_km_10km_x10, l3_vars.ui16_wh_per_km_trip_x10,
+      l3_vars.ui16_range_x10 };
+  uint8_t pkt[2 + sizeof(values)];
+
+  pkt[0] = 'R';
+  memcpy(&pkt[1], values, sizeof(values));
+  pkt[1 + sizeof(values)] = l3_vars.fused_soc;
+  nus_try_send(pkt, sizeof(pkt), reply_gone);
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+  memcpy(p, &v, sizeof(v));
+  return p + sizeof(v);
+}
+
+/**@brief Reply to a 'T' request with the trip statistics, little endian:
+ *        'T', moving sec (uint32), trip km x10 (uint32), avg and max speed km/h x10, avg and max motor W,
+ *        avg human W (all uint16), avg cadence rpm (uint8)
+ *        'T' followed by an assist level digit replies with
+ *        'L', level (uint8), moving sec in that level (uint32), battery Wh x10 used in that level (uint32)
+ */
+static void trip_send(const uint8_t *req, uint16_t len)
+{
+  uint8_t pkt[BLE_NUS_MAX_DATA_LEN], *p = pkt;
+
+  if(len >= 2) {
+    uint8_t level = req[1] - '0';
+    if(level >= TRIPSTATS_LEVELS)
+      return;
+
+    *p++ = 'L';
+    *p++ = level;
+    p = put_u32(p, l3_vars.trip_stats.level_ds[level] / 10);
+    p = put_u32(p, energy_wh_x10(&l3_vars.trip_stats.level_energy[level]));
+  }
+  else {
+    *p++ = 'T';
+    p = put_u32(p, l3_vars.ui32_trip_moving_sec);
+    p = put_u32(p, l3_vars.ui32_trip_x10);
+    p = put_u16(p, l3_vars.ui16_trip_avg_speed_x10);
+    p = put_u16(p, l3_vars.ui16_trip_max_speed_x10);
+    p = put_u16(p, l3_vars.ui16_trip_avg_motor_power);
+    p = put_u16(p, l3_vars.ui16_trip_max_motor_power);
+    p = put_u16(p, l3_vars.ui16_trip_avg_human_power);
+    *p++ = l3_vars.ui8_trip_avg_cadence;
+  }
+
+  nus_try_send(pkt, p - pkt, reply_gone);
+}
+
+#ifdef PROFILE
+/**@brief Send one profiler dump packet.
+ */
+static bool profile_send(const uint8_t *data, uint16_t len)
+{
+  return nus_try_send(data, len, profile_dump_stop);
+}
+#endif
+
 /**@brief Function for handling the data from the Nordic UART Service.
  *
  * @param[in] p_nus    Nordic UART Service structure.
@@ -111,7 +231,43 @@ static void gap_params_init(void)
  */
 static void nus_data_handler(ble_nus_t * p_nus, uint8_t * p_data, uint16_t length)
 {
- // fixme
+  if(length < 1)
+    return;
+
+  PROF_BEGIN(PROF_NUS_DATA);
+
+  switch(p_data[0]) {
+  case 'M': // M1 starts screen mirroring, M0 stops it
+    if(length >= 2 && p_data[1] == '1')
+      mirror_start(&frameBuffer[0][0], mirror_send);
+    else
+      mirror_stop();
+    break;
+  case 'R': // R replies with the efficiency and range
+    range_send();
+    break;
+  case 'T': // T replies with the trip statistics, T0-T9 with the time and energy in one assist level
+    trip_send(p_data, length);
+    break;
+  case 'C': // C dumps the saved crash records, CC erases them
+    if(length >= 2 && p_data[1] == 'C')
+      crashlog_clear();
+    else
+      crashlog_dump_start(crashlog_send);
+    break;
+#ifdef PROFILE
+  case 'P': // P dumps the profiler stats and trace, PC clears them
+    if(length >= 2 && p_data[1] == 'C')
+      profile_clear();
+    else
+      profile_dump_start(profile_send);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  PROF_END(PROF_NUS_DATA);
 }
 
 // Init the serial port service
@@ -321,7 +477,7 @@ static ble_bas_t  m_bas;
 static void battery_level_update(void)
 {
     uint32_t err_code;
-    uint8_t  battery_level = l3_vars.volt_based_soc; // from 0 to 100
+    uint8_t  battery_level = l3_vars.fused_soc; // from 0 to 100
 
     err_code = ble_bas_battery_level_update(&m_bas, battery_level);
     if ((err_code != NRF_SUCCESS) &&
@@ -500,6 +656,13 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
 
         case BLE_GAP_EVT_DISCONNECTED:
             m_conn_handle = BLE_CONN_HANDLE_INVALID;
+#ifdef BLE_SERIAL
+            mirror_stop();
+            crashlog_dump_stop();
+#ifdef PROFILE
+            profile_dump_stop();
+#endif
+#endif
             break; // BLE_GAP_EVT_DISCONNECTED
 
         case BLE_GAP_EVT_SEC_PARAMS_REQUEST:
@@ -576,12 +739,14 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
  */
 static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
 {
+    PROF_BEGIN(PROF_BLE_EVT);
     ble_conn_params_on_ble_evt(p_ble_evt);
 #ifdef BLE_SERIAL
     ble_nus_on_ble_evt(&m_nus, p_ble_evt);
 #endif
     on_ble_evt(p_ble_evt);
     ble_advertising_on_ble_evt(p_ble_evt);
+    PROF_END(PROF_BLE_EVT);
 }
 
 
@@ -594,6 +759,8 @@ static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
  */
 static void sys_evt_dispatch(uint32_t sys_evt)
 {
+    PROF_BEGIN(PROF_SYS_EVT);
+
     // Dispatch the system event to the fstorage module, where it will be
     // dispatched to the Flash Data Storage (FDS) module.
     fs_sys_event_handler(sys_evt);
@@ -602,6 +769,8 @@ static void sys_evt_dispatch(uint32_t sys_evt)
     // pending flash operations in fstorage. Let fstorage process system events first,
     // so that it can report correctly to the Advertising module.
     ble_advertising_on_sys_evt(sys_evt);
+
+    PROF_END(PROF_SYS_EVT);
 }
 
 
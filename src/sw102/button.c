@@ -6,6 +6,9 @@
  * Released under the GPL License, Version 3
  */
 #include "button.h"
+#include "main.h"
+#include "app_timer.h"
+#include "nrf_drv_gpiote.h"
 
 /**
  * @brief Init button struct. Call once.
@@ -32,3 +35,90 @@ bool PollButton(Button* button)
 }
 
 
+
+/* Edges are queued from the GPIOTE interrupt (only writer of edgeHead) and taken by the main loop
+ * (only writer of edgeTail), so no locking is needed.  The interrupt just stores the raw RTC counter,
+ * conversion to msecs is left to the reader.
+ */
+static Button* edgeButtons[BUTTON_COUNT];
+static struct
+{
+  uint32_t Ticks;
+  uint8_t Id;
+  bool Pressed;
+} edgeQueue[BUTTON_EDGE_QUEUE_SIZE];
+static volatile uint8_t edgeHead, edgeTail;
+static volatile uint32_t edgesDropped;
+
+static void button_edge_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+  uint32_t ticks = app_timer_cnt_get();
+
+  for (uint8_t id = 0; id < BUTTON_COUNT; id++)
+  {
+    if (edgeButtons[id] && edgeButtons[id]->PinNumber == pin)
+    {
+      uint8_t next = (edgeHead + 1) & (BUTTON_EDGE_QUEUE_SIZE - 1);
+      if (next == edgeTail)
+      {
+        edgesDropped++; // reader fell way behind, the level resync in buttons.c will catch up
+        return;
+      }
+
+      edgeQueue[edgeHead].Ticks = ticks;
+      edgeQueue[edgeHead].Id = id;
+      edgeQueue[edgeHead].Pressed = PollButton(edgeButtons[id]);
+      __DMB(); // entry must be complete before the reader can see it
+      edgeHead = next;
+      return;
+    }
+  }
+}
+
+/**
+ * @brief Report all pin changes of the buttons through the edge queue. Call once after InitButton.
+ */
+void InitButtonEdges(Button* buttons[BUTTON_COUNT])
+{
+  if (!nrf_drv_gpiote_is_init())
+    APP_ERROR_CHECK(nrf_drv_gpiote_init());
+
+  // Low power PORT events, we only have one button per GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS slot
+  nrf_drv_gpiote_in_config_t config = GPIOTE_CONFIG_IN_SENSE_TOGGLE(false);
+
+  for (uint8_t id = 0; id < BUTTON_COUNT; id++)
+  {
+    edgeButtons[id] = buttons[id];
+    config.pull = buttons[id]->ActiveState == BUTTON_ACTIVE_LOW ? NRF_GPIO_PIN_PULLUP : NRF_GPIO_PIN_NOPULL;
+
+    APP_ERROR_CHECK(nrf_drv_gpiote_in_init(buttons[id]->PinNumber, &config, button_edge_handler));
+    nrf_drv_gpiote_in_event_enable(buttons[id]->PinNumber, true);
+  }
+}
+
+/**
+ * @brief True if edges are queued that PopButtonEdge() hasn't taken yet.
+ */
+bool HasButtonEdges(void)
+{
+  return edgeTail != edgeHead;
+}
+
+/**
+ * @brief Take the oldest queued edge, with its timestamp converted to msecs since boot.
+ */
+bool PopButtonEdge(ButtonEdge* edge)
+{
+  if (edgeTail == edgeHead)
+    return false;
+
+  __DMB();
+  uint32_t ageTicks;
+  app_timer_cnt_diff_compute(app_timer_cnt_get(), edgeQueue[edgeTail].Ticks, &ageTicks);
+  edge->Time = get_msecs() - ((ageTicks * 125) >> 12); // 32768 Hz RTC ticks to msecs, fits 24 bits of ticks
+  edge->Id = (ButtonId) edgeQueue[edgeTail].Id;
+  edge->Pressed = edgeQueue[edgeTail].Pressed;
+  edgeTail = (edgeTail + 1) & (BUTTON_EDGE_QUEUE_SIZE - 1);
+
+  return true;
+}
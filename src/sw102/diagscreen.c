@@ -0,0 +1,98 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "main.h"
+#include "screen.h"
+#include "fonts.h"
+#include "lcd.h"
+#include "uart.h"
+#include "eeprom_hw.h"
+#include "tasks.h"
+#include "diagscreen.h"
+
+//
+// Diagnostics screen, shows how busy we are.  Values are filled in when the screen is shown and then
+// refreshed once a second through fieldPrintf(), so only the lines that changed get redrawn.
+//
+static Field cpuField = FIELD_DRAWTEXT_BUF();
+static Field missedField = FIELD_DRAWTEXT_BUF();
+static Field frameField = FIELD_DRAWTEXT_BUF();
+static Field spiField = FIELD_DRAWTEXT_BUF();
+static Field rxOkField = FIELD_DRAWTEXT_BUF();
+static Field rxBadField = FIELD_DRAWTEXT_BUF();
+static Field stackField = FIELD_DRAWTEXT_BUF();
+static Field flashField = FIELD_DRAWTEXT_BUF();
+
+#define DIAG_LINE(f) \
+    { \
+        .x = 0, .y = -1, \
+        .width = 0, .height = -1, \
+        .field = &f, \
+        .font = &FONT_5X12, \
+    }
+
+const Screen diagScreen = {
+    .fields = {
+    {
+        .x = 0, .y = 0,
+        .width = 0, .height = -1,
+        .field = &cpuField,
+        .font = &FONT_5X12,
+    },
+    DIAG_LINE(missedField),
+    DIAG_LINE(frameField),
+    DIAG_LINE(spiField),
+    DIAG_LINE(rxOkField),
+    DIAG_LINE(rxBadField),
+    DIAG_LINE(stackField),
+    DIAG_LINE(flashField),
+    {
+        .field = NULL
+    } }
+};
+
+static uint32_t spiRate; // LCD SPI bytes/s over the last second
+static bool newSample; // diagscreen_sample() ran since the fields were last filled
+
+void diagscreen_sample()
+{
+  static uint32_t lastSpiBytes, lastMsecs;
+
+  uint32_t spiBytes = lcd_get_spi_bytes(), msecs = get_msecs();
+  uint32_t elapsed = msecs - lastMsecs;
+  spiRate = elapsed ? (spiBytes - lastSpiBytes) * 1000 / elapsed : 0;
+  lastSpiBytes = spiBytes;
+  lastMsecs = msecs;
+
+  newSample = true;
+}
+
+void diagscreen_update()
+{
+  static bool wasShown;
+
+  bool shown = fieldIsRendered(&cpuField);
+  bool appeared = shown && !wasShown;
+  wasShown = shown;
+
+  // Fill the fields as soon as we are shown, after that once per sample
+  if(!appeared && !(shown && newSample))
+    return;
+  newSample = false;
+
+  // The worst screen_clock() run is our worst frame (RTC ticks to msecs)
+  const task_t *screenTask = tasks_find("screen");
+  uint32_t frameMsecs = screenTask ? screenTask->max_ticks * 1000 / 32768 : 0;
+
+  fieldPrintf(&cpuField, "CPU %u%%", (unsigned) get_cpu_busy_percent());
+  fieldPrintf(&missedField, "Miss %u", (unsigned) tasks_total_missed());
+  fieldPrintf(&frameField, "Frame %ums", (unsigned) frameMsecs);
+  fieldPrintf(&spiField, "SPI %u/s", (unsigned) spiRate);
+  fieldPrintf(&rxOkField, "Rx %u", (unsigned) uart_get_rx_frames_ok());
+  fieldPrintf(&rxBadField, "RxBad %u", (unsigned) uart_get_rx_frames_bad());
+  fieldPrintf(&stackField, "Stack %u", (unsigned) stack_overflow_debug());
+  fieldPrintf(&flashField, "Flash %u", (unsigned) flash_get_write_count());
+}
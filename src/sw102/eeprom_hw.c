@@ -14,12 +14,15 @@
 #include "nrf_delay.h"
 #include "nrf_soc.h"
 #include "assert.h"
+#include "profile.h"
+#include "watchdog.h"
 
 // volatile fs_ret_t last_fs_ret;
 
 /* Event handler */
 
 volatile static bool gc_done, init_done, write_done;
+static uint32_t write_count; // flash writes since boot (for the diagnostics screen)
 
 /* Register fs_sys_event_handler with softdevice_sys_evt_handler_set in ble_stack_init or this doesn't fire! */
 static void fds_evt_handler(fds_evt_t const *const evt)
@@ -48,8 +51,8 @@ static void fds_evt_handler(fds_evt_t const *const evt)
 #define FILE_ID     0x1001
 #define REC_KEY     0x2002
 
-// returns true if our preferences were found
-bool flash_read_words(void *dest, uint16_t length_words)
+// returns true if the record was found, a shorter record (from older firmware) leaves the rest of dest alone
+bool flash_read_record(uint16_t file_id, uint16_t key, void *dest, uint16_t length_words)
 {
   fds_flash_record_t flash_record;
   fds_record_desc_t record_desc;
@@ -60,7 +63,7 @@ bool flash_read_words(void *dest, uint16_t length_words)
   memset(&record_desc, 0x00, sizeof(record_desc));
   memset(&ftok, 0x00, sizeof(ftok));
   // Loop until all records with the given key and file ID have been found.
-  while (fds_record_find(FILE_ID, REC_KEY, &record_desc, &ftok) == FDS_SUCCESS)
+  while (fds_record_find(file_id, key, &record_desc, &ftok) == FDS_SUCCESS)
   {
     if(!did_read) {
       // Found our first match (there should be only one unless someone else screwed up)
@@ -68,6 +71,8 @@ bool flash_read_words(void *dest, uint16_t length_words)
       APP_ERROR_CHECK(fds_record_open(&record_desc, &flash_record));
 
       // Access the record through the flash_record structure.
+      if (flash_record.p_header->tl.length_words < length_words)
+        length_words = flash_record.p_header->tl.length_words;
       memcpy(dest, flash_record.p_data, length_words * sizeof(uint32_t));
       did_read = true;
 
@@ -83,33 +88,54 @@ bool flash_read_words(void *dest, uint16_t length_words)
   return did_read;
 }
 
-static bool wait_gc()
+// Wait up to a second for an fds operation, the main loop is blocked meanwhile so we keep feeding the watchdog
+static void wait_done(volatile bool *done)
 {
-  gc_done = false;
-  fds_gc();
-  for (volatile int count = 0; count < 1000 && !gc_done; count++) {
+  for (volatile int count = 0; count < 1000 && !*done; count++) {
     sd_app_evt_wait();
     nrf_delay_ms(1);
+    watchdog_service();
   }
+}
+
+static bool wait_gc()
+{
+  gc_done = false;
+  fds_gc();
+  wait_done(&gc_done);
   // Note: this can fail if the soft device is not enabled (normally performed in ble init)
   // assert(gc_done);
   return gc_done;
 }
 
 
-bool flash_write_words(const void *value, uint16_t length_words)
+uint32_t flash_get_write_count(void)
+{
+  return write_count;
+}
+
+// returns true if our preferences were found
+bool flash_read_words(void *dest, uint16_t length_words)
+{
+  return flash_read_record(FILE_ID, REC_KEY, dest, length_words);
+}
+
+bool flash_write_record(uint16_t file_id, uint16_t key, const void *value, uint16_t length_words)
 {
   fds_record_t record;
   fds_record_desc_t record_desc;
   fds_record_chunk_t record_chunk;
   fds_find_token_t ftok;
 
+  PROF_BEGIN(PROF_FLASH_WRITE);
+  watchdog_busy(WATCHDOG_FLASH, true);
+
   wait_gc(); // Before writing we always GC (to ensure there is at least one free record we can use)
 
   // Do we already have one of these records?
   memset(&record_desc, 0x00, sizeof(record_desc));
   memset(&ftok, 0x00, sizeof(ftok));
-  bool has_old = fds_record_find(FILE_ID, REC_KEY, &record_desc, &ftok)
+  bool has_old = fds_record_find(file_id, key, &record_desc, &ftok)
       == FDS_SUCCESS;
 
 // Set up data.
@@ -117,12 +143,13 @@ bool flash_write_words(const void *value, uint16_t length_words)
   record_chunk.length_words = length_words;
 
 // Set up record.
-  record.file_id = FILE_ID;
-  record.key = REC_KEY;
+  record.file_id = file_id;
+  record.key = key;
   record.data.p_chunks = &record_chunk;
   record.data.num_chunks = 1;
 
   write_done = false;
+  write_count++;
 
   // either make a new record or update an old one (if we lose power during update the old record is preserved)
   if (has_old)
@@ -130,14 +157,24 @@ bool flash_write_words(const void *value, uint16_t length_words)
   else
     APP_ERROR_CHECK(fds_record_write(&record_desc, &record));
 
-  for (volatile int count = 0; count < 1000 && !write_done; count++) {
-    sd_app_evt_wait();
-    nrf_delay_ms(1);
-  }
+  wait_done(&write_done);
 
+  watchdog_busy(WATCHDOG_FLASH, false);
+  PROF_END(PROF_FLASH_WRITE);
   return write_done;
 }
 
+bool flash_write_words(const void *value, uint16_t length_words)
+{
+  return flash_write_record(FILE_ID, REC_KEY, value, length_words);
+}
+
+// Delete all the records of a file, the space is reclaimed by the GC before the next write
+void flash_delete_file(uint16_t file_id)
+{
+  APP_ERROR_CHECK(fds_file_delete(file_id));
+}
+
 
 /**
  * @brief Init eeprom emulation system
@@ -147,10 +184,7 @@ void eeprom_hw_init(void)
   APP_ERROR_CHECK(fds_register(fds_evt_handler));
 
   APP_ERROR_CHECK(fds_init());
-  for (volatile int count = 0; count < 1000 && !init_done; count++) {
-    sd_app_evt_wait();
-    nrf_delay_ms(1);
-  }
+  wait_done(&init_done);
   // Note: this can fail if the soft device is not enabled (normally performed in ble init)
   // assert(init_done);
 
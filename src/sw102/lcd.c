@@ -13,11 +13,14 @@
  * Therefore we use standard blocking SPI transfer right away and save some complexity and flash space.
  */
 
+#include <string.h>
 #include "lcd.h"
 #include "common.h"
 #include "nrf_delay.h"
 #include "nrf_drv_spi.h"
 #include "ugui.h"
+#include "mirror.h"
+#include "profile.h"
 
 
 /* Function prototype */
@@ -36,14 +39,20 @@ extern UG_GUI gui;
 /* Frame buffer in RAM with same structure as LCD memory --> 16 pages a 64 columns (1 kB) */
 uint8_t frameBuffer[16][64];
 
+/* One bit per page touched since the last lcd_refresh(), start with everything dirty */
+static uint16_t dirtyPages = 0xffff;
+
+/* Bytes sent to the LCD since boot (for the diagnostics screen) */
+static uint32_t spiBytes;
+
 /* Init sequence sampled by casainho from original SW102 display */
 static const uint8_t init_array[] = {
     0xAE, // 11. display on
     0xA8, 0x3F, // set multiplex ratio 3f
     0xD5, 0x50, // set display divite/oscillator ratios
     0xC0, // set common scan dir
-    0xD3, 0x60, // ???
-    0xDC, 0x00,  // set display start line
+    0xD3, 0x60, // set display offset
+    0xDC, 0x00,  // set display start line (the RAM column shown on COM0, so it would pan along x, not along y)
     0x20, // set memory address mode
     0x81, 0xFF, // Set contrast level (POR value is 0x80, but closed source software uses 0xBF
     0xA0, // set segment remap
@@ -78,6 +87,7 @@ static void send_cmd(const uint8_t *cmds, size_t numcmds)
 {
   set_cmd();
   APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, cmds, numcmds, NULL, 0));
+  spiBytes += numcmds;
 }
 
 /// Heavily borrowed from https://github.com/adafruit/Adafruit_SSD1306/blob/master/Adafruit_SSD1306.cpp, because this display controller is basically the same
@@ -94,6 +104,7 @@ void drawFastHLineInternal(int16_t x, int16_t y, int16_t w, UG_COLOR color) {
       w = (SCREEN_WIDTH - x);
     }
     if(w > 0) { // Proceed only if width is positive
+      dirtyPages |= 1 << (y / 8);
       uint8_t *pBuf = &frameBuffer[(y / 8)][x],
                mask = 1 << (y & 7);
       if(color)
@@ -108,6 +119,34 @@ void drawFastHLineInternal(int16_t x, int16_t y, int16_t w, UG_COLOR color) {
 }
 
 
+void lcd_scroll_left(int16_t x, int16_t y, int16_t w, int16_t h)
+{
+  for(int16_t page = y / 8; page <= (y + h - 1) / 8; page++) {
+    // only the rows of this page that are inside the area
+    int16_t top = y > page * 8 ? y - page * 8 : 0;
+    int16_t bottom = y + h - 1 < page * 8 + 7 ? y + h - 1 - page * 8 : 7;
+    uint8_t mask = (uint8_t) (0xff << top) & (uint8_t) (0xff >> (7 - bottom));
+    uint8_t *pBuf = &frameBuffer[page][x];
+
+    for(int16_t i = 0; i < w - 1; i++)
+      pBuf[i] = (pBuf[i] & ~mask) | (pBuf[i + 1] & mask);
+
+    dirtyPages |= 1 << page;
+  }
+}
+
+/*
+ * Menus are scrolled by moving pages in the frameBuffer, they still have to be sent again.  The SH1107 display start
+ * line can't do it: with the 64 multiplex ratio we use, the 64 COM lines are RAM columns, so the start line (and the
+ * 64 RAM columns that aren't shown) only pan the 64 pixel wide x axis.  Menu rows are pages along the 128 pixel y axis.
+ */
+void lcd_move_pages(uint8_t dest, uint8_t src, uint8_t count)
+{
+  memmove(frameBuffer[dest], frameBuffer[src], count * sizeof(frameBuffer[0]));
+  dirtyPages |= ((1 << count) - 1) << dest;
+}
+
+
 #define ssd1306_swap(a, b) \
   (((a) ^= (b)), ((b) ^= (a)), ((a) ^= (b))) ///< No-temp-var swap operation
 
@@ -167,6 +206,7 @@ static void pset(UG_S16 x, UG_S16 y, UG_COLOR col)
   uint8_t page = y / 8;
   uint8_t pixel = y % 8;
 
+  dirtyPages |= 1 << page;
   if (col > 0)
     SET_BIT(frameBuffer[page][x], pixel);
   else
@@ -210,24 +250,39 @@ void lcd_init(void)
 
 
 /**
- * @brief Start transfer of frameBuffer to LCD
+ * @brief Start transfer of the pages of the frameBuffer that were drawn to since the last refresh
  */
 void lcd_refresh(void)
 {
-  uint8_t addr = 0xB0;
-
   static uint8_t pagecmd[] = { 0, 0x00, 0x10 };
 
+  PROF_BEGIN(PROF_LCD_REFRESH);
+
   for (uint8_t i = 0; i < 16; i++)
   {
+    if (!(dirtyPages & (1 << i)))
+      continue; // the display still has this page
+
     // New page address
-    pagecmd[0] = addr++;
+    pagecmd[0] = 0xB0 + i;
     send_cmd(pagecmd, sizeof(pagecmd));
 
     // send page data
     set_data();
     APP_ERROR_CHECK(nrf_drv_spi_transfer(&spi, &frameBuffer[i][0], 64, NULL, 0));
+    spiBytes += 64;
   }
+
+  // Let a BLE screen mirror know which pages it needs to send
+  mirror_pages_changed(dirtyPages);
+  dirtyPages = 0;
+
+  PROF_END(PROF_LCD_REFRESH);
+}
+
+uint32_t lcd_get_spi_bytes(void)
+{
+  return spiBytes;
 }
 
 /**
@@ -5,6 +5,7 @@
  */
 #include <ble_services.h>
 #include <eeprom_hw.h>
+#include <assert.h>
 #include "app_timer.h"
 #include "main.h"
 #include "button.h"
@@ -23,6 +24,14 @@
 #include "hardfault.h"
 #include "fault.h"
 #include "nrf_nvic.h"
+#include "app_util_platform.h"
+#include "mirror.h"
+#include "tasks.h"
+#include "profile.h"
+#include "diagscreen.h"
+#include "stackmon.h"
+#include "watchdog.h"
+#include "crashlog.h"
 
 #define MIN_VOLTAGE_10X 140 // If our measured bat voltage (using ADC in the display) is lower than this, we assume we are running on a developers desk
 
@@ -51,14 +60,33 @@ APP_TIMER_DEF(gui_timer_id); /* GUI updates counting timer. */
 #define GUI_INTERVAL APP_TIMER_TICKS(MSEC_PER_TICK, APP_TIMER_PRESCALER)
 volatile uint32_t gui_ticks;
 
+// While nothing is changing we only wake for layer_2(), which must keep running every 100ms
+#define IDLE_TICKS (100 / MSEC_PER_TICK)
+static volatile uint8_t ticks_per_timeout = 1;
+static volatile bool idle_allowed;
+
+// RTC count of the gui tick boundary that fired last.  The single shot timer is always started for a boundary
+// counted from here rather than from "now", so changing speed never stretches a tick or lets gui_ticks fall behind.
+static uint32_t tick_cnt;
+
+// Rough nRF51822 currents from the datasheet, used to estimate our average current from how long we are awake
+#define RUN_CURRENT_UA 4400 // CPU running from flash at 16MHz
+#define SLEEP_CURRENT_UA 3 // System ON idle with the RTC running
+
+static uint32_t wakeups, busy_ticks; // since the last power_stats() run
+static uint16_t wakeups_per_sec;
+static uint32_t avg_current_ua;
+static uint8_t busy_percent;
+
 
 Field bootHeading = FIELD_DRAWTEXT(.msg = "OpenSource EBike");
 Field bootVersion = FIELD_DRAWTEXT(.msg = VERSION_STRING);
-Field bootStatus = FIELD_DRAWTEXT(.msg = "Booting...");
+Field bootStatus = FIELD_DRAWTEXT_BUF("Booting...");
+Field bootReset = FIELD_DRAWTEXT_BUF();
 
 
 
-Screen bootScreen = {
+const Screen bootScreen = {
     .fields = {
     {
         .x = 0, .y = 0,
@@ -75,6 +103,11 @@ Screen bootScreen = {
         .field = &bootStatus,
         .font = &FONT_5X12,
     },
+    {
+        .x = 0, .y = 100,
+        .field = &bootReset,
+        .font = &FONT_5X12,
+    },
     {
         .field = NULL
     }
@@ -108,7 +141,7 @@ void lcd_power_off(uint8_t updateDistanceOdo)
 
   // block here till we die
   while (1)
-    ;
+    watchdog_feed();
 }
 
 static void automatic_power_off_management(void)
@@ -131,7 +164,7 @@ static void automatic_power_off_management(void)
       ui16_lcd_power_off_time_counter++;
 
       // check if we should power off the LCD
-      if(ui16_lcd_power_off_time_counter >= (l3_vars.ui8_lcd_power_off_time_minutes * 10 * 60)) // have we passed our timeout?
+      if(ui16_lcd_power_off_time_counter >= (l3_vars.ui8_lcd_power_off_time_minutes * 10 * 60)) // have we passed our timeout? (we are called every 100ms)
       {
         lcd_power_off(1);
       }
@@ -145,22 +178,39 @@ static void automatic_power_off_management(void)
 
 
 // Screens in a loop, shown when the user short presses the power button
-static Screen *screens[] = {
+static const Screen *screens[] = {
     &mainScreen,
     &infoScreen,
+    &tripScreen,
+    &graphScreen,
+    &diagScreen, // only if enabled in the config
     &configScreen,
     NULL
 };
 
 static int nextScreen = 0;
 
+// A screen that doesn't fit the resolved layout cache asserts when it is shown, find out at boot instead
+static void check_screens(void)
+{
+  for (const Screen **s = screens; *s; s++)
+    assert(screenLayoutCount(*s) <= MAX_RESOLVED_LAYOUTS);
+
+  assert(screenLayoutCount(&bootScreen) <= MAX_RESOLVED_LAYOUTS);
+  assert(screenLayoutCount(&faultScreen) <= MAX_RESOLVED_LAYOUTS); // asserting in the fault handler would be no use
+}
+
 void showNextScreen() {
-  Screen *next = screens[nextScreen++];
+  const Screen *next;
 
-  if(!next) {
-    nextScreen = 0;
+  do {
     next = screens[nextScreen++];
-  }
+
+    if(!next) {
+      nextScreen = 0;
+      next = screens[nextScreen++];
+    }
+  } while(next == &diagScreen && !l3_vars.ui8_diagnostics_screen);
 
   screenShow(next);
 }
@@ -186,24 +236,17 @@ static bool appwide_onpress(buttons_events_t events)
 extern uint32_t __StackTop;
 extern uint32_t __StackLimit;
 
-// Returns # of unused bytes in stack
-uint32_t stack_overflow_debug(void)
-{
-    // uint32_t stack_usage = 0;
-    uint32_t offset = 0;
-    volatile uint32_t * value_addr = (uint32_t *) &__StackLimit;
+static stackmon_t stackmon;
 
-    for (; offset <  ((uint32_t)&__StackTop - (uint32_t)&__StackLimit); offset=offset+4)
-    {
-        uint32_t new_val = *(value_addr + offset);
-        if (new_val != 0xDEADBEEF )
-        {
-            break;
-        }
-    }
-    // stack_usage = ((uint32_t)&__StackTop - (uint32_t)&__StackLimit) - offset;
+static void stack_monitor_init(void)
+{
+  stackmon_init(&stackmon, &__StackLimit, ((uint32_t) &__StackTop - (uint32_t) &__StackLimit) / sizeof(uint32_t));
+}
 
-    return offset;
+// Returns # of unused bytes in stack (the lowest it has been since boot)
+uint32_t stack_overflow_debug(void)
+{
+  return stackmon_unused_bytes(&stackmon);
 }
 
 
@@ -228,11 +271,160 @@ static void handle_buttons() {
   buttons_clock(); // Note: this is done _after_ button events is checked to provide a 20ms debounce
 }
 
+// Render only counts as alive once a whole screen update has finished
+static void screen_task(void)
+{
+  screen_clock();
+  watchdog_checkin(WATCHDOG_RENDER);
+}
+
+static void check_stack(void)
+{
+  stackmon_check(&stackmon);
+
+  if(!stackmon_canary_ok(&stackmon) || stack_overflow_debug() < 128) // we ran out of stack, or are close to it
+    APP_ERROR_HANDLER(FAULT_STACKOVERFLOW);
+}
+
+static uint32_t boot_start_time;
+
+static void boot_screen_idle(void)
+{
+  if(getCurrentScreen() != &bootScreen) // FIXME move this into an onIdle callback on the screen
+    return;
+
+  uint16_t bvolt = battery_voltage_10x_get();
+
+  is_sim_motor = (bvolt < MIN_VOLTAGE_10X);
+
+  if(is_sim_motor)
+    fieldPrintf(&bootStatus, "SIMULATING motor!");
+  else if(has_seen_motor)
+    fieldPrintf(&bootStatus, "Found motor");
+  else
+    fieldPrintf(&bootStatus, "No motor? (%u.%uV)", bvolt / 10, bvolt % 10);
+
+  // Stop showing the boot screen after a few seconds (once we've found a motor)
+  if(get_seconds() - boot_start_time >= 5 && (has_seen_motor || is_sim_motor))
+    showNextScreen();
+}
+
+// Once a second turn the wakeup count and the time we were awake into rates
+static void power_stats(void)
+{
+  static uint32_t last_cnt;
+  uint32_t cnt = app_timer_cnt_get();
+  uint32_t elapsed;
+  app_timer_cnt_diff_compute(cnt, last_cnt, &elapsed);
+  last_cnt = cnt;
+
+  if(!elapsed)
+    return;
+
+  if(busy_ticks > elapsed)
+    busy_ticks = elapsed;
+
+  wakeups_per_sec = wakeups * 32768 / elapsed;
+  busy_percent = busy_ticks * 100 / elapsed;
+  avg_current_ua = SLEEP_CURRENT_UA + (RUN_CURRENT_UA - SLEEP_CURRENT_UA) * busy_ticks / elapsed;
+  wakeups = busy_ticks = 0;
+}
+
+uint16_t get_wakeups_per_sec()
+{
+  return wakeups_per_sec;
+}
+
+uint32_t get_avg_current_ua()
+{
+  return avg_current_ua;
+}
+
+uint8_t get_cpu_busy_percent()
+{
+  return busy_percent;
+}
+
+#define TASK_BUDGET(ms) APP_TIMER_TICKS(ms, APP_TIMER_PRESCALER)
+
+// Everything the main loop does.  The 100ms tasks have different phases so they don't all land on the same tick.
+static task_t main_tasks[] = {
+    // receive data from layer 2 to layer 3, send data from layer 3 to layer 2
+    TASK("layer3", copy_layer_2_layer_3_vars, 100, 0, 0, TASK_BUDGET(2)),
+    TASK("diagfill", diagscreen_update, MSEC_PER_TICK, 0, 1, TASK_BUDGET(5)), // before screen, so new values are drawn this tick
+    TASK("screen", screen_task, MSEC_PER_TICK, 0, 1, TASK_BUDGET(MSEC_PER_TICK)),
+    TASK("mirror", mirror_service, MSEC_PER_TICK, 0, 2, TASK_BUDGET(5)), // push changed display pages to a BLE mirror client (if any)
+    TASK("buttons", handle_buttons, MSEC_PER_TICK, 0, 3, TASK_BUDGET(MSEC_PER_TICK)),
+    // Note: this was moved from layer_2() because it does eeprom operations which should not be used from ISR
+    TASK("poweroff", automatic_power_off_management, 100, 20, 4, TASK_BUDGET(5)),
+    TASK("boot", boot_screen_idle, 100, 40, 5, TASK_BUDGET(5)),
+    TASK("stack", check_stack, MSEC_PER_TICK, 0, 6, TASK_BUDGET(1)), // cheap, so every tick
+    TASK("power", power_stats, 1000, 80, 7, TASK_BUDGET(1)),
+    TASK("diag", diagscreen_sample, 1000, 80, 8, TASK_BUDGET(1)), // after power_stats, so it shows this second's numbers
+    TASK("watchdog", watchdog_service, WATCHDOG_SERVICE_MSEC, 60, 9, TASK_BUDGET(1)),
+    TASK("crashlog", crashlog_dump_service, MSEC_PER_TICK, 0, 10, TASK_BUDGET(5)), // send saved crashes to a BLE client (if asked)
+    TASK("graphs", graphs_sample, 100, 0, 12, TASK_BUDGET(1)), // after layer3, so it samples the fresh values
+#ifdef PROFILE
+    TASK("profile", profile_dump_service, MSEC_PER_TICK, 0, 11, TASK_BUDGET(5)),
+#endif
+};
+
+// The scheduler runs on the gui tick rather than get_msecs(), so a task is due exactly when its tick fires
+static uint32_t tick_msecs(void)
+{
+  return gui_ticks * MSEC_PER_TICK;
+}
+
+static uint32_t rtc_ticks(void)
+{
+  return app_timer_cnt_get();
+}
+
+// Start the gui timer for the next boundary, the timer must be stopped (or just expired)
+static void gui_timer_start(void)
+{
+  uint32_t until;
+  app_timer_cnt_diff_compute(tick_cnt + GUI_INTERVAL * ticks_per_timeout, app_timer_cnt_get(), &until);
+  if(until < APP_TIMER_MIN_TIMEOUT_TICKS || until > GUI_INTERVAL * IDLE_TICKS)
+    until = APP_TIMER_MIN_TIMEOUT_TICKS; // due right now or already late, tick_cnt keeps the next one on time
+
+  APP_ERROR_CHECK(app_timer_start(gui_timer_id, until, NULL));
+}
+
+// Leave the slow tick: count the 20ms ticks that passed since the last boundary and wake on the next one
+static void gui_timer_speed_up(void)
+{
+  uint32_t since;
+  app_timer_cnt_diff_compute(app_timer_cnt_get(), tick_cnt, &since);
+  uint32_t passed = since / GUI_INTERVAL;
+  if(passed >= IDLE_TICKS)
+    passed = IDLE_TICKS - 1; // the 100ms boundary is due, leave it (and layer_2()) to the timer
+
+  APP_ERROR_CHECK(app_timer_stop(gui_timer_id));
+  tick_cnt += GUI_INTERVAL * passed;
+  gui_ticks += passed;
+  ticks_per_timeout = 1;
+  gui_timer_start();
+}
+
+// Can we slow the gui tick down?  Only if the bike is parked and nothing on screen or under a finger is changing.
+static bool can_idle(void)
+{
+  return getCurrentScreen() != &bootScreen &&
+      l3_vars.ui16_wheel_speed_x10 == 0 &&
+      l3_vars.ui8_battery_current_x5 == 0 &&
+      !mirror_is_active() &&
+      buttons_is_idle() &&
+      !screenIsAnimating();
+}
+
 /**
  * @brief Application main entry.
  */
 int main(void)
 {
+  stack_monitor_init(); // first, before we have used much stack
+  watchdog_read_reset_reason(); // before ble_init, the SoftDevice owns the POWER registers after that
   gpio_init();
   lcd_init();
   uart_init();
@@ -243,8 +435,13 @@ int main(void)
   // kevinh FIXME - turn off ble for now because somtimes it calls app_error_fault_handler(1...) from nrf51822_sw102_ble_advdata
   ble_init();
 
+#ifdef PROFILE
+  profile_init(); // after ble_init, it needs the SoftDevice for its IRQ
+#endif
+
   /* eeprom_init AFTER ble_init! */
   eeprom_init();
+  crashlog_save(); // if we crashed before the last reset, now that we can write flash
   // FIXME
   // eeprom_read_configuration(get_configuration_variables());
   system_power(true);
@@ -261,61 +458,47 @@ int main(void)
    */
 
 
+  fieldPrintf(&bootReset, "%s", watchdog_reset_reason());
+  check_screens();
   screenShow(&bootScreen);
+  screenUpdate(); // the screen_clock task isn't running yet
 
   // After we show the bootscreen...
   // If a button is currently pressed (likely unless developing), wait for the release (so future click events are not confused
-  while(buttons_get_onoff_state() || buttons_get_m_state() || buttons_get_up_state() || buttons_get_down_state())
+  while(PollButton(&buttonPWR) || PollButton(&buttonM) || PollButton(&buttonUP) || PollButton(&buttonDWN))
     ;
 
+  buttons_init(); // debouncer starts from the released state and takes its edges from GPIOTE from now on
+
   // Enter main loop.
+  boot_start_time = get_seconds();
+  tasks_init(main_tasks, sizeof(main_tasks) / sizeof(main_tasks[0]), tick_msecs, rtc_ticks, 0xffffff);
+  watchdog_init();
 
-  uint32_t lasttick = gui_ticks;
-  uint32_t start_time = get_seconds();
-  uint32_t tickshandled = 0; // we might miss ticks if running behind, so we use our own local count to figure out if we need to run our 100ms services
-  uint32_t ticksmissed = 0;
   while (1)
   {
-    uint32_t tick = gui_ticks;
-    if (tick != lasttick)
-    {
-      if(tick != lasttick + 1) {
-        ticksmissed += (tick - lasttick - 1); // Error!  We fell behind and missed some ticks (probably due to screen draw taking more than 20 msec)
-
-        // if(is_sim_motor) app_error_fault_handler(FAULT_MISSEDTICK, 0, ticksmissed);
-      }
-
-      lasttick = tick;
-
-      if(tickshandled++ % (100 / MSEC_PER_TICK) == 0) { // every 100ms
+    uint32_t awake = app_timer_cnt_get();
 
-        if(stack_overflow_debug() < 128) // we are close to running out of stack
-          APP_ERROR_HANDLER(FAULT_STACKOVERFLOW);
-      }
-
-      screen_clock();
-
-      handle_buttons();
-      automatic_power_off_management(); // Note: this was moved from layer_2() because it does eeprom operations which should not be used from ISR
+    if(ticks_per_timeout != 1)
+      tasks_resync(); // the 20ms tasks run once per slow tick, that is not them running late
 
-      if(getCurrentScreen() == &bootScreen) { // FIXME move this into an onIdle callback on the screen
-        uint16_t bvolt = battery_voltage_10x_get();
+    tasks_run();
+    watchdog_checkin(WATCHDOG_MAIN);
 
-        is_sim_motor = (bvolt < MIN_VOLTAGE_10X);
-
-        if(is_sim_motor)
-          fieldPrintf(&bootStatus, "SIMULATING motor!");
-        else if(has_seen_motor)
-          fieldPrintf(&bootStatus, "Found motor");
-        else
-          fieldPrintf(&bootStatus, "No motor? (%u.%uV)", bvolt / 10, bvolt % 10);
-
-        // Stop showing the boot screen after a few seconds (once we've found a motor)
-        if(get_seconds() - start_time >= 5 && (has_seen_motor || is_sim_motor))
-          showNextScreen();
-      }
+    // The timer ISR only slows the tick down on a layer_2() tick, but any wakeup (GPIOTE, UART, BLE) that makes
+    // us busy again brings it back to full speed right away
+    idle_allowed = can_idle();
+    if(!idle_allowed && ticks_per_timeout != 1) {
+      CRITICAL_REGION_ENTER();
+      gui_timer_speed_up();
+      CRITICAL_REGION_EXIT();
     }
 
+    wakeups++;
+    uint32_t busy;
+    app_timer_cnt_diff_compute(app_timer_cnt_get(), awake, &busy);
+    busy_ticks += busy; // note: ISR time is not counted
+
     sd_app_evt_wait(); // let OS threads have time to run
   }
 
@@ -367,29 +550,52 @@ static void button_poll_timer_timeout(void *p_context)
 #endif
 
 
-static uint32_t seconds = 0;
-
 static void gui_timer_timeout(void *p_context)
 {
   UNUSED_PARAMETER(p_context);
 
-  gui_ticks++;
+  tick_cnt += GUI_INTERVAL * ticks_per_timeout;
+  gui_ticks += ticks_per_timeout;
+  get_msecs(); // keep our msec clock from missing an RTC wrap
 
-  if(gui_ticks % (100 / MSEC_PER_TICK) == 0) // every 100ms
+  if(gui_ticks % IDLE_TICKS == 0) { // every 100ms
     layer_2();
+    watchdog_checkin(WATCHDOG_MOTOR);
 
-  if(gui_ticks % (1000 / MSEC_PER_TICK) == 0)
-    seconds++;
+    if(idle_allowed && ticks_per_timeout == 1)
+      ticks_per_timeout = IDLE_TICKS;
+  }
+
+  gui_timer_start();
 }
 
 
 /// msecs since boot (note: will roll over every 50 days)
+/// Derived from the RTC rather than gui_ticks so timestamps (i.e. button edges) are not quantized to a tick.
+/// The RTC counter is only 24 bits, but we are called at least every tick, long before it can wrap.
 uint32_t get_msecs() {
-  return gui_ticks * MSEC_PER_TICK;
+  static uint32_t lastcnt, msecs, fraction;
+  uint32_t now;
+
+  CRITICAL_REGION_ENTER();
+  uint32_t cnt = app_timer_cnt_get();
+  uint32_t diff;
+  app_timer_cnt_diff_compute(cnt, lastcnt, &diff);
+  lastcnt = cnt;
+
+  // 32768 Hz ticks to msecs, carrying the remainder so we never drift
+  msecs += (diff >> 15) * 1000;
+  fraction += (diff & 0x7fff) * 1000;
+  msecs += fraction >> 15;
+  fraction &= 0x7fff;
+  now = msecs;
+  CRITICAL_REGION_EXIT();
+
+  return now;
 }
 
 uint32_t get_seconds() {
-  return seconds;
+  return get_msecs() / 1000;
 }
 
 static void init_app_timers(void)
@@ -414,9 +620,10 @@ static void init_app_timers(void)
 
   // Create&Start timers.
   APP_ERROR_CHECK(
-      app_timer_create(&gui_timer_id, APP_TIMER_MODE_REPEATED,
+      app_timer_create(&gui_timer_id, APP_TIMER_MODE_SINGLE_SHOT,
           gui_timer_timeout));
-  APP_ERROR_CHECK(app_timer_start(gui_timer_id, GUI_INTERVAL, NULL));
+  tick_cnt = app_timer_cnt_get();
+  gui_timer_start();
 }
 
 
@@ -0,0 +1,275 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "profile.h"
+
+#ifdef PROFILE
+
+#include <string.h>
+#include "nrf.h"
+#include "nrf_nvic.h"
+#include "app_util_platform.h"
+#include "app_error.h"
+
+typedef struct {
+  uint32_t count, min, max, total;
+} profile_stat_t;
+
+static const char * const names[PROF_COUNT] = {
+  [PROF_LAYER_2] = "layer_2",
+  [PROF_PROCESS_RX] = "process_rx",
+  [PROF_COPY_LAYER3] = "copy_layer_2_layer_3_vars",
+  [PROF_SCREEN_UPDATE] = "screenUpdate",
+  [PROF_MAIN_SCREEN_FIELDS] = "lcd_main_screen",
+  [PROF_RENDER_LAYOUTS] = "renderLayouts",
+  [PROF_RENDER_DRAWTEXT] = "renderDrawText",
+  [PROF_RENDER_FILL] = "renderFill",
+  [PROF_RENDER_MESH] = "renderMesh",
+  [PROF_RENDER_SCROLLABLE] = "renderScrollable",
+  [PROF_RENDER_EDITABLE] = "renderEditable",
+  [PROF_RENDER_GRAPH] = "renderGraph",
+  [PROF_RENDER_END] = "renderEnd",
+  [PROF_LCD_REFRESH] = "lcd_refresh",
+  [PROF_FLASH_WRITE] = "flash_write_words",
+  [PROF_BLE_EVT] = "ble_evt_dispatch",
+  [PROF_SYS_EVT] = "sys_evt_dispatch",
+  [PROF_NUS_DATA] = "nus_data_handler",
+};
+
+static uint32_t ring[PROFILE_RING_SIZE];
+static uint16_t ringHead;
+static bool ringFull;
+
+static profile_stat_t stats[PROF_COUNT];
+static uint32_t startTime[PROF_COUNT];
+static uint8_t depth[PROF_COUNT];
+
+static volatile uint16_t timerHigh; // TIMER1 is only 16 bits, we count its wraps here
+
+typedef enum {
+  DUMP_IDLE = 0,
+  DUMP_HEADER,
+  DUMP_NAMES,
+  DUMP_STATS,
+  DUMP_RING,
+  DUMP_END
+} dump_state_t;
+
+static profile_send_fn sender;
+static volatile bool dumpRequested, stopRequested;
+static volatile bool frozen; // ring is not written while we dump it
+static dump_state_t dumpState;
+static uint16_t dumpIndex;
+
+void TIMER1_IRQHandler(void)
+{
+  if (NRF_TIMER1->EVENTS_COMPARE[0]) {
+    NRF_TIMER1->EVENTS_COMPARE[0] = 0;
+    timerHigh++;
+  }
+}
+
+void profile_init(void)
+{
+  NRF_TIMER1->TASKS_STOP = 1;
+  NRF_TIMER1->MODE = TIMER_MODE_MODE_Timer;
+  NRF_TIMER1->BITMODE = TIMER_BITMODE_BITMODE_16Bit;
+  NRF_TIMER1->PRESCALER = 4; // 16MHz / 2^4 = 1MHz
+  NRF_TIMER1->CC[0] = 0; // fires each time the counter wraps
+  NRF_TIMER1->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+
+  APP_ERROR_CHECK(sd_nvic_SetPriority(TIMER1_IRQn, APP_IRQ_PRIORITY_HIGH));
+  APP_ERROR_CHECK(sd_nvic_EnableIRQ(TIMER1_IRQn));
+
+  NRF_TIMER1->TASKS_CLEAR = 1;
+  NRF_TIMER1->TASKS_START = 1;
+}
+
+// usecs since profile_init(), must be called with interrupts blocked
+static uint32_t profile_now(void)
+{
+  NRF_TIMER1->TASKS_CAPTURE[1] = 1;
+  uint16_t low = NRF_TIMER1->CC[1];
+  uint16_t high = timerHigh;
+
+  if (NRF_TIMER1->EVENTS_COMPARE[0] && low < 0x8000)
+    high++; // the counter wrapped but our IRQ has not run yet
+
+  return ((uint32_t) high << 16) | low;
+}
+
+void profile_mark(profile_id_t id, bool end)
+{
+  CRITICAL_REGION_ENTER();
+  uint32_t now = profile_now();
+
+  if (!frozen) {
+    ring[ringHead] = (now & 0xffffff) | ((uint32_t) id << 24) | (end ? PROFILE_RING_END : 0);
+    ringHead = (ringHead + 1) & (PROFILE_RING_SIZE - 1);
+    if (!ringHead)
+      ringFull = true;
+  }
+
+  // Only the outermost begin/end of an id is timed, so recursion (i.e. renderLayouts) is not counted twice
+  if (!end) {
+    if (depth[id]++ == 0)
+      startTime[id] = now;
+  }
+  else if (depth[id] && --depth[id] == 0) {
+    profile_stat_t *s = &stats[id];
+    uint32_t elapsed = now - startTime[id];
+
+    if (!s->count || elapsed < s->min)
+      s->min = elapsed;
+    if (elapsed > s->max)
+      s->max = elapsed;
+    s->total += elapsed;
+    s->count++;
+  }
+  CRITICAL_REGION_EXIT();
+}
+
+void profile_clear(void)
+{
+  CRITICAL_REGION_ENTER();
+  memset(stats, 0, sizeof(stats));
+  ringHead = 0;
+  ringFull = false;
+  CRITICAL_REGION_EXIT();
+}
+
+void profile_dump_start(profile_send_fn send)
+{
+  sender = send;
+  dumpRequested = true;
+}
+
+void profile_dump_stop(void)
+{
+  stopRequested = true;
+}
+
+static uint16_t ring_count(void)
+{
+  return ringFull ? PROFILE_RING_SIZE : ringHead;
+}
+
+// Build the next packet of the dump, returns false once there is nothing more to send
+static bool dump_encode(uint8_t *pkt, uint16_t *len)
+{
+  uint16_t count = ring_count();
+
+  switch (dumpState) {
+  case DUMP_HEADER:
+    pkt[0] = PROFILE_PKT_HEADER;
+    memcpy(&pkt[1], &count, sizeof(count));
+    pkt[3] = PROF_COUNT;
+    *len = 4;
+    return true;
+
+  case DUMP_NAMES: {
+    uint16_t n = strlen(names[dumpIndex]);
+    if (n > 18)
+      n = 18;
+    pkt[0] = PROFILE_PKT_NAME;
+    pkt[1] = dumpIndex;
+    memcpy(&pkt[2], names[dumpIndex], n);
+    *len = 2 + n;
+    return true;
+  }
+
+  case DUMP_STATS:
+    pkt[0] = PROFILE_PKT_STATS;
+    pkt[1] = dumpIndex;
+    CRITICAL_REGION_ENTER();
+    memcpy(&pkt[2], &stats[dumpIndex], sizeof(profile_stat_t));
+    CRITICAL_REGION_EXIT();
+    *len = 2 + sizeof(profile_stat_t);
+    return true;
+
+  case DUMP_RING: {
+    // oldest entry first
+    uint16_t first = ringFull ? ringHead : 0, n = count - dumpIndex;
+    if (n > 4)
+      n = 4;
+    pkt[0] = PROFILE_PKT_RING;
+    for (uint16_t i = 0; i < n; i++) {
+      uint32_t entry = ring[(first + dumpIndex + i) & (PROFILE_RING_SIZE - 1)];
+      memcpy(&pkt[1 + i * 4], &entry, sizeof(entry));
+    }
+    *len = 1 + n * 4;
+    return true;
+  }
+
+  case DUMP_END:
+    pkt[0] = PROFILE_PKT_END;
+    *len = 1;
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+// The packet for the current state went out, move on
+static void dump_advance(void)
+{
+  switch (dumpState) {
+  case DUMP_HEADER:
+    dumpState = DUMP_NAMES;
+    dumpIndex = 0;
+    break;
+
+  case DUMP_NAMES:
+    if (++dumpIndex >= PROF_COUNT) {
+      dumpState = DUMP_STATS;
+      dumpIndex = 0;
+    }
+    break;
+
+  case DUMP_STATS:
+    if (++dumpIndex >= PROF_COUNT) {
+      dumpState = DUMP_RING;
+      dumpIndex = 0;
+    }
+    break;
+
+  case DUMP_RING:
+    dumpIndex += 4;
+    if (dumpIndex >= ring_count())
+      dumpState = DUMP_END;
+    break;
+
+  default:
+    dumpState = DUMP_IDLE;
+    frozen = false;
+    break;
+  }
+}
+
+void profile_dump_service(void)
+{
+  if (stopRequested) {
+    stopRequested = false;
+    dumpState = DUMP_IDLE;
+    frozen = false;
+  }
+
+  if (dumpRequested) {
+    dumpRequested = false;
+    frozen = true;
+    dumpState = DUMP_HEADER;
+  }
+
+  uint8_t pkt[20];
+  uint16_t len;
+
+  // a refused packet is simply encoded again on a later call
+  while (dump_encode(pkt, &len) && sender(pkt, len))
+    dump_advance();
+}
+
+#endif
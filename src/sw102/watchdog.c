@@ -0,0 +1,118 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "watchdog.h"
+#include "fmt.h"
+#include "checkin.h"
+#include "main.h"
+#include "nrf.h"
+#include "nrf_drv_wdt.h"
+#include "app_error.h"
+
+#define RESET_RECORD_MAGIC 0x57444f47 // "WDOG"
+
+// Deadlines must be shorter than WDT_CONFIG_RELOAD_VALUE, so when the main loop hangs (and nobody calls
+// watchdog_service any more) the client that stopped checking in is already overdue when the WDT fires.
+// The main loop and render deadlines also cover a worst case flash write, which blocks the main loop.
+static const checkin_client_t clients[WATCHDOG_NUM_CLIENTS] = {
+    [WATCHDOG_FLASH] = { .name = "flash", .deadline_msec = 3000, .only_when_busy = true },
+    [WATCHDOG_MOTOR] = { .name = "motor", .deadline_msec = 1000 },
+    [WATCHDOG_RENDER] = { .name = "render", .deadline_msec = 3000 },
+    [WATCHDOG_MAIN] = { .name = "main", .deadline_msec = 3000 },
+};
+
+static checkin_t checkins;
+static nrf_drv_wdt_channel_id channel;
+static bool started;
+
+// Survives the WDT reset (not touched by the startup code), see gcc_nrf51.ld
+typedef struct {
+  uint32_t magic;
+  uint8_t client;
+} reset_record_t;
+
+static reset_record_t reset_record __attribute__((section(".noinit")));
+
+static const char *reset_reason = "power on";
+
+void watchdog_read_reset_reason(void)
+{
+  uint32_t reason = NRF_POWER->RESETREAS;
+  NRF_POWER->RESETREAS = reason; // the bits are sticky until written back
+
+  if (reason & POWER_RESETREAS_DOG_Msk) {
+    if (reset_record.magic == RESET_RECORD_MAGIC && reset_record.client < WATCHDOG_NUM_CLIENTS) {
+      static char buf[16];
+
+      fmt_t f;
+      fmt_begin(&f, buf, sizeof(buf));
+      fmt_str(&f, "WDT ");
+      fmt_str(&f, clients[reset_record.client].name);
+      fmt_end(&f);
+      reset_reason = buf;
+    }
+    else
+      reset_reason = "WDT";
+  }
+  else if (reason & POWER_RESETREAS_LOCKUP_Msk)
+    reset_reason = "lockup";
+  else if (reason & POWER_RESETREAS_SREQ_Msk)
+    reset_reason = "soft reset";
+  else if (reason & POWER_RESETREAS_RESETPIN_Msk)
+    reset_reason = "pin reset";
+  else if (reason & POWER_RESETREAS_OFF_Msk)
+    reset_reason = "wakeup";
+
+  reset_record.magic = 0;
+}
+
+const char *watchdog_reset_reason(void)
+{
+  return reset_reason;
+}
+
+// Called from the WDT ISR, we have two 32kHz cycles before the reset
+static void wdt_event_handler(void)
+{
+  int8_t overdue = checkin_overdue(&checkins, get_msecs());
+
+  reset_record.client = overdue == CHECKIN_NONE ? WATCHDOG_NUM_CLIENTS : overdue;
+  reset_record.magic = RESET_RECORD_MAGIC;
+}
+
+void watchdog_init(void)
+{
+  nrf_drv_wdt_config_t config = NRF_DRV_WDT_DEAFULT_CONFIG;
+
+  checkin_init(&checkins, clients, WATCHDOG_NUM_CLIENTS, get_msecs());
+
+  APP_ERROR_CHECK(nrf_drv_wdt_init(&config, wdt_event_handler));
+  APP_ERROR_CHECK(nrf_drv_wdt_channel_alloc(&channel));
+  nrf_drv_wdt_enable();
+  started = true;
+}
+
+void watchdog_checkin(watchdog_client_t client)
+{
+  checkin(&checkins, client, get_msecs());
+}
+
+void watchdog_busy(watchdog_client_t client, bool busy)
+{
+  checkin_busy(&checkins, client, busy, get_msecs());
+}
+
+void watchdog_service(void)
+{
+  if (started && checkin_overdue(&checkins, get_msecs()) == CHECKIN_NONE)
+    nrf_drv_wdt_channel_feed(channel);
+}
+
+void watchdog_feed(void)
+{
+  if (started)
+    nrf_drv_wdt_channel_feed(channel);
+}
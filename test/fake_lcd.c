@@ -0,0 +1,104 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "ugui.h"
+#include "buttons.h"
+#include "fake_lcd.h"
+
+UG_GUI gui;
+
+uint8_t fake_lcd_fb[FAKE_LCD_PAGES][SCREEN_WIDTH];
+fake_lcd_counts_t fake_lcd_counts;
+bool fake_m_pressed;
+
+static uint16_t dirtyPages;
+
+static void pset(UG_S16 x, UG_S16 y, UG_COLOR col)
+{
+  if (col == C_TRANSPARENT || x < 0 || x >= SCREEN_WIDTH || y < 0 || y >= SCREEN_HEIGHT)
+    return;
+
+  fake_lcd_counts.pixels++;
+  fake_lcd_counts.row_pixels[y]++;
+  dirtyPages |= 1 << (y / 8);
+  if (col)
+    fake_lcd_fb[y / 8][x] |= 1 << (y % 8);
+  else
+    fake_lcd_fb[y / 8][x] &= ~(1 << (y % 8));
+}
+
+void fake_lcd_init(void)
+{
+  memset(fake_lcd_fb, 0, sizeof(fake_lcd_fb));
+  dirtyPages = 0;
+  fake_lcd_clear_counts();
+  UG_Init(&gui, pset, SCREEN_WIDTH, SCREEN_HEIGHT);
+}
+
+void fake_lcd_clear_counts(void)
+{
+  memset(&fake_lcd_counts, 0, sizeof(fake_lcd_counts));
+}
+
+uint32_t fake_lcd_pixels_in_rows(int16_t y, int16_t height)
+{
+  uint32_t n = 0;
+  for (int16_t i = y; i < y + height; i++)
+    n += fake_lcd_counts.row_pixels[i];
+
+  return n;
+}
+
+void lcd_refresh(void)
+{
+  fake_lcd_counts.refreshes++;
+  for (int i = 0; i < FAKE_LCD_PAGES; i++)
+    if (dirtyPages & (1 << i)) {
+      fake_lcd_counts.pages++;
+      fake_lcd_counts.spi_bytes += FAKE_LCD_PAGE_BYTES;
+    }
+
+  fake_lcd_counts.sent_pages |= dirtyPages;
+  dirtyPages = 0;
+}
+
+void lcd_scroll_left(int16_t x, int16_t y, int16_t w, int16_t h)
+{
+  for (int16_t page = y / 8; page <= (y + h - 1) / 8; page++) {
+    int16_t top = y > page * 8 ? y - page * 8 : 0;
+    int16_t bottom = y + h - 1 < page * 8 + 7 ? y + h - 1 - page * 8 : 7;
+    uint8_t mask = (uint8_t) (0xff << top) & (uint8_t) (0xff >> (7 - bottom));
+    uint8_t *p = &fake_lcd_fb[page][x];
+
+    for (int16_t i = 0; i < w - 1; i++)
+      p[i] = (p[i] & ~mask) | (p[i + 1] & mask);
+
+    dirtyPages |= 1 << page;
+  }
+}
+
+void lcd_move_pages(uint8_t dest, uint8_t src, uint8_t count)
+{
+  memmove(fake_lcd_fb[dest], fake_lcd_fb[src], count * sizeof(fake_lcd_fb[0]));
+  dirtyPages |= ((1 << count) - 1) << dest;
+  fake_lcd_counts.moved_pages += count;
+}
+
+uint32_t buttons_get_m_state(void)
+{
+  return fake_m_pressed;
+}
+
+// The edit acceleration is tested with the gesture engine (test_gestures.c), here every step is 1x
+uint32_t buttons_get_held_msecs(buttons_events_t button)
+{
+  return 0;
+}
+
+void buttons_set_repeating(buttons_events_t buttons)
+{
+}
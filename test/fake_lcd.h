@@ -0,0 +1,39 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lcd.h"
+
+/**
+ * Host stand-in for the LCD driver (src/sw102/lcd.c) and the button state screen.c asks for
+ *
+ * The frameBuffer has the same pages as lcd.c and the pages drawn to are tracked the same way, so
+ * lcd_refresh() sends what the display would get.  Every pixel drawn and every byte sent is counted.
+ */
+
+#define FAKE_LCD_PAGES (SCREEN_HEIGHT / 8)
+#define FAKE_LCD_PAGE_BYTES (3 + SCREEN_WIDTH) // page address command plus the page data, as lcd_refresh() sends it
+
+typedef struct {
+  uint32_t pixels; // pset() calls that drew a pixel on screen
+  uint32_t row_pixels[SCREEN_HEIGHT]; // the same, per row
+  uint32_t refreshes; // lcd_refresh() calls
+  uint32_t pages; // pages sent by lcd_refresh()
+  uint16_t sent_pages; // one bit per page sent since the counts were cleared
+  uint32_t spi_bytes;
+  uint32_t moved_pages; // pages copied by lcd_move_pages()
+} fake_lcd_counts_t;
+
+extern uint8_t fake_lcd_fb[FAKE_LCD_PAGES][SCREEN_WIDTH];
+extern fake_lcd_counts_t fake_lcd_counts;
+extern bool fake_m_pressed; // what buttons_get_m_state() returns
+
+void fake_lcd_init(void); // blank frameBuffer, no counts, and ugui set up to draw with our pset()
+void fake_lcd_clear_counts(void);
+uint32_t fake_lcd_pixels_in_rows(int16_t y, int16_t height);
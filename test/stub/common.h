@@ -0,0 +1,10 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+// Host stand-in for include/common.h, which pulls in the board and SDK headers.  ugui.c includes it but
+// uses nothing from it.
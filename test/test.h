@@ -0,0 +1,39 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Minimal checks for the host tests in this directory
+ *
+ * Each test is its own program built with the PC compiler, a failed check prints where it failed and
+ * the program exits non zero from TEST_DONE().
+ */
+
+static int test_failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      test_failures++; \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+#define CHECK_EQ(got, want) do { \
+    long long _got = (long long) (got), _want = (long long) (want); \
+    if (_got != _want) { \
+      test_failures++; \
+      printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #got, _got, _want); \
+    } \
+  } while (0)
+
+#define TEST_DONE() do { \
+    printf("%s: %s\n", __FILE__, test_failures ? "FAILED" : "ok"); \
+    return test_failures ? EXIT_FAILURE : EXIT_SUCCESS; \
+  } while (0)
@@ -0,0 +1,112 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "checkin.h"
+#include "test.h"
+
+// Same table as src/sw102/watchdog.c
+enum { FLASH, MOTOR, RENDER, MAIN, NUM_CLIENTS };
+
+static const checkin_client_t clients[NUM_CLIENTS] = {
+  [FLASH] = { .name = "flash", .deadline_msec = 3000, .only_when_busy = true },
+  [MOTOR] = { .name = "motor", .deadline_msec = 1000 },
+  [RENDER] = { .name = "render", .deadline_msec = 3000 },
+  [MAIN] = { .name = "main", .deadline_msec = 3000 },
+};
+
+static checkin_t c;
+
+static void deadlines(void)
+{
+  checkin_init(&c, clients, NUM_CLIENTS, 500);
+  CHECK_EQ(checkin_overdue(&c, 500), CHECKIN_NONE);
+  CHECK_EQ(checkin_overdue(&c, 1500), CHECKIN_NONE); // exactly at the deadline is still in time
+  CHECK_EQ(checkin_overdue(&c, 1501), MOTOR);
+
+  checkin(&c, MOTOR, 1400);
+  CHECK_EQ(checkin_overdue(&c, 2400), CHECKIN_NONE);
+  CHECK_EQ(checkin_overdue(&c, 2401), MOTOR);
+
+  // Several late: the first in table order is reported
+  checkin(&c, MOTOR, 3600);
+  CHECK_EQ(checkin_overdue(&c, 3600), RENDER);
+  checkin(&c, RENDER, 3600);
+  CHECK_EQ(checkin_overdue(&c, 3600), MAIN);
+  checkin(&c, MAIN, 3600);
+  CHECK_EQ(checkin_overdue(&c, 3600), CHECKIN_NONE);
+}
+
+static void busy(void)
+{
+  checkin_init(&c, clients, NUM_CLIENTS, 0);
+
+  // Not busy: flash is never overdue, however long it is quiet
+  for (uint32_t t = 0; t < 10000; t += 500) {
+    checkin(&c, MOTOR, t);
+    checkin(&c, RENDER, t);
+    checkin(&c, MAIN, t);
+    CHECK_EQ(checkin_overdue(&c, t), CHECKIN_NONE);
+  }
+
+  // The deadline counts from the start of the busy time, not from init
+  checkin_busy(&c, FLASH, true, 10000);
+  checkin(&c, MOTOR, 13000);
+  checkin(&c, RENDER, 13000);
+  checkin(&c, MAIN, 13000);
+  CHECK_EQ(checkin_overdue(&c, 13000), CHECKIN_NONE);
+  CHECK_EQ(checkin_overdue(&c, 13001), FLASH);
+
+  // Checking in while busy keeps it alive, and going idle stops the watching
+  checkin(&c, FLASH, 13001);
+  CHECK_EQ(checkin_overdue(&c, 13002), CHECKIN_NONE);
+  checkin_busy(&c, FLASH, false, 13500);
+  checkin(&c, MOTOR, 20000);
+  checkin(&c, RENDER, 20000);
+  checkin(&c, MAIN, 20000);
+  CHECK_EQ(checkin_overdue(&c, 20000), CHECKIN_NONE);
+}
+
+// The 100 ms feed task of watchdog.c: a client that hangs stops the feeding within its deadline + one period
+static void feed_loop(void)
+{
+  uint32_t lastFeed = 0, stalledAt = 5000;
+
+  checkin_init(&c, clients, NUM_CLIENTS, 0);
+  for (uint32_t t = 0; t < 10000; t += 100) {
+    if (t < stalledAt)
+      checkin(&c, RENDER, t);
+    if (t % 200 == 0)
+      checkin(&c, MOTOR, t);
+    checkin(&c, MAIN, t);
+
+    if (checkin_overdue(&c, t) == CHECKIN_NONE)
+      lastFeed = t;
+  }
+
+  CHECK_EQ(lastFeed, stalledAt - 100 + clients[RENDER].deadline_msec);
+}
+
+// The millisecond clock wraps after 49 days
+static void wrap(void)
+{
+  uint32_t t0 = UINT32_MAX - 200;
+
+  checkin_init(&c, clients, NUM_CLIENTS, t0);
+  CHECK_EQ(checkin_overdue(&c, t0 + 1000), CHECKIN_NONE);
+  CHECK_EQ(checkin_overdue(&c, t0 + 1001), MOTOR);
+  checkin(&c, MOTOR, t0 + 1001);
+  checkin_busy(&c, FLASH, true, t0 + 1001);
+  CHECK_EQ(checkin_overdue(&c, t0 + 2000), CHECKIN_NONE);
+}
+
+int main(void)
+{
+  deadlines();
+  busy();
+  feed_loop();
+  wrap();
+  TEST_DONE();
+}
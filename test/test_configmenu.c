@@ -0,0 +1,151 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include "fake_lcd.h"
+#include "test.h"
+
+// Built with screen.c itself, a full redraw needs its static state
+#include "../src/common/screen.c"
+
+/**
+ * A scripted session in a config style menu.  The expanded scrollable only draws what changed, after every
+ * frame the display must look like a full redraw of the same state, which is what the menu drew on every
+ * blink before.
+ */
+static uint8_t maxSpeed = 26, units = 1, other = 3;
+static uint16_t perimeter = 2105;
+
+static Field shortMenus[] = {
+    FIELD_EDITABLE_UINT("Only", &other, "x", 1, 9),
+    FIELD_END
+};
+
+static Field wheelMenus[] = {
+    FIELD_EDITABLE_UINT("Max speed", &maxSpeed, "km/h", 1, 99),
+    FIELD_EDITABLE_ENUM("Units", &units, "km/h", "mph"),
+    FIELD_READONLY_UINT("Perimeter", &perimeter, "mm", .div_digits = 1),
+    FIELD_SCROLLABLE("Short", shortMenus),
+    FIELD_EDITABLE_UINT("Other", &other, "x", 1, 9),
+    FIELD_END
+};
+
+static Field topMenus[] = {
+    FIELD_SCROLLABLE("Wheel", wheelMenus),
+    FIELD_SCROLLABLE("Short", shortMenus),
+    FIELD_SCROLLABLE("Alpha", wheelMenus),
+    FIELD_SCROLLABLE("Beta", shortMenus),
+    FIELD_SCROLLABLE("Gamma", wheelMenus),
+    FIELD_END
+};
+
+static Field configRoot = FIELD_SCROLLABLE("Config", topMenus);
+
+static const Screen configScreen = { .fields = { { .color = ColorNormal, .field = &configRoot }, { .field = NULL } } };
+
+static int mismatches;
+
+// Draws the current state from scratch in a child process, so the caches of the incremental drawing here stay as they are
+static bool same_as_full_redraw(void)
+{
+  uint8_t shown[FAKE_LCD_PAGES][SCREEN_WIDTH];
+  memcpy(shown, fake_lcd_fb, sizeof(shown));
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    memset(fake_lcd_fb, 0, sizeof(fake_lcd_fb));
+    forceScrollableRelayout = true;
+    blinkChanged = false;
+    renderLayouts(resolvedBody, true);
+    _exit(memcmp(shown, fake_lcd_fb, sizeof(shown)) ? 1 : 0);
+  }
+
+  int status;
+  CHECK(pid > 0 && waitpid(pid, &status, 0) == pid);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Draw n frames, return the pixels drawn
+static uint32_t frames(int n)
+{
+  uint32_t pixels = 0;
+
+  for (int i = 0; i < n; i++) {
+    fake_lcd_clear_counts();
+    screenUpdate();
+    pixels += fake_lcd_counts.pixels;
+    if (!same_as_full_redraw())
+      mismatches++;
+  }
+
+  return pixels;
+}
+
+static uint32_t press(buttons_events_t events, int n)
+{
+  CHECK(screenOnPress(events));
+  return frames(n);
+}
+
+int main(void)
+{
+  fake_lcd_init();
+  screenShow(&configScreen);
+  frames(25);
+
+  // to the end of the top menu and back, scrolling both ways
+  uint32_t moved = 0, scrolled = 0;
+  for (int i = 0; i < 4; i++)
+    press(DOWN_CLICK, 3);
+  press(DOWN_CLICK, 3); // already on the last entry
+  press(UP_CLICK, 3);
+  press(UP_CLICK, 3);
+  CHECK_EQ(configRoot.scrollable.first, 2);
+  for (int i = 0; i < 2; i++) {
+    scrolled += press(UP_CLICK, 1);
+    moved += fake_lcd_counts.moved_pages;
+    frames(2);
+  }
+  CHECK_EQ(moved, 2 * 2 * 4); // the two rows still showing are moved, four pages each
+  CHECK_EQ(configRoot.scrollable.first, 0);
+
+  // moving the selection between visible rows just moves the bar
+  uint32_t selected = press(DOWN_CLICK, 1);
+  CHECK(selected < 100);
+
+  // a submenu with a single entry and two blank rows, and back
+  press(M_CLICK, 12);
+  CHECK_EQ(scrollableStackPtr, 2);
+  press(ONOFF_CLICK, 3);
+
+  // edit the units in the wheel submenu, with the cursor blinking
+  press(UP_CLICK, 1);
+  press(M_CLICK, 2);
+  press(DOWN_CLICK, 1);
+  press(M_CLICK, 11);
+  CHECK(curActiveEditable == &wheelMenus[1]);
+  press(UP_CLICK, 11);
+  CHECK_EQ(units, 0);
+  press(ONOFF_CLICK, 3);
+  CHECK(curActiveEditable == NULL);
+
+  // scroll the submenu past its read only row and leave it
+  press(DOWN_CLICK, 1);
+  press(DOWN_CLICK, 1);
+  press(DOWN_CLICK, 3);
+  press(ONOFF_CLICK, 3);
+
+  // idle, only the selection bar blinks
+  uint32_t idle = frames(50);
+  CHECK(idle < 200);
+
+  CHECK_EQ(mismatches, 0);
+  printf("50 idle frames %u pixels, moving the selection %u pixels, scrolling one row %u pixels\n", (unsigned) idle,
+      (unsigned) selected, (unsigned) scrolled / 2);
+  TEST_DONE();
+}
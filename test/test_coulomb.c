@@ -0,0 +1,166 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "coulomb.h"
+#include "test.h"
+
+// A simulated 10Ah pack: true charge in mA*s, what the motor reports as current and what the voltage curve says
+#define TRUE_CAPACITY_MAS (10000UL * 3600)
+#define SAG_SOC 15 // under load the voltage reads this much low
+
+static coulomb_t c;
+static double trueMas;
+static double maxErr; // worst |fused - true| SOC in % since the last reset of it
+static unsigned hiddenMa; // drawn on top of the reported current, like a reading that is always a bit low
+
+static double true_soc(void)
+{
+  return trueMas * 100 / TRUE_CAPACITY_MAS;
+}
+
+static uint8_t volt_soc(uint8_t current_x5)
+{
+  int soc = (int) (true_soc() + 0.5) - (current_x5 > COULOMB_REST_CURRENT_X5 ? SAG_SOC : 0);
+  return soc < 0 ? 0 : soc;
+}
+
+// Replay updates of a steady current (in 0.2A units)
+static void replay(uint8_t current_x5, uint32_t seconds)
+{
+  for (uint32_t i = 0; i < seconds * 10; i++) {
+    trueMas -= current_x5 * COULOMB_MAS_PER_CURRENT_X5 + hiddenMa / 10.0;
+    if (trueMas < 0)
+      trueMas = 0;
+
+    coulomb_update(&c, current_x5, volt_soc(current_x5));
+
+    double err = c.soc_x10 / 10.0 - true_soc();
+    if (err < 0)
+      err = -err;
+    if (c.synced && err > maxErr)
+      maxErr = err;
+  }
+}
+
+// Ride until the true SOC drops to stop_soc: 10 minutes at 6-12A, then a minute stopped at the lights
+static void ride(double stop_soc)
+{
+  for (int leg = 0; true_soc() > stop_soc; leg++) {
+    replay(30 + (leg * 7) % 31, 600);
+    replay(0, 60);
+  }
+  replay(0, 60);
+}
+
+// Charged while switched off, then powered on with the state saved at power off
+static void charge_and_power_on(void)
+{
+  uint32_t capacity = c.capacity_mas, remaining = c.remaining_mas;
+
+  trueMas = TRUE_CAPACITY_MAS;
+  coulomb_init(&c, capacity, remaining);
+  CHECK(!c.synced);
+  replay(0, 20); // parked, the first rest syncs to the voltage
+  CHECK(c.synced);
+}
+
+static void first_rest_syncs(void)
+{
+  trueMas = TRUE_CAPACITY_MAS * 0.8;
+  coulomb_init(&c, TRUE_CAPACITY_MAS, 0); // no saved state: guess half
+  CHECK_EQ(c.soc_x10, 500);
+
+  replay(0, 14);
+  CHECK_EQ(c.soc_x10, 500); // not trusted yet
+  replay(0, 2);
+  CHECK(c.synced);
+  CHECK_EQ(c.soc_x10, 800); // exactly, whole percents must not show as 0.1% less
+
+  // Riding off: counted down exactly, not by the sagging voltage
+  replay(50, 360); // 10A for 6 minutes is 1Ah
+  CHECK(c.soc_x10 >= 699 && c.soc_x10 <= 701);
+}
+
+// Start from an 8.5Ah guess, each full cycle takes about a quarter off the error
+static void learn_capacity(void)
+{
+  double prevErr = TRUE_CAPACITY_MAS * 0.15;
+
+  hiddenMa = 0;
+  trueMas = TRUE_CAPACITY_MAS;
+  coulomb_init(&c, 8500UL * 3600, 0);
+
+  for (int cycle = 0; cycle < 12; cycle++) {
+    charge_and_power_on();
+    ride(30);
+
+    double capErr = (double) c.capacity_mas - TRUE_CAPACITY_MAS;
+    if (capErr < 0)
+      capErr = -capErr;
+    CHECK(capErr <= prevErr * 0.8);
+    prevErr = capErr;
+  }
+
+  // 0.75^12 of 1.5Ah is left, the SOC of the next ride follows
+  CHECK(prevErr < TRUE_CAPACITY_MAS / 100);
+  maxErr = 0;
+  charge_and_power_on();
+  ride(30);
+  CHECK(maxErr < 2);
+}
+
+// The current reads 0.3A low all the time: the count drifts, the rests pull it back
+static void drift(void)
+{
+  hiddenMa = 300;
+  trueMas = TRUE_CAPACITY_MAS;
+  coulomb_init(&c, TRUE_CAPACITY_MAS, 0);
+  replay(0, 20);
+
+  maxErr = 0;
+  ride(20);
+  CHECK(maxErr < 2);
+
+  // Without rests the same ride drifts much further
+  coulomb_t saved = c;
+  trueMas = TRUE_CAPACITY_MAS * 0.8;
+  coulomb_init(&c, TRUE_CAPACITY_MAS, TRUE_CAPACITY_MAS * 0.8);
+  c.synced = true;
+  maxErr = 0;
+  replay(50, 3 * 3600);
+  CHECK(maxErr > 2);
+  c = saved;
+  hiddenMa = 0;
+}
+
+static void limits(void)
+{
+  // Never below empty
+  trueMas = 1000;
+  coulomb_init(&c, TRUE_CAPACITY_MAS, 1000);
+  coulomb_update(&c, 255, 0);
+  CHECK_EQ(c.remaining_mas, 0);
+  CHECK_EQ(c.soc_x10, 0);
+
+  // A nonsense capacity is raised to 1Ah, and the remaining charge never exceeds it
+  coulomb_init(&c, 100, 5000000);
+  CHECK_EQ(c.capacity_mas, 1000UL * 3600);
+  CHECK_EQ(c.remaining_mas, 1000UL * 3600);
+  CHECK_EQ(c.soc_x10, 1000);
+
+  // 360Wh on 13 cells (46.8V nominal) is 7.69Ah
+  CHECK_EQ(coulomb_capacity_from_wh(3600, 13), 27692307);
+  CHECK_EQ(coulomb_capacity_from_wh(3600, 0), 0);
+}
+
+int main(void)
+{
+  first_rest_syncs();
+  learn_capacity();
+  drift();
+  limits();
+  TEST_DONE();
+}
@@ -0,0 +1,92 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "energy.h"
+#include "test.h"
+
+static energy_t e;
+
+// A 24h ride of random 100ms samples against a double precision integral of the same samples
+static void against_double(void)
+{
+  double wh = 0;
+  uint64_t mws = 0;
+
+  srand(1);
+  energy_reset(&e);
+  for (long i = 0; i < 24L * 36000; i++) {
+    uint32_t current_x5 = rand() % 150, volts_x10 = 400 + rand() % 200;
+    uint32_t power_x50 = current_x5 * volts_x10;
+
+    energy_add(&e, power_x50);
+    wh += power_x50 / 50.0 * 0.1 / 3600;
+    mws += power_x50 * 2;
+
+    // Exactly the whole 0.1Wh units of the energy so far, the double may be off by its own rounding
+    if (e.wh_x10 != mws / ENERGY_MWS_PER_WH_X10) {
+      CHECK_EQ(e.wh_x10, mws / ENERGY_MWS_PER_WH_X10);
+      break;
+    }
+    if (i % 36000 == 0)
+      CHECK(wh * 10 - energy_wh_x10(&e) > -1e-6 && wh * 10 - energy_wh_x10(&e) < 1 + 1e-6);
+  }
+
+  CHECK(wh * 10 - energy_wh_x10(&e) > -1e-6 && wh * 10 - energy_wh_x10(&e) < 1 + 1e-6);
+  CHECK(e.mws < ENERGY_MWS_PER_WH_X10);
+}
+
+static void units(void)
+{
+  energy_reset(&e);
+
+  // 360W (7.2A at 50V) for 1 s is 0.1Wh
+  for (int i = 0; i < 9; i++)
+    energy_add(&e, 36 * 500);
+  CHECK_EQ(energy_wh_x10(&e), 0);
+  energy_add(&e, 36 * 500);
+  CHECK_EQ(energy_wh_x10(&e), 1);
+  CHECK_EQ(e.mws, 0);
+
+  // The highest power the motor can report carries more than one unit in one sample
+  energy_reset(&e);
+  energy_add(&e, 255 * 1000);
+  CHECK_EQ(energy_wh_x10(&e), 1);
+  CHECK_EQ(e.mws, 255 * 1000 * 2 - ENERGY_MWS_PER_WH_X10);
+  energy_add(&e, 255 * 1000);
+  CHECK_EQ(energy_wh_x10(&e), 2);
+  CHECK_EQ(e.mws, 2 * 255 * 1000 * 2 - 2 * ENERGY_MWS_PER_WH_X10);
+
+  // and with almost a unit left over from before it carries two, never more
+  energy_reset(&e);
+  e.mws = ENERGY_MWS_PER_WH_X10 - 1;
+  energy_add(&e, 255 * 1000);
+  CHECK_EQ(energy_wh_x10(&e), 2);
+  CHECK(e.mws < ENERGY_MWS_PER_WH_X10);
+
+  energy_add(&e, 0);
+  CHECK_EQ(energy_wh_x10(&e), 2);
+
+  energy_reset(&e);
+  CHECK_EQ(energy_wh_x10(&e), 0);
+  CHECK_EQ(e.mws, 0);
+}
+
+// Above 1300W, where the old 16 bit power wrapped
+static void high_power(void)
+{
+  energy_reset(&e);
+  for (int i = 0; i < 36000; i++)
+    energy_add(&e, 150 * 520); // 30A at 52V is 1560W, power_x50 78000 doesn't fit 16 bits
+  CHECK_EQ(energy_wh_x10(&e), 15600); // for an hour
+}
+
+int main(void)
+{
+  against_double();
+  units();
+  high_power();
+  TEST_DONE();
+}
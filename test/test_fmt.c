@@ -0,0 +1,216 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "fmt.h"
+#include "test.h"
+
+#define BUF_SIZE 16
+
+static char buf[BUF_SIZE];
+
+static void same(const char *what, const char *got, const char *want)
+{
+  if (strcmp(got, want) != 0) {
+    test_failures++;
+    if (test_failures < 20)
+      printf("%s: got '%s', snprintf gives '%s'\n", what, got, want);
+  }
+}
+
+static bool vf(const char *format, ...)
+{
+  va_list args;
+  fmt_t f;
+
+  va_start(args, format);
+  fmt_begin(&f, buf, sizeof(buf));
+  fmt_vformat(&f, format, args);
+  va_end(args);
+  return fmt_end(&f);
+}
+
+// Interesting values first, then random ones of all sizes
+static uint32_t value(int i, int k)
+{
+  static const uint32_t edges[] = { 0, 1, 5, 9, 10, 99, 100, 101, 999, 1000, 12345, 65535, 65536, 99999, 100000,
+      999999999, 1000000000, 2147483647, 2147483648u, 4294967295u };
+
+  if (k == 0)
+    return edges[i % (sizeof(edges) / sizeof(edges[0]))];
+  return k % 2 ? (uint32_t) rand() * 2654435761u : (uint32_t) (rand() % 100000);
+}
+
+// Every output must be exactly what snprintf gives for the format strings the screens used before
+static void against_snprintf(void)
+{
+  static const char * const formats[] = { "%d", "%3d", "%03d", "%10d", "%010d", "%u", "%2u", "%02u", "%x", "%06x",
+      "%08x", "%12u" };
+  char want[64], got[BUF_SIZE];
+  fmt_t f;
+
+  srand(7);
+  for (int i = 0; i < 20; i++)
+    for (int k = 0; k < 2000; k++) {
+      uint32_t v = value(i, k);
+
+      // renderEditable(): "%lu" or "%lu.%0*lu" with div_digits
+      for (int digits = 0; digits <= 4; digits++)
+        for (int hide = 0; hide < 2; hide++) {
+          uint32_t div = 1;
+          for (int d = 0; d < digits; d++)
+            div *= 10;
+
+          if (digits == 0 || hide)
+            snprintf(want, sizeof(got), "%lu", (unsigned long) v / div);
+          else
+            snprintf(want, sizeof(got), "%lu.%0*lu", (unsigned long) v / div, digits, (unsigned long) v % div);
+
+          fmt_begin(&f, got, sizeof(got));
+          fmt_fixed(&f, v, digits, hide);
+          fmt_end(&f);
+          same("fmt_fixed", got, want);
+        }
+
+      for (unsigned j = 0; j < sizeof(formats) / sizeof(formats[0]); j++) {
+        snprintf(want, sizeof(buf), formats[j], v);
+        vf(formats[j], v);
+        same(formats[j], buf, want);
+      }
+
+      snprintf(want, sizeof(buf), "%2u.%1uV", (v % 1000) / 10, (v % 1000) % 10);
+      fmt_begin(&f, buf, sizeof(buf));
+      fmt_volts_x10(&f, v % 1000);
+      fmt_end(&f);
+      same("fmt_volts_x10", buf, want);
+
+      snprintf(want, sizeof(buf), "%3d%%", (int) (v % 2000));
+      fmt_begin(&f, buf, sizeof(buf));
+      fmt_percent(&f, v % 2000);
+      fmt_end(&f);
+      same("fmt_percent", buf, want);
+
+      snprintf(want, sizeof(buf), "%02d:%02d", (int) (v % 100), (int) (v / 100 % 60));
+      fmt_begin(&f, buf, sizeof(buf));
+      fmt_time(&f, v % 100, v / 100 % 60);
+      fmt_end(&f);
+      same("fmt_time", buf, want);
+
+      snprintf(want, sizeof(buf), "Mov %lu:%02lu", (unsigned long) v / 3600, (unsigned long) v / 60 % 60);
+      vf("Mov %lu:%02lu", (unsigned long) v / 3600, (unsigned long) v / 60 % 60);
+      same("Mov", buf, want);
+
+      snprintf(want, sizeof(buf), "%d|%5d|%d", (int32_t) v, (int32_t) v, (int32_t) v);
+      fmt_begin(&f, buf, sizeof(buf));
+      fmt_int(&f, v, 0, false);
+      fmt_char(&f, '|');
+      fmt_int(&f, v, 5, false);
+      fmt_char(&f, '|');
+      fmt_int(&f, v, 0, true);
+      fmt_end(&f);
+      same("fmt_int", buf, want);
+    }
+}
+
+// The fault, boot and diagnostics messages, including truncation to the buffer
+static void messages(void)
+{
+  char want[64];
+
+  snprintf(want, sizeof(buf), "%s:%d (%d)", "main.c", 123, -5);
+  vf("%s:%d (%d)", "main.c", 123, -5);
+  same("fault", buf, want);
+
+  snprintf(want, sizeof(buf), "%s:%d (%d)", "a_very_long_file.c", 123, 5);
+  vf("%s:%d (%d)", "a_very_long_file.c", 123, 5);
+  same("truncated", buf, want);
+
+  snprintf(want, sizeof(buf), "No motor? (%u.%uV)", 52, 3);
+  vf("No motor? (%u.%uV)", 52, 3);
+  same("boot", buf, want);
+
+  snprintf(want, sizeof(buf), "CPU %u%%", 42);
+  vf("CPU %u%%", 42);
+  same("cpu", buf, want);
+
+  snprintf(want, sizeof(buf), "0x%06lx", 0x1234ul);
+  vf("0x%06lx", 0x1234ul);
+  same("address", buf, want);
+
+  snprintf(want, sizeof(buf), "%5s|%c|%i", "ab", 'z', -7);
+  vf("%5s|%c|%i", "ab", 'z', -7);
+  same("string", buf, want);
+
+  snprintf(want, sizeof(buf), "%010d", -42);
+  vf("%010d", -42);
+  same("zero padded negative", buf, want);
+}
+
+static void changes(void)
+{
+  vf("hello");
+  CHECK(!vf("hello"));
+  CHECK(vf("hell"));
+  CHECK(vf("hello"));
+  CHECK(vf(""));
+  CHECK(!vf(""));
+
+  // Truncated output compares what fits
+  CHECK(vf("0123456789abcdefXYZ"));
+  CHECK(!vf("0123456789abcdefQ"));
+  CHECK_EQ(strlen(buf), BUF_SIZE - 1);
+}
+
+// Host timing of the per tick time + volts producers, old vs new
+static void benchmark(void)
+{
+  enum { N = 2000000 };
+  char msg[BUF_SIZE] = "";
+  volatile uint32_t sink = 0;
+  fmt_t f;
+
+  clock_t t0 = clock();
+  for (int i = 0; i < N; i++) {
+    char b[BUF_SIZE] = "";
+    snprintf(b, sizeof(b), "%02d:%02d", i % 24, i % 60);
+    if (strcmp(b, msg)) {
+      strcpy(msg, b);
+      sink++;
+    }
+
+    char b2[BUF_SIZE] = "";
+    snprintf(b2, sizeof(b2), "%2u.%1uV", (i % 600) / 10, (i % 600) % 10);
+    if (strcmp(b2, msg)) {
+      strcpy(msg, b2);
+      sink++;
+    }
+  }
+
+  clock_t t1 = clock();
+  for (int i = 0; i < N; i++) {
+    fmt_begin(&f, msg, sizeof(msg));
+    fmt_time(&f, i % 24, i % 60);
+    sink += fmt_end(&f);
+    fmt_begin(&f, msg, sizeof(msg));
+    fmt_volts_x10(&f, i % 600);
+    sink += fmt_end(&f);
+  }
+
+  clock_t t2 = clock();
+  printf("snprintf + strcmp %.1f ns, fmt %.1f ns per pair (host)\n", (t1 - t0) * 1e9 / CLOCKS_PER_SEC / N,
+      (t2 - t1) * 1e9 / CLOCKS_PER_SEC / N);
+}
+
+int main(void)
+{
+  against_snprintf();
+  messages();
+  changes();
+  benchmark();
+  TEST_DONE();
+}
@@ -0,0 +1,316 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "gestures.h"
+#include "test.h"
+
+// Same table and timings as src/common/buttons.c
+enum { PWR, M, UP, DOWN, NUM_BUTTONS };
+
+static const gesture_button_t buttons[NUM_BUTTONS] = {
+  [PWR] = { .click = ONOFF_CLICK, .click_long_click = ONOFF_CLICK_LONG_CLICK, .long_click = ONOFF_LONG_CLICK, .long_click_msec = 2000 },
+  [M] = { .click = M_CLICK, .click_long_click = M_CLICK_LONG_CLICK, .long_click = M_LONG_CLICK, .long_click_msec = 1000 },
+  [UP] = { .click = UP_CLICK, .click_long_click = UP_CLICK_LONG_CLICK, .long_click = UP_LONG_CLICK, .long_click_msec = 1000 },
+  [DOWN] = { .click = DOWN_CLICK, .click_long_click = DOWN_CLICK_LONG_CLICK, .long_click = DOWN_LONG_CLICK, .long_click_msec = 1000 },
+};
+
+static const gesture_chord_t chords[] = {
+  { .buttons = (1 << UP) | (1 << DOWN), .event = UPDOWN_CLICK },
+};
+
+static const gesture_timing_t timing = {
+  .quick_click_msec = 40,
+  .second_press_msec = 400,
+  .click_long_click_msec = 1000,
+  .repeat_delay_msec = 500,
+  .repeat_msec = 200,
+  .repeat_min_msec = 50,
+  .repeat_accel_count = 5,
+};
+
+static const gesture_config_t config = {
+  .buttons = buttons,
+  .num_buttons = NUM_BUTTONS,
+  .chords = chords,
+  .num_chords = sizeof(chords) / sizeof(chords[0]),
+  .timing = &timing,
+};
+
+#define TICK_MSEC 10
+#define MAX_LOG 32
+
+typedef struct {
+  uint32_t time;
+  uint8_t button;
+  bool pressed;
+} edge_t;
+
+typedef struct {
+  uint32_t time;
+  buttons_events_t events;
+} logged_t;
+
+#define PRESS(t, b) { t, b, true }
+#define RELEASE(t, b) { t, b, false }
+
+static gesture_engine_t g;
+static logged_t log_[MAX_LOG];
+static int logged;
+
+// Feed the edges at their times and poll every tick until end, the events of each tick are taken and logged
+static void replay(const edge_t *edges, int num_edges, uint8_t repeating, uint32_t end)
+{
+  int e = 0;
+
+  gesture_init(&g, &config, 0);
+  gesture_set_repeating(&g, repeating);
+  logged = 0;
+
+  for (uint32_t t = 0; t <= end; t += TICK_MSEC) {
+    buttons_events_t events = 0;
+
+    for (; e < num_edges && edges[e].time <= t; e++)
+      gesture_edge(&g, edges[e].button, edges[e].pressed, edges[e].time, &events);
+    gesture_update(&g, t, &events);
+
+    if (events && logged < MAX_LOG)
+      log_[logged++] = (logged_t) { t, events };
+  }
+
+  CHECK(gesture_is_idle(&g));
+}
+
+#define REPLAY(edges, repeating, end) replay(edges, sizeof(edges) / sizeof(edges[0]), repeating, end)
+
+static void expect(const logged_t *want, int num_want, int line)
+{
+  if (logged != num_want) {
+    test_failures++;
+    printf("line %d: %d events, expected %d\n", line, logged, num_want);
+  }
+
+  for (int i = 0; i < logged && i < num_want; i++)
+    if (log_[i].time != want[i].time || log_[i].events != want[i].events) {
+      test_failures++;
+      printf("line %d: event %d is %u at %u ms, expected %u at %u ms\n", line, i,
+          (unsigned) log_[i].events, (unsigned) log_[i].time, (unsigned) want[i].events, (unsigned) want[i].time);
+    }
+}
+
+#define EXPECT(...) do { \
+    static const logged_t _want[] = { __VA_ARGS__ }; \
+    expect(_want, sizeof(_want) / sizeof(_want[0]), __LINE__); \
+  } while (0)
+
+#define EXPECT_NONE() expect(NULL, 0, __LINE__)
+
+static void clicks(void)
+{
+  // A normal click is reported on release
+  static const edge_t click[] = { PRESS(0, UP), RELEASE(100, UP) };
+  REPLAY(click, 0, 1000);
+  EXPECT({ 100, UP_CLICK });
+
+  // A very short tap waits to see if a click + long click follows
+  static const edge_t tap[] = { PRESS(0, M), RELEASE(20, M) };
+  REPLAY(tap, 0, 1000);
+  EXPECT({ 420, M_CLICK });
+
+  // Tap then short press is still one click (no double click in this table)
+  static const edge_t tapClick[] = { PRESS(0, DOWN), RELEASE(20, DOWN), PRESS(100, DOWN), RELEASE(200, DOWN) };
+  REPLAY(tapClick, 0, 1000);
+  EXPECT({ 200, DOWN_CLICK });
+
+  // Two normal clicks are two clicks
+  static const edge_t twice[] = { PRESS(0, UP), RELEASE(80, UP), PRESS(150, UP), RELEASE(250, UP) };
+  REPLAY(twice, 0, 1000);
+  EXPECT({ 80, UP_CLICK }, { 250, UP_CLICK });
+}
+
+static void long_clicks(void)
+{
+  static const edge_t up[] = { PRESS(0, UP), RELEASE(1500, UP) };
+  REPLAY(up, 0, 2000);
+  EXPECT({ 1000, UP_LONG_CLICK });
+
+  // The power button needs 2 s
+  static const edge_t pwr[] = { PRESS(0, PWR), RELEASE(1500, PWR), PRESS(2000, PWR), RELEASE(4500, PWR) };
+  REPLAY(pwr, 0, 5000);
+  EXPECT({ 1500, ONOFF_CLICK }, { 4000, ONOFF_LONG_CLICK });
+
+  static const edge_t tapHold[] = { PRESS(0, PWR), RELEASE(30, PWR), PRESS(200, PWR), RELEASE(1500, PWR) };
+  REPLAY(tapHold, 0, 2000);
+  EXPECT({ 1200, ONOFF_CLICK_LONG_CLICK });
+
+  // Second press too late: a click, then a plain long click
+  static const edge_t late[] = { PRESS(0, M), RELEASE(30, M), PRESS(500, M), RELEASE(1600, M) };
+  REPLAY(late, 0, 2000);
+  EXPECT({ 430, M_CLICK }, { 1500, M_LONG_CLICK });
+}
+
+static void chord(void)
+{
+  static const edge_t both[] = { PRESS(0, UP), PRESS(50, DOWN), RELEASE(1200, UP), RELEASE(1250, DOWN) };
+  REPLAY(both, 0, 2000);
+  EXPECT({ 1000, UPDOWN_CLICK });
+
+  // DOWN let go before UP reached its long click: no chord
+  static const edge_t early[] = { PRESS(0, UP), PRESS(50, DOWN), RELEASE(300, DOWN), RELEASE(1200, UP) };
+  REPLAY(early, 0, 2000);
+  EXPECT({ 300, DOWN_CLICK }, { 1000, UP_LONG_CLICK });
+}
+
+static void repeat(void)
+{
+  // 200 ms repeats after 500 ms, halved every 5 repeats down to 50 ms
+  static const edge_t hold[] = { PRESS(0, UP), RELEASE(2000, UP) };
+  REPLAY(hold, 1 << UP, 2500);
+  EXPECT({ 0, UP_CLICK }, { 500, UP_CLICK }, { 700, UP_CLICK }, { 900, UP_CLICK }, { 1100, UP_CLICK },
+      { 1300, UP_CLICK }, { 1400, UP_CLICK }, { 1500, UP_CLICK }, { 1600, UP_CLICK }, { 1700, UP_CLICK },
+      { 1800, UP_CLICK }, { 1850, UP_CLICK }, { 1900, UP_CLICK }, { 1950, UP_CLICK }, { 2000, UP_CLICK });
+
+  // Buttons that don't repeat keep their long click
+  static const edge_t other[] = { PRESS(0, DOWN), RELEASE(1200, DOWN) };
+  REPLAY(other, 1 << UP, 2000);
+  EXPECT({ 1000, DOWN_LONG_CLICK });
+}
+
+// Called rarely, the engine must catch up with everything that timed out in between
+static void late_update(void)
+{
+  buttons_events_t events = 0;
+
+  gesture_init(&g, &config, 0);
+  gesture_set_repeating(&g, 1 << UP);
+  gesture_edge(&g, UP, true, 0, &events);
+  CHECK_EQ(events, UP_CLICK);
+
+  events = 0;
+  gesture_update(&g, 950, &events);
+  CHECK_EQ(events, UP_CLICK);
+  CHECK_EQ(g.buttons[UP].repeats, 3);
+  CHECK_EQ(gesture_held_msec(&g, UP), 950);
+
+  // An edge stamped before the last update doesn't move time back
+  events = 0;
+  gesture_edge(&g, UP, false, 940, &events);
+  CHECK_EQ(events, 0);
+  CHECK_EQ(gesture_held_msec(&g, UP), 0);
+  CHECK(gesture_is_idle(&g));
+}
+
+static void blocked_and_reset(void)
+{
+  buttons_events_t events = 0;
+
+  // A press while this button's last event is still pending is ignored until released
+  gesture_init(&g, &config, 0);
+  gesture_edge(&g, UP, true, 0, &events);
+  gesture_edge(&g, UP, false, 100, &events);
+  CHECK_EQ(events, UP_CLICK);
+  gesture_edge(&g, UP, true, 200, &events);
+  gesture_update(&g, 1500, &events);
+  CHECK_EQ(events, UP_CLICK);
+  gesture_edge(&g, UP, false, 1600, &events);
+  CHECK_EQ(events, UP_CLICK);
+  CHECK(gesture_is_idle(&g));
+
+  // Pending events of other buttons don't block
+  gesture_edge(&g, DOWN, true, 1700, &events);
+  gesture_update(&g, 2700, &events);
+  CHECK_EQ(events, UP_CLICK | DOWN_LONG_CLICK);
+  gesture_edge(&g, DOWN, false, 2800, &events);
+
+  // A reset drops the gesture of a held button, its release does nothing
+  events = 0;
+  gesture_edge(&g, M, true, 3000, &events);
+  gesture_update(&g, 3500, &events);
+  gesture_reset(&g);
+  CHECK(!gesture_is_idle(&g));
+  gesture_update(&g, 5000, &events);
+  gesture_edge(&g, M, false, 5100, &events);
+  gesture_update(&g, 6000, &events);
+  CHECK_EQ(events, 0);
+  CHECK(gesture_is_idle(&g));
+}
+
+// The millisecond clock wraps after 49 days
+static void wrap(void)
+{
+  buttons_events_t events = 0;
+  uint32_t t0 = UINT32_MAX - 300;
+
+  gesture_init(&g, &config, t0);
+  gesture_edge(&g, UP, true, t0, &events);
+  gesture_update(&g, t0 + 999, &events);
+  CHECK_EQ(events, 0);
+  gesture_update(&g, t0 + 1000, &events);
+  CHECK_EQ(events, UP_LONG_CLICK);
+}
+
+// Same schedule as editAccel in src/common/screen.c
+static const gesture_accel_step_t accel[] = { { 0, 1 }, { 2000, 10 }, { 4000, 100 } };
+#define NUM_ACCEL (sizeof(accel) / sizeof(accel[0]))
+
+static void accel_schedule(void)
+{
+  CHECK_EQ(gesture_accel_multiplier(accel, NUM_ACCEL, 0), 1);
+  CHECK_EQ(gesture_accel_multiplier(accel, NUM_ACCEL, 1999), 1);
+  CHECK_EQ(gesture_accel_multiplier(accel, NUM_ACCEL, 2000), 10);
+  CHECK_EQ(gesture_accel_multiplier(accel, NUM_ACCEL, 3999), 10);
+  CHECK_EQ(gesture_accel_multiplier(accel, NUM_ACCEL, 4000), 100);
+  CHECK_EQ(gesture_accel_multiplier(accel, NUM_ACCEL, UINT32_MAX), 100);
+
+  // No steps, or a first step that needs some dwell: plain steps until then
+  CHECK_EQ(gesture_accel_multiplier(accel, 0, 5000), 1);
+  CHECK_EQ(gesture_accel_multiplier(&accel[1], NUM_ACCEL - 1, 1000), 1);
+  CHECK_EQ(gesture_accel_multiplier(&accel[1], NUM_ACCEL - 1, 2500), 10);
+}
+
+// Hold UP on an editable the way screen.c does: every repeated click steps by the multiplier for the held time
+static void accel_hold(void)
+{
+  buttons_events_t events = 0;
+  uint32_t value = 0;
+
+  gesture_init(&g, &config, 0);
+  gesture_set_repeating(&g, 1 << UP);
+  gesture_edge(&g, UP, true, 0, &events);
+
+  for (uint32_t t = 0; t <= 4500; t += TICK_MSEC) {
+    gesture_update(&g, t, &events);
+    if (events & UP_CLICK)
+      value += gesture_accel_multiplier(accel, NUM_ACCEL, gesture_held_msec(&g, UP));
+    events = 0;
+
+    // 14 single steps in the first 2 s, then 40 steps of 10 at 50 ms
+    if (t == 1990)
+      CHECK_EQ(value, 14);
+    if (t == 3990)
+      CHECK_EQ(value, 414);
+  }
+
+  // So a wheel perimeter goes from 750 to 2200 mm in 4.5 s instead of 290 s at one step per 200 ms
+  CHECK_EQ(value, 1514);
+
+  gesture_edge(&g, UP, false, 4510, &events);
+  CHECK_EQ(gesture_held_msec(&g, UP), 0);
+  CHECK_EQ(gesture_accel_multiplier(accel, NUM_ACCEL, gesture_held_msec(&g, UP)), 1);
+}
+
+int main(void)
+{
+  clicks();
+  long_clicks();
+  chord();
+  repeat();
+  late_update();
+  blocked_and_reset();
+  wrap();
+  accel_schedule();
+  accel_hold();
+  TEST_DONE();
+}
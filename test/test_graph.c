@@ -0,0 +1,146 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "graph.h"
+#include "test.h"
+
+#define SAMPLES_30S 5
+#define SAMPLES_5MIN (SAMPLES_30S * 10)
+#define SAMPLES_30MIN (SAMPLES_5MIN * 6)
+#define NUM_SAMPLES (SAMPLES_30MIN * (GRAPH_COLS + 10)) // enough for every ring to wrap
+
+static const uint32_t samplesPerCol[GRAPH_SCALES] = { SAMPLES_30S, SAMPLES_5MIN, SAMPLES_30MIN };
+
+static graph_t g;
+static uint16_t samples[NUM_SAMPLES];
+
+// Every column against the raw samples it covers: exact min and max, average within the rounding of each level
+static void against_samples(void)
+{
+  srand(11);
+  graph_init(&g);
+
+  for (uint32_t i = 0; i < NUM_SAMPLES; i++) {
+    samples[i] = i % 997 < 500 ? rand() % 800 : 300 + rand() % 50;
+
+    uint8_t finished = graph_add(&g, samples[i]);
+    uint8_t want = 0;
+    for (int s = 0; s < GRAPH_SCALES; s++)
+      if ((i + 1) % samplesPerCol[s] == 0)
+        want |= 1 << s;
+    if (finished != want) {
+      CHECK_EQ(finished, want);
+      break;
+    }
+  }
+
+  for (int s = 0; s < GRAPH_SCALES; s++) {
+    uint32_t per = samplesPerCol[s], cols = NUM_SAMPLES / per;
+
+    CHECK(graph_column(&g, s, GRAPH_COLS - 1) != NULL);
+    CHECK(graph_column(&g, s, GRAPH_COLS) == NULL);
+
+    for (uint8_t age = 0; age < GRAPH_COLS; age++) {
+      const graph_column_t *c = graph_column(&g, s, age);
+      uint32_t first = (cols - 1 - age) * per;
+      uint16_t min = UINT16_MAX, max = 0;
+      uint32_t sum = 0;
+
+      for (uint32_t i = first; i < first + per; i++) {
+        if (samples[i] < min)
+          min = samples[i];
+        if (samples[i] > max)
+          max = samples[i];
+        sum += samples[i];
+      }
+
+      CHECK_EQ(c->min, min);
+      CHECK_EQ(c->max, max);
+      CHECK(c->avg <= sum / per && c->avg + s >= sum / per); // each level may round down by one
+    }
+  }
+}
+
+static void filling(void)
+{
+  graph_init(&g);
+  CHECK(graph_column(&g, GRAPH_30S, 0) == NULL);
+
+  for (int i = 0; i < SAMPLES_30S - 1; i++)
+    CHECK_EQ(graph_add(&g, 100), 0);
+  CHECK_EQ(graph_add(&g, 200), 1 << GRAPH_30S);
+  CHECK(graph_column(&g, GRAPH_30S, 1) == NULL);
+  CHECK(graph_column(&g, GRAPH_5MIN, 0) == NULL);
+
+  const graph_column_t *c = graph_column(&g, GRAPH_30S, 0);
+  CHECK_EQ(c->min, 100);
+  CHECK_EQ(c->max, 200);
+  CHECK_EQ(c->avg, 120);
+
+  // Extremes survive into the slower scales
+  for (int i = SAMPLES_30S; i < SAMPLES_5MIN; i++)
+    graph_add(&g, i == 20 ? UINT16_MAX : i == 30 ? 0 : 100);
+  c = graph_column(&g, GRAPH_5MIN, 0);
+  CHECK_EQ(c->min, 0);
+  CHECK_EQ(c->max, UINT16_MAX);
+}
+
+static void range(uint16_t min, uint16_t max, uint16_t want_lo, uint16_t want_hi, int line)
+{
+  uint16_t lo, hi;
+
+  graph_init(&g);
+  for (int i = 0; i < SAMPLES_30S * 4; i++)
+    graph_add(&g, i < 10 ? min : max);
+
+  graph_range(&g, GRAPH_30S, GRAPH_COLS, &lo, &hi);
+  if (lo != want_lo || hi != want_hi) {
+    test_failures++;
+    printf("line %d: range %u-%u is %u-%u, expected %u-%u\n", line, min, max, lo, hi, want_lo, want_hi);
+  }
+}
+
+#define RANGE(min, max, lo, hi) range(min, max, lo, hi, __LINE__)
+
+// Four grid steps of 1, 2 or 5 times a power of ten cover the data
+static void ranges(void)
+{
+  uint16_t lo, hi;
+
+  graph_init(&g);
+  graph_range(&g, GRAPH_30S, GRAPH_COLS, &lo, &hi);
+  CHECK_EQ(lo, 0); // no data yet
+  CHECK_EQ(hi, 1);
+
+  RANGE(0, 700, 0, 800);
+  RANGE(0, 4, 0, 4);
+  RANGE(0, 5, 0, 6);
+  RANGE(230, 260, 230, 260);
+  RANGE(231, 259, 230, 260);
+  RANGE(1000, 1000, 1000, 1001);
+  RANGE(0, 9999, 0, 10000);
+  RANGE(50000, UINT16_MAX, 50000, UINT16_MAX); // clamped to what fits
+  RANGE(UINT16_MAX, UINT16_MAX, UINT16_MAX - 1, UINT16_MAX);
+
+  // Only the newest columns count
+  graph_init(&g);
+  for (int i = 0; i < SAMPLES_30S * 10; i++)
+    graph_add(&g, i < SAMPLES_30S * 5 ? 900 : 100);
+  graph_range(&g, GRAPH_30S, 5, &lo, &hi);
+  CHECK_EQ(lo, 100);
+  CHECK_EQ(hi, 101);
+  graph_range(&g, GRAPH_30S, 6, &lo, &hi);
+  CHECK_EQ(lo, 0);
+  CHECK_EQ(hi, 1000);
+}
+
+int main(void)
+{
+  against_samples();
+  filling();
+  ranges();
+  TEST_DONE();
+}
@@ -0,0 +1,143 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "mirror.h"
+#include "test.h"
+
+#define FB_SIZE (MIRROR_PAGES * MIRROR_PAGE_WIDTH)
+
+static uint8_t fb[FB_SIZE], copy[FB_SIZE];
+
+// Fake link: applies every packet to copy, refuses every few packets like a full BLE queue
+static int sent, refuseEvery;
+static bool send(const uint8_t *data, uint16_t len)
+{
+  if (refuseEvery && ++sent % refuseEvery == 0)
+    return false;
+
+  CHECK(len >= 2 && len <= MIRROR_MAX_PACKET);
+  CHECK(mirror_decode(data, len, copy));
+  return true;
+}
+
+static void fill(int pattern)
+{
+  for (int i = 0; i < FB_SIZE; i++)
+    switch (pattern) {
+    case 0: fb[i] = 0; break;
+    case 1: fb[i] = rand(); break;
+    case 2: fb[i] = (i / 7) & 1 ? 0xff : 0x00; break; // runs that span packet ends
+    case 3: fb[i] = rand() % 8 ? fb[i ? i - 1 : 0] : rand(); break; // long runs, like text on a blank screen
+    case 4: fb[i] = i & 1 ? 0x55 : 0xaa; break; // no runs at all
+    }
+}
+
+// Encode and decode every page directly
+static void round_trip(void)
+{
+  for (int pattern = 0; pattern < 5; pattern++)
+    for (int rep = 0; rep < 100; rep++) {
+      fill(pattern);
+      memset(copy, 0x5a, sizeof(copy));
+
+      for (uint8_t page = 0; page < MIRROR_PAGES; page++)
+        for (uint8_t col = 0; col < MIRROR_PAGE_WIDTH;) {
+          uint8_t pkt[MIRROR_MAX_PACKET], len = 0;
+          uint8_t cols = mirror_encode(&fb[page * MIRROR_PAGE_WIDTH], page, col, pkt, &len);
+
+          CHECK(cols > 0);
+          CHECK(len >= 2 && len <= MIRROR_MAX_PACKET);
+          CHECK(mirror_decode(pkt, len, copy));
+          col += cols;
+        }
+
+      CHECK(memcmp(fb, copy, FB_SIZE) == 0);
+    }
+}
+
+// A blank page must fit in one RLE packet
+static void blank_page(void)
+{
+  uint8_t page[MIRROR_PAGE_WIDTH] = { 0 }, pkt[MIRROR_MAX_PACKET], len;
+
+  CHECK_EQ(mirror_encode(page, 3, 0, pkt, &len), MIRROR_PAGE_WIDTH);
+  CHECK_EQ(len, 4);
+  CHECK_EQ(pkt[0], 3 | MIRROR_HDR_RLE);
+}
+
+static void malformed(void)
+{
+  const uint8_t shortPkt[] = { 0 };
+  const uint8_t oddRle[] = { MIRROR_HDR_RLE, 0, 4 };
+  const uint8_t zeroRun[] = { MIRROR_HDR_RLE, 0, 0, 0xff };
+  const uint8_t rleOverrun[] = { MIRROR_HDR_RLE, 60, 5, 0xff };
+  const uint8_t rawOverrun[] = { 0, 62, 1, 2, 3 };
+  const uint8_t rawLast[] = { 15, 62, 1, 2 };
+
+  memset(copy, 0, sizeof(copy));
+  CHECK(!mirror_decode(shortPkt, sizeof(shortPkt), copy));
+  CHECK(!mirror_decode(oddRle, sizeof(oddRle), copy));
+  CHECK(!mirror_decode(zeroRun, sizeof(zeroRun), copy));
+  CHECK(!mirror_decode(rleOverrun, sizeof(rleOverrun), copy));
+  CHECK(!mirror_decode(rawOverrun, sizeof(rawOverrun), copy));
+  CHECK(mirror_decode(rawLast, sizeof(rawLast), copy));
+  CHECK_EQ(copy[FB_SIZE - 1], 2);
+}
+
+// The whole path through mirror_service(), with a link that is sometimes full
+static void service(void)
+{
+  // refuseEvery 1 would never send anything
+  static const int refuse[] = { 0, 2, 3, 7 };
+
+  for (unsigned r = 0; r < sizeof(refuse) / sizeof(refuse[0]); r++) {
+    refuseEvery = refuse[r];
+    fill(3);
+    memset(copy, 0, sizeof(copy));
+    mirror_start(fb, send);
+    CHECK(mirror_is_active());
+
+    for (int tick = 0; tick < 1000; tick++) {
+      if (tick % 50 == 10) {
+        int i = rand() % FB_SIZE;
+        fb[i] = rand();
+        fb[FB_SIZE - 1] ^= 0x81;
+        mirror_pages_changed(1 << (MIRROR_PAGES - 1) | 1 << (i / MIRROR_PAGE_WIDTH));
+      }
+      mirror_service();
+    }
+
+    CHECK(memcmp(fb, copy, FB_SIZE) == 0);
+    mirror_stop();
+  }
+  refuseEvery = 0;
+
+  // A start right after a stop, before the main loop ran, must win
+  mirror_service();
+  CHECK(!mirror_is_active());
+  mirror_start(fb, send);
+  mirror_stop();
+  mirror_start(fb, send);
+  CHECK(mirror_is_active());
+  mirror_service();
+  CHECK(mirror_is_active());
+  CHECK(memcmp(fb, copy, FB_SIZE) == 0);
+
+  mirror_stop();
+  CHECK(!mirror_is_active());
+  mirror_service();
+  CHECK(!mirror_is_active());
+}
+
+int main(void)
+{
+  round_trip();
+  blank_page();
+  malformed();
+  service();
+  TEST_DONE();
+}
@@ -0,0 +1,103 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "odometer.h"
+#include "test.h"
+
+#define PERIMETER 2100
+
+static odometer_t o;
+
+// 1000km at up to 3 wheel turns per sample: nothing is lost to rounding
+static void long_ride(void)
+{
+  uint32_t ticks = 12345, steps = 0;
+  uint64_t turns = 0;
+
+  odometer_init(&o, 0);
+  CHECK_EQ(odometer_update(&o, ticks, PERIMETER), 0); // the first sample only syncs
+
+  srand(5);
+  while (turns * PERIMETER < 1000ULL * 1000 * 1000) {
+    uint32_t t = rand() % 4;
+    turns += t;
+    ticks += t;
+    steps += odometer_update(&o, ticks, PERIMETER);
+  }
+
+  CHECK_EQ(steps, turns * PERIMETER / ODOMETER_MM_PER_STEP);
+  CHECK_EQ(odometer_remainder_mm(&o), turns * PERIMETER % ODOMETER_MM_PER_STEP);
+}
+
+static void wrap(void)
+{
+  odometer_init(&o, 0);
+  odometer_update(&o, ODOMETER_TICK_MASK - 20, PERIMETER);
+
+  // Across the 24 bit wrap counts normally, as do bits above 24 the caller didn't mask
+  uint32_t steps = odometer_update(&o, 30, PERIMETER);
+  CHECK_EQ(steps, 51 * PERIMETER / ODOMETER_MM_PER_STEP);
+  CHECK_EQ(odometer_remainder_mm(&o), 51 * PERIMETER % ODOMETER_MM_PER_STEP);
+  CHECK_EQ(odometer_update(&o, 0x1000000 + 40, PERIMETER), 0);
+  CHECK_EQ(odometer_remainder_mm(&o), 61 * PERIMETER % ODOMETER_MM_PER_STEP);
+}
+
+static void controller_reset(void)
+{
+  odometer_init(&o, 0);
+  odometer_update(&o, 50000, PERIMETER);
+
+  // Back to a small count: the controller restarted and this is the distance since
+  CHECK_EQ(odometer_update(&o, 5, PERIMETER), 0);
+  CHECK_EQ(odometer_remainder_mm(&o), 5 * PERIMETER);
+
+  // A jump no wheel can make in 100ms is not trusted, we just follow it
+  CHECK_EQ(odometer_update(&o, 5 + ODOMETER_MAX_TICKS + 1, PERIMETER), 0);
+  CHECK_EQ(odometer_remainder_mm(&o), 5 * PERIMETER);
+  CHECK_EQ(odometer_update(&o, 5 + ODOMETER_MAX_TICKS + 3, PERIMETER), 0);
+  CHECK_EQ(odometer_remainder_mm(&o), 7 * PERIMETER);
+
+  // The largest trusted jump is counted
+  CHECK_EQ(odometer_update(&o, 5 + 2 * ODOMETER_MAX_TICKS + 3, PERIMETER), 1);
+  CHECK_EQ(odometer_remainder_mm(&o), (7 + ODOMETER_MAX_TICKS) * PERIMETER - ODOMETER_MM_PER_STEP);
+}
+
+static void resync_and_restore(void)
+{
+  // The remainder saved at power off is carried on, a bad one is dropped
+  odometer_init(&o, 99000);
+  odometer_update(&o, 700, PERIMETER);
+  CHECK_EQ(odometer_update(&o, 701, PERIMETER), 1);
+  CHECK_EQ(odometer_remainder_mm(&o), 1100);
+
+  odometer_init(&o, ODOMETER_MM_PER_STEP);
+  CHECK_EQ(odometer_remainder_mm(&o), 0);
+
+  // After a resync the next count is only taken as the new reference
+  odometer_init(&o, 0);
+  odometer_update(&o, 100, PERIMETER);
+  odometer_update(&o, 110, PERIMETER);
+  odometer_resync(&o);
+  CHECK_EQ(odometer_update(&o, 120, PERIMETER), 0);
+  CHECK_EQ(odometer_remainder_mm(&o), 10 * PERIMETER);
+  odometer_update(&o, 121, PERIMETER);
+  CHECK_EQ(odometer_remainder_mm(&o), 11 * PERIMETER);
+
+  // The biggest perimeter over the biggest jump doesn't overflow
+  odometer_init(&o, ODOMETER_MM_PER_STEP - 1);
+  odometer_update(&o, 0, UINT16_MAX);
+  CHECK_EQ(odometer_update(&o, ODOMETER_MAX_TICKS, UINT16_MAX),
+      (ODOMETER_MM_PER_STEP - 1 + ODOMETER_MAX_TICKS * UINT16_MAX) / ODOMETER_MM_PER_STEP);
+}
+
+int main(void)
+{
+  long_ride();
+  wrap();
+  controller_reset();
+  resync_and_restore();
+  TEST_DONE();
+}
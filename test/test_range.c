@@ -0,0 +1,139 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "range.h"
+#include "test.h"
+
+static range_t r;
+
+// The running window sums always equal a plain sum over the last steps
+static void windows(void)
+{
+  static uint16_t steps[5000];
+  uint32_t wh = 500;
+
+  srand(3);
+  range_reset(&r, wh);
+  for (int i = 0; i < 5000; i++) {
+    steps[i] = rand() % 40;
+    wh += steps[i];
+    range_step(&r, wh, i < 2500 ? 2 : 3);
+
+    uint32_t shortSum = 0, longSum = 0;
+    for (int k = 0; k < RANGE_SHORT_STEPS && k <= i; k++)
+      shortSum += steps[i - k];
+    for (int k = 0; k < RANGE_LONG_STEPS && k <= i; k++)
+      longSum += steps[i - k];
+
+    if (r.short_wh_x10 != shortSum || r.long_wh_x10 != longSum) {
+      CHECK_EQ(r.short_wh_x10, shortSum);
+      CHECK_EQ(r.long_wh_x10, longSum);
+      break;
+    }
+  }
+
+  CHECK_EQ(r.trip_wh_x10, wh - 500);
+  CHECK_EQ(r.trip_steps, 5000);
+  CHECK_EQ(r.level_steps[2] + r.level_steps[3], 5000);
+}
+
+static void efficiency(void)
+{
+  // 1km of 1Wh per 100m, then 9km at 2Wh per 100m
+  uint32_t wh = 0;
+  range_reset(&r, 0);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_SHORT), 0);
+
+  for (int i = 0; i < 10; i++)
+    range_step(&r, wh += 10, 1);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_SHORT), 100);
+
+  for (int i = 0; i < 90; i++)
+    range_step(&r, wh += 20, 1);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_SHORT), 200);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_LONG), 190);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_TRIP), 190);
+
+  // Once the first km has left the 10km window only the trip remembers it
+  range_step(&r, wh += 20, 1);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_LONG), 191);
+  for (int i = 0; i < 9; i++)
+    range_step(&r, wh += 20, 1);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_LONG), 200);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_TRIP), 190);
+
+  // A few steps into a new trip the short window averages what it has
+  range_reset(&r, wh);
+  range_step(&r, wh += 15, 1);
+  range_step(&r, wh += 25, 1);
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_SHORT), 200);
+}
+
+static void range(void)
+{
+  uint32_t wh = 0;
+
+  range_reset(&r, 0);
+  CHECK_EQ(range_km_x10(&r, 3000, 1), 0); // not moved yet
+
+  // Less than 1km: the trip so far
+  for (int i = 0; i < 5; i++)
+    range_step(&r, wh += 20, 1);
+  CHECK_EQ(range_km_x10(&r, 3000, 1), 150); // 300Wh at 20Wh/km
+
+  // Level 1 has 1km now: its own efficiency
+  for (int i = 0; i < 5; i++)
+    range_step(&r, wh += 20, 1);
+  CHECK_EQ(range_km_x10(&r, 3000, 1), 150);
+
+  // Level 4 hasn't got 1km yet: the 10km window
+  for (int i = 0; i < 5; i++)
+    range_step(&r, wh += 40, 4);
+  CHECK_EQ(range_km_x10(&r, 3000, 4), 112); // 15 steps, 300 units: 300Wh / 26.7Wh/km
+  CHECK_EQ(range_km_x10(&r, 3000, 1), 150);
+
+  for (int i = 0; i < 5; i++)
+    range_step(&r, wh += 40, 4);
+  CHECK_EQ(range_km_x10(&r, 3000, 4), 75); // 300Wh at 40Wh/km
+
+  // Unknown levels use the window too
+  CHECK_EQ(range_km_x10(&r, 3000, RANGE_LEVELS), 100);
+
+  // Coasting: nothing used, so the range is capped
+  range_reset(&r, wh);
+  for (int i = 0; i < 20; i++)
+    range_step(&r, wh, 2);
+  CHECK_EQ(range_km_x10(&r, 3000, 2), RANGE_MAX_KM_X10);
+
+  // And a big battery at low use is capped as well
+  range_reset(&r, wh);
+  for (int i = 0; i < 20; i++)
+    range_step(&r, wh += 1, 2);
+  CHECK_EQ(range_km_x10(&r, 100000, 2), RANGE_MAX_KM_X10);
+}
+
+// A step bigger than the 16 bit ring entries (i.e. energy reset under us) is clamped, the sums stay consistent
+static void clamp(void)
+{
+  range_reset(&r, 1000);
+  range_step(&r, 500, 1);
+  CHECK_EQ(r.steps_wh_x10[0], UINT16_MAX);
+
+  for (int i = 0; i < RANGE_LONG_STEPS; i++)
+    range_step(&r, 500 + i, 1);
+  CHECK_EQ(r.short_wh_x10, RANGE_SHORT_STEPS); // steps of 0, 1, 1 ...
+  CHECK_EQ(r.long_wh_x10, RANGE_LONG_STEPS - 1); // the clamped step has left the window
+  CHECK_EQ(range_wh_per_km_x10(&r, RANGE_TRIP), (UINT16_MAX + RANGE_LONG_STEPS - 1) * 10 / (RANGE_LONG_STEPS + 1));
+}
+
+int main(void)
+{
+  windows();
+  efficiency();
+  range();
+  clamp();
+  TEST_DONE();
+}
@@ -0,0 +1,217 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "screen.h"
+#include "fonts.h"
+#include "fake_lcd.h"
+#include "test.h"
+
+// The bands and two bodies of the main and info screens (mainscreen.c), with fixed values
+static uint8_t assist = 3;
+static uint16_t maxPower = 250, speed = 234;
+
+static Field batteryField = FIELD_DRAWTEXT_BUF();
+static Field socField = FIELD_DRAWTEXT_BUF();
+static Field warnField = FIELD_DRAWTEXT_BUF();
+static Field assistField = FIELD_READONLY_UINT("Assist", &assist, "");
+static Field maxPowerField = FIELD_READONLY_UINT("Motor Pwr", &maxPower, "W");
+static Field speedField = FIELD_READONLY_UINT("Speed", &speed, "kph", .div_digits = 1, .hide_fraction = true);
+static Field tempField = FIELD_DRAWTEXT_BUF();
+static Field humanField = FIELD_DRAWTEXT_BUF();
+static Field tripField = FIELD_DRAWTEXT_BUF();
+static Field odoField = FIELD_DRAWTEXT_BUF();
+
+#define HEADER_HEIGHT 12
+#define FOOTER_Y 114
+
+#define BATTERY_BAR { \
+    .y = 0, .height = HEADER_HEIGHT, \
+    .fields = { \
+    { .x = 0, .y = 0, .width = -1, .height = -1, .field = &batteryField, .font = &MY_FONT_BATTERY }, \
+    { .x = 32, .y = 0, .width = -5, .height = -1, .field = &socField, .font = &FONT_5X12 }, \
+    { .field = NULL } } \
+}
+
+#define STATUS_BAR { \
+    .y = FOOTER_Y, .height = SCREEN_HEIGHT - FOOTER_Y, \
+    .fields = { \
+    { .x = 4, .y = FOOTER_Y, .width = 0, .height = -1, .field = &warnField, .font = &FONT_5X12 }, \
+    { .field = NULL } } \
+}
+
+#define MAIN_BODY { \
+    { .x = 0, .y = -1, .width = 0, .height = -1, .field = &assistField, .font = &MY_FONT_NUM_24X40, \
+      .modifier = ModNoLabel, .border = BorderBottom }, \
+    { .x = 0, .y = -3, .width = 0, .height = 19, .field = &maxPowerField, .font = &MY_FONT_NUM_10X16, \
+      .modifier = ModNoLabel, .border = BorderBottom }, \
+    { .x = 0, .y = -3, .width = 0, .height = -1, .field = &speedField, .font = &MY_FONT_NUM_24X40, \
+      .modifier = ModNoLabel }, \
+    { .field = NULL } }
+
+#define INFO_LINE(f) { .x = 0, .y = -1, .width = 0, .height = -1, .field = &f, .font = &FONT_5X12, \
+    .modifier = ModNoLabel, .border = BorderBottom }
+
+#define INFO_BODY { INFO_LINE(tempField), INFO_LINE(humanField), INFO_LINE(tripField), INFO_LINE(odoField), \
+    { .field = NULL } }
+
+// Shared bands, like mainscreen.c
+static const Subscreen batteryBar = BATTERY_BAR, statusBar = STATUS_BAR;
+static const Screen mainScreen = { .header = &batteryBar, .footer = &statusBar, .fields = MAIN_BODY };
+static const Screen infoScreen = { .header = &batteryBar, .footer = &statusBar, .fields = INFO_BODY };
+
+// The same screens with bands of their own, so a switch draws everything like before the bands were shared
+static const Subscreen mainBattery = BATTERY_BAR, mainStatus = STATUS_BAR, infoBattery = BATTERY_BAR,
+    infoStatus = STATUS_BAR;
+static const Screen ownMainScreen = { .header = &mainBattery, .footer = &mainStatus, .fields = MAIN_BODY };
+static const Screen ownInfoScreen = { .header = &infoBattery, .footer = &infoStatus, .fields = INFO_BODY };
+
+// Only the status bar, like the graph screen
+static Field titleField = FIELD_DRAWTEXT(.msg = "Motor power");
+static const Screen footerOnlyScreen = { .footer = &statusBar, .fields = {
+    { .x = 0, .y = 0, .width = 0, .height = -1, .field = &titleField, .font = &FONT_5X12, .border = BorderBottom },
+    { .field = NULL } } };
+
+// Nothing at all, shown before a screen is drawn from scratch
+static const Screen blankScreen = { .fields = { { .field = NULL } } };
+
+static void fill_fields(void)
+{
+  fieldPrintf(&batteryField, "%c", 0x34);
+  fieldPrintf(&socField, "%u%%", 82);
+  fieldPrintf(&warnField, "");
+  fieldPrintf(&tempField, "Motor %uC", 41);
+  fieldPrintf(&humanField, "Human %uW", 120);
+  fieldPrintf(&tripField, "Trip %u.%ukm", 12, 3);
+  fieldPrintf(&odoField, "Odo %ukm", 2301);
+}
+
+// Show a screen and draw it, with the counts of just that frame
+static void show(const Screen *screen)
+{
+  screenShow(screen);
+  fake_lcd_clear_counts();
+  screenUpdate();
+}
+
+// Start over on a blank display, so the screen is drawn in full
+static void start(const Screen *screen)
+{
+  show(&blankScreen);
+  fake_lcd_init();
+  show(screen);
+}
+
+// True if the display shows what drawing the current screen from scratch on a blank display gives
+static bool same_as_fresh(void)
+{
+  const Screen *screen = getCurrentScreen();
+  uint8_t shown[FAKE_LCD_PAGES][SCREEN_WIDTH];
+  memcpy(shown, fake_lcd_fb, sizeof(shown));
+  fake_lcd_counts_t counts = fake_lcd_counts;
+
+  start(screen);
+  bool same = memcmp(shown, fake_lcd_fb, sizeof(shown)) == 0;
+
+  // put back what we had
+  memcpy(fake_lcd_fb, shown, sizeof(shown));
+  fake_lcd_counts = counts;
+  return same;
+}
+
+// Switch back and forth between two screens, return the counts of one round trip (there and back)
+static fake_lcd_counts_t switch_cost(const Screen *a, const Screen *b, bool sharedBands)
+{
+  fake_lcd_counts_t trips[4] = { { 0 } };
+
+  start(a);
+  for (int i = 0; i < 8; i++) {
+    show(i % 2 ? a : b);
+    CHECK_EQ(fake_lcd_counts.refreshes, 1);
+    CHECK_EQ(fake_lcd_counts.spi_bytes, fake_lcd_counts.pages * FAKE_LCD_PAGE_BYTES);
+    if (sharedBands) // the speed box of the main screen ends on the first row of the status bar, so only check the battery bar
+      CHECK_EQ(fake_lcd_pixels_in_rows(0, HEADER_HEIGHT), 0);
+    CHECK(same_as_fresh());
+
+    fake_lcd_counts_t *t = &trips[i / 2];
+    t->pixels += fake_lcd_counts.pixels;
+    t->pages += fake_lcd_counts.pages;
+    t->spi_bytes += fake_lcd_counts.spi_bytes;
+    t->sent_pages |= fake_lcd_counts.sent_pages;
+  }
+
+  // every trip costs the same
+  for (int i = 1; i < 4; i++) {
+    CHECK_EQ(trips[i].pixels, trips[0].pixels);
+    CHECK_EQ(trips[i].sent_pages, trips[0].sent_pages);
+  }
+
+  return trips[0];
+}
+
+// Switching between screens that share both bands leaves the bands alone
+static void shared_bands(void)
+{
+  fake_lcd_counts_t own = switch_cost(&ownMainScreen, &ownInfoScreen, false);
+  CHECK_EQ(own.sent_pages, 0xffff);
+  CHECK_EQ(own.spi_bytes, 2 * 1072);
+
+  // Only pages 1 to 14 are sent, the battery bar ends in page 1 and the status bar starts in page 14
+  fake_lcd_counts_t shared = switch_cost(&mainScreen, &infoScreen, true);
+  CHECK_EQ(shared.sent_pages, 0x7ffe);
+  CHECK_EQ(shared.spi_bytes, 2 * 938);
+
+  // The saving is the two bands, which are otherwise cleared and drawn again on every switch
+  CHECK_EQ(own.pixels, 13648 + 16966);
+  CHECK_EQ(shared.pixels, 10370 + 13688);
+  printf("pixels per switch: %u with own bands, %u with shared bands\n", (unsigned) own.pixels / 2,
+      (unsigned) shared.pixels / 2);
+}
+
+// A band field that changed while another screen was shown is still drawn, just that field
+static void shared_band_changed(void)
+{
+  start(&mainScreen);
+  fieldPrintf(&socField, "%u%%", 81);
+  show(&infoScreen);
+
+  CHECK(fake_lcd_pixels_in_rows(0, HEADER_HEIGHT) > 0);
+  CHECK_EQ(fake_lcd_pixels_in_rows(FOOTER_Y, SCREEN_HEIGHT - FOOTER_Y), 0);
+  CHECK(same_as_fresh());
+
+  // Nothing changed, nothing is drawn
+  fake_lcd_clear_counts();
+  screenUpdate();
+  CHECK_EQ(fake_lcd_counts.pixels, 0);
+  CHECK_EQ(fake_lcd_counts.refreshes, 0);
+
+  fieldPrintf(&socField, "%u%%", 82);
+}
+
+// A screen without the battery bar clears it, so it is drawn in full when it comes back
+static void band_left_out(void)
+{
+  start(&mainScreen);
+  show(&footerOnlyScreen);
+  CHECK_EQ(fake_lcd_pixels_in_rows(FOOTER_Y, SCREEN_HEIGHT - FOOTER_Y), 0);
+  CHECK(fake_lcd_pixels_in_rows(0, HEADER_HEIGHT) > 0);
+
+  show(&infoScreen);
+  CHECK(fake_lcd_pixels_in_rows(0, HEADER_HEIGHT) >= HEADER_HEIGHT * SCREEN_WIDTH); // cleared and drawn
+  CHECK_EQ(fake_lcd_pixels_in_rows(FOOTER_Y, SCREEN_HEIGHT - FOOTER_Y), 0);
+  CHECK_EQ(fake_lcd_counts.sent_pages, 0x7fff);
+  CHECK(same_as_fresh());
+}
+
+int main(void)
+{
+  fake_lcd_init();
+  fill_fields();
+  shared_bands();
+  shared_band_changed();
+  band_left_out();
+  TEST_DONE();
+}
@@ -0,0 +1,136 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "screen.h"
+#include "fonts.h"
+#include "fake_lcd.h"
+#include "test.h"
+
+// fieldIsRendered() and the per field count of layouts behind it, as the screens switch
+static Field socField = FIELD_DRAWTEXT_BUF();
+static Field warnField = FIELD_DRAWTEXT_BUF();
+static Field tripField = FIELD_DRAWTEXT_BUF();
+static Field odoField = FIELD_DRAWTEXT_BUF();
+
+static const Subscreen batteryBar = { .y = 0, .height = 12, .fields = {
+    { .x = 32, .y = 0, .width = -5, .height = -1, .field = &socField, .font = &FONT_5X12 },
+    { .field = NULL } } };
+
+static const Subscreen statusBar = { .y = 114, .height = 14, .fields = {
+    { .x = 4, .y = 114, .width = 0, .height = -1, .field = &warnField, .font = &FONT_5X12 },
+    { .field = NULL } } };
+
+// The soc in the battery bar and again, bigger, in the body
+static const Screen socScreen = { .header = &batteryBar, .footer = &statusBar, .fields = {
+    { .x = 0, .y = -1, .width = 0, .height = -1, .field = &socField, .font = &MY_FONT_NUM_10X16, .modifier = ModNoLabel },
+    { .x = 0, .y = -1, .width = 0, .height = -1, .field = &tripField, .font = &FONT_5X12, .modifier = ModNoLabel },
+    { .field = NULL } } };
+
+static const Screen tripScreen = { .header = &batteryBar, .footer = &statusBar, .fields = {
+    { .x = 0, .y = -1, .width = 0, .height = -1, .field = &tripField, .font = &FONT_5X12, .modifier = ModNoLabel },
+    { .x = 0, .y = -1, .width = 0, .height = -1, .field = &odoField, .font = &FONT_5X12, .modifier = ModNoLabel },
+    { .field = NULL } } };
+
+// No battery bar, no soc
+static const Screen odoScreen = { .footer = &statusBar, .fields = {
+    { .x = 0, .y = 0, .width = 0, .height = -1, .field = &odoField, .font = &FONT_5X12, .modifier = ModNoLabel },
+    { .field = NULL } } };
+
+static void show(const Screen *screen)
+{
+  screenShow(screen);
+  fake_lcd_clear_counts();
+  screenUpdate();
+}
+
+static void check_counts(unsigned soc, unsigned warn, unsigned trip, unsigned odo)
+{
+  CHECK_EQ(socField.rendered, soc);
+  CHECK_EQ(warnField.rendered, warn);
+  CHECK_EQ(tripField.rendered, trip);
+  CHECK_EQ(odoField.rendered, odo);
+
+  CHECK_EQ(fieldIsRendered(&socField), soc != 0);
+  CHECK_EQ(fieldIsRendered(&warnField), warn != 0);
+  CHECK_EQ(fieldIsRendered(&tripField), trip != 0);
+  CHECK_EQ(fieldIsRendered(&odoField), odo != 0);
+}
+
+// A field in a band and in the body is counted once for each
+static void band_and_body(void)
+{
+  show(&socScreen);
+  check_counts(2, 1, 1, 0);
+}
+
+// Switching between screens that share the bands keeps the band fields rendered the whole time
+static void shared_bands(void)
+{
+  for (int i = 0; i < 4; i++) {
+    show(&tripScreen);
+    check_counts(1, 1, 1, 1);
+    show(&socScreen);
+    check_counts(2, 1, 1, 0);
+  }
+}
+
+// A field that leaves the screen isn't rendered, when it comes back it is again and shows what was set meanwhile
+static void leave_and_return(void)
+{
+  show(&odoScreen);
+  check_counts(0, 1, 0, 1);
+
+  // the producer skips it, but a value set anyway must not be drawn
+  fieldPrintf(&socField, "%u%%", 55);
+  fake_lcd_clear_counts();
+  screenUpdate();
+  CHECK_EQ(fake_lcd_counts.pixels, 0);
+  CHECK_EQ(fake_lcd_counts.refreshes, 0);
+
+  show(&tripScreen);
+  check_counts(1, 1, 1, 1);
+  CHECK(fake_lcd_pixels_in_rows(0, 12) > 0);
+
+  show(&odoScreen);
+  check_counts(0, 1, 0, 1);
+  show(&socScreen);
+  check_counts(2, 1, 1, 0);
+
+  // showing the same screen again doesn't count it twice
+  show(&socScreen);
+  check_counts(2, 1, 1, 0);
+}
+
+// As many layouts of one field as the 3 bit count holds
+#define SOC_LINE { .x = 0, .y = -1, .width = 0, .height = -1, .field = &socField, .font = &FONT_5X12, .modifier = ModNoLabel }
+
+static const Screen socTimesSevenScreen = { .fields = {
+    SOC_LINE, SOC_LINE, SOC_LINE, SOC_LINE, SOC_LINE, SOC_LINE, SOC_LINE, { .field = NULL } } };
+
+static void most_layouts(void)
+{
+  show(&socTimesSevenScreen);
+  check_counts(7, 0, 0, 0);
+  show(&socScreen);
+  check_counts(2, 1, 1, 0);
+}
+
+int main(void)
+{
+  fake_lcd_init();
+  fieldPrintf(&socField, "%u%%", 82);
+  fieldPrintf(&warnField, "");
+  fieldPrintf(&tripField, "Trip %u.%ukm", 12, 3);
+  fieldPrintf(&odoField, "Odo %ukm", 2301);
+
+  check_counts(0, 0, 0, 0);
+  band_and_body();
+  shared_bands();
+  leave_and_return();
+  most_layouts();
+  TEST_DONE();
+}
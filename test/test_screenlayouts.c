@@ -0,0 +1,110 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <time.h>
+#include "screen.h"
+#include "fonts.h"
+#include "fake_lcd.h"
+#include "test.h"
+
+// The layouts of a screen are resolved into a cache of MAX_RESOLVED_LAYOUTS entries when it is shown.  The real
+// screens can't be built here (SDK and ARM code), main.c checks them against the cache at boot.
+static uint16_t temp = 41, human = 120, trip = 123, odo = 23012, efficiency = 87, range = 412;
+
+static Field batteryField = FIELD_DRAWTEXT_BUF();
+static Field socField = FIELD_DRAWTEXT_BUF();
+static Field warnField = FIELD_DRAWTEXT_BUF();
+static Field tempField = FIELD_READONLY_UINT("Motor", &temp, "C");
+static Field humanField = FIELD_READONLY_UINT("Human Pwr", &human, "W");
+static Field tripField = FIELD_READONLY_UINT("Trip", &trip, "km", .div_digits = 1);
+static Field odoField = FIELD_READONLY_UINT("ODO", &odo, "km", .div_digits = 1);
+static Field efficiencyField = FIELD_READONLY_UINT("Wh/km", &efficiency, "Wh/km", .div_digits = 1);
+static Field rangeField = FIELD_READONLY_UINT("Range", &range, "km", .div_digits = 1);
+static Field fillField = { .variant = FieldFill }, otherFillField = { .variant = FieldFill };
+
+static const Subscreen batteryBar = { .y = 0, .height = 12, .fields = {
+    { .x = 0, .y = 0, .width = -1, .height = -1, .field = &batteryField, .font = &MY_FONT_BATTERY },
+    { .x = 32, .y = 0, .width = -5, .height = -1, .field = &socField, .font = &FONT_5X12 },
+    { .field = NULL } } };
+
+static const Subscreen statusBar = { .y = 114, .height = 14, .fields = {
+    { .x = 4, .y = 114, .width = 0, .height = -1, .field = &warnField, .font = &FONT_5X12 },
+    { .field = NULL } } };
+
+#define INFO_LINE(f) { .x = 0, .y = -1, .width = 0, .height = -1, .field = &f, .font = &FONT_5X12, \
+    .modifier = ModNoLabel, .border = BorderBottom }
+
+// The info screen of mainscreen.c, six editables between the bands
+static const Screen infoScreen = { .header = &batteryBar, .footer = &statusBar, .fields = {
+    INFO_LINE(tempField), INFO_LINE(humanField), INFO_LINE(tripField), INFO_LINE(odoField),
+    INFO_LINE(efficiencyField), INFO_LINE(rangeField), { .field = NULL } } };
+
+#define FILL_LINE(f) { .x = 0, .y = -1, .width = 0, .height = 8, .field = &f }
+
+// Exactly fills the cache: 3 + 11 + 2 (two fields, one field can be shown at most 7 times)
+static const Screen fullScreen = { .header = &batteryBar, .footer = &statusBar, .fields = {
+    FILL_LINE(fillField), FILL_LINE(otherFillField), FILL_LINE(fillField), FILL_LINE(otherFillField),
+    FILL_LINE(fillField), FILL_LINE(otherFillField), FILL_LINE(fillField), FILL_LINE(otherFillField),
+    FILL_LINE(fillField), FILL_LINE(otherFillField), { .field = NULL } } };
+
+static const Screen blankScreen = { .fields = { { .field = NULL } } };
+
+static void layout_counts(void)
+{
+  CHECK_EQ(screenLayoutCount(&blankScreen), 1);
+  CHECK_EQ(screenLayoutCount(&infoScreen), 3 + 7 + 2);
+  CHECK_EQ(screenLayoutCount(&fullScreen), MAX_RESOLVED_LAYOUTS);
+
+  // a full cache still shows, up to the last band field
+  screenShow(&fullScreen);
+  fake_lcd_clear_counts();
+  screenUpdate();
+  CHECK_EQ(fake_lcd_pixels_in_rows(12, 10 * 8), 2 * 10 * 8 * SCREEN_WIDTH); // cleared, then filled
+  CHECK_EQ(fieldIsRendered(&warnField), true);
+}
+
+// Once drawn, an idle frame of the info screen draws nothing, the editables leave their box and border alone
+static void idle_frame(void)
+{
+  screenShow(&blankScreen);
+  screenUpdate();
+  screenShow(&infoScreen);
+  fake_lcd_clear_counts();
+  screenUpdate();
+  CHECK(fake_lcd_counts.pixels > 0);
+
+  for (int i = 0; i < 20; i++) { // across a blink toggle too
+    fake_lcd_clear_counts();
+    screenUpdate();
+    CHECK_EQ(fake_lcd_counts.pixels, 0);
+    CHECK_EQ(fake_lcd_counts.refreshes, 0);
+  }
+
+  // a changed value draws just its line
+  odo++;
+  fake_lcd_clear_counts();
+  screenUpdate();
+  CHECK(fake_lcd_counts.pixels > 0);
+  CHECK_EQ(fake_lcd_counts.refreshes, 1);
+
+  const int reps = 100000;
+  clock_t start = clock();
+  for (int i = 0; i < reps; i++)
+    screenUpdate();
+  printf("idle info screen frame %.1f ns (host)\n", (double) (clock() - start) / CLOCKS_PER_SEC * 1e9 / reps);
+}
+
+int main(void)
+{
+  fake_lcd_init();
+  fieldPrintf(&batteryField, "%c", 0x34);
+  fieldPrintf(&socField, "%u%%", 82);
+  fieldPrintf(&warnField, "");
+
+  layout_counts();
+  idle_frame();
+  TEST_DONE();
+}
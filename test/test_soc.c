@@ -0,0 +1,159 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <math.h>
+#include <time.h>
+#include "soc.h"
+#include "test.h"
+
+// Same curves as src/common/soc.c, as cell volts
+static const double cellVolts[SOC_NUM_CHEMISTRIES][SOC_TABLE_POINTS] = {
+  [SOC_CHEMISTRY_LI_ION] = { 3.305, 3.384, 3.463, 3.542, 3.621, 3.699, 3.778, 3.857, 3.936, 4.015, 4.094 },
+  [SOC_CHEMISTRY_LIFEPO4] = { 2.500, 3.000, 3.200, 3.220, 3.250, 3.260, 3.270, 3.300, 3.320, 3.350, 3.400 },
+};
+
+// Exact interpolation of the curve, in percent
+static double reference(soc_chemistry_t chemistry, uint8_t cells, uint16_t pack_volts_x10)
+{
+  double v = pack_volts_x10 / 10.0 / cells;
+  const double *c = cellVolts[chemistry];
+
+  if (v <= c[0])
+    return 0;
+
+  for (int i = 1; i < SOC_TABLE_POINTS; i++)
+    if (v < c[i])
+      return (i - 1) * 10 + 10 * (v - c[i - 1]) / (c[i] - c[i - 1]);
+
+  return 100;
+}
+
+// The code this replaced: 10% buckets, reported as their middle
+static uint8_t old_soc(uint8_t cells, uint16_t pack_volts_x10)
+{
+  uint32_t cells_x10 = cells * 10;
+
+  for (int i = 9; i >= 0; i--)
+    if (pack_volts_x10 > (uint16_t) ((float) cells_x10 * (float) cellVolts[SOC_CHEMISTRY_LI_ION][i]))
+      return i * 10 + 5;
+
+  return 0;
+}
+
+static void accuracy(void)
+{
+  for (soc_chemistry_t chem = 0; chem < SOC_NUM_CHEMISTRIES; chem++)
+    for (uint8_t cells = 1; cells <= 20; cells++) {
+      soc_table_t t = { 0 };
+      soc_table_update(&t, chem, cells);
+
+      uint8_t prev = 0;
+      double maxErr = 0;
+      for (uint16_t v = 0; v <= cells * 45; v++) {
+        uint8_t soc = soc_from_voltage(&t, v);
+        double err = fabs(soc - reference(chem, cells, v));
+
+        if (err > maxErr)
+          maxErr = err;
+        CHECK(soc >= prev); // never goes down as the voltage goes up
+        prev = soc;
+      }
+
+      // Rounding to 1% gives up to 0.5%, scaling the table to pack volts x100 adds a little more
+      if (maxErr > 1.0) {
+        test_failures++;
+        printf("chemistry %d, %d cells: %.2f%% from the curve\n", chem, cells, maxErr);
+      }
+
+      CHECK_EQ(soc_from_voltage(&t, 0), 0);
+      CHECK_EQ(soc_from_voltage(&t, UINT16_MAX / 10), 100);
+    }
+}
+
+// For 7-14 cells Li-ion the new value always lies in the 10% bucket the old code reported
+static void matches_old(void)
+{
+  for (uint8_t cells = 7; cells <= 14; cells++) {
+    soc_table_t t = { 0 };
+    soc_table_update(&t, SOC_CHEMISTRY_LI_ION, cells);
+
+    for (uint16_t v = 0; v <= cells * 45; v++) {
+      uint8_t old = old_soc(cells, v), soc = soc_from_voltage(&t, v);
+
+      if (old == 0)
+        CHECK(soc <= 1);
+      else if (old == 95)
+        CHECK(soc >= 89);
+      else
+        CHECK(soc + 1 >= old - 5 && soc <= old + 5 + 1);
+    }
+  }
+
+  soc_table_t t = { 0 };
+  soc_table_update(&t, SOC_CHEMISTRY_LI_ION, 13);
+  CHECK_EQ(soc_from_voltage(&t, 429), 0); // 3.30 V per cell
+  CHECK_EQ(soc_from_voltage(&t, 480), 49); // 3.69 V
+  CHECK_EQ(soc_from_voltage(&t, 532), 100); // 4.09 V
+}
+
+static void table_update(void)
+{
+  soc_table_t t = { 0 };
+
+  soc_table_update(&t, SOC_CHEMISTRY_LI_ION, 13);
+  CHECK_EQ(t.pack_x100[0], 4297);
+  CHECK_EQ(t.pack_x100[SOC_TABLE_POINTS - 1], 5322);
+
+  // Changing either the cells or the chemistry rescales
+  soc_table_update(&t, SOC_CHEMISTRY_LI_ION, 10);
+  CHECK_EQ(t.pack_x100[0], 3305);
+  soc_table_update(&t, SOC_CHEMISTRY_LIFEPO4, 10);
+  CHECK_EQ(t.pack_x100[0], 2500);
+  CHECK_EQ(t.chemistry, SOC_CHEMISTRY_LIFEPO4);
+
+  // An unknown chemistry from a bad eeprom falls back to Li-ion
+  soc_table_update(&t, SOC_NUM_CHEMISTRIES, 10);
+  CHECK_EQ(t.pack_x100[0], 3305);
+  CHECK_EQ(t.chemistry, SOC_CHEMISTRY_LI_ION);
+
+  // and is then cached like a valid one, so the table isn't rebuilt on every call
+  t.pack_x100[0] = 0;
+  soc_table_update(&t, SOC_NUM_CHEMISTRIES, 10);
+  CHECK_EQ(t.pack_x100[0], 0);
+}
+
+// Host timing only, the M0 has no FPU so the old code is relatively much slower there
+static void benchmark(void)
+{
+  soc_table_t t = { 0 };
+  volatile uint32_t sink = 0;
+  const int reps = 20000;
+
+  soc_table_update(&t, SOC_CHEMISTRY_LI_ION, 13);
+
+  clock_t start = clock();
+  for (int r = 0; r < reps; r++)
+    for (uint16_t v = 400; v < 560; v++)
+      sink += soc_from_voltage(&t, v);
+  double newNs = (double) (clock() - start) / CLOCKS_PER_SEC * 1e9 / (reps * 160);
+
+  start = clock();
+  for (int r = 0; r < reps; r++)
+    for (uint16_t v = 400; v < 560; v++)
+      sink += old_soc(13, v);
+  double oldNs = (double) (clock() - start) / CLOCKS_PER_SEC * 1e9 / (reps * 160);
+
+  printf("soc_from_voltage %.1f ns, old float buckets %.1f ns per call (host)\n", newNs, oldNs);
+}
+
+int main(void)
+{
+  accuracy();
+  matches_old();
+  table_update();
+  benchmark();
+  TEST_DONE();
+}
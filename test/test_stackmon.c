@@ -0,0 +1,139 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "stackmon.h"
+#include "test.h"
+
+// A fake stack: index 0 is the limit, the stack grows down from the top
+#define WORDS 256
+
+static uint32_t stack[WORDS];
+static stackmon_t m;
+
+static void fill(uint32_t used)
+{
+  for (uint32_t i = 0; i < WORDS; i++)
+    stack[i] = i < WORDS - used ? STACKMON_FILL : i;
+}
+
+// What a full scan of the whole stack would report
+static uint32_t reference_unused(void)
+{
+  uint32_t i = 0;
+  while (i < WORDS && stack[i] == STACKMON_FILL)
+    i++;
+  return i;
+}
+
+// Each check looks at no more than two windows, so this many checks must find anything
+#define FULL_SWEEP_CHECKS (WORDS / STACKMON_WINDOW_WORDS + 1)
+
+static void initial_scan(void)
+{
+  fill(40);
+  stackmon_init(&m, stack, WORDS);
+  CHECK_EQ(m.unused, WORDS - 40);
+  CHECK_EQ(stackmon_unused_bytes(&m), (WORDS - 40) * 4);
+  CHECK(stackmon_canary_ok(&m));
+
+  // Nothing new used, nothing changes
+  for (int i = 0; i < 100; i++)
+    stackmon_check(&m);
+  CHECK_EQ(m.unused, WORDS - 40);
+}
+
+// A stack that grows a few words at a time is tracked on the very next check
+static void gradual_growth(void)
+{
+  fill(10);
+  stackmon_init(&m, stack, WORDS);
+
+  for (uint32_t used = 10; used < WORDS - STACKMON_CANARY_WORDS; used += 1 + used % STACKMON_WINDOW_WORDS) {
+    stack[WORDS - 1 - used] = 0;
+    stackmon_check(&m);
+    CHECK_EQ(m.unused, WORDS - 1 - used);
+  }
+  CHECK(stackmon_canary_ok(&m));
+}
+
+// A big local array can leave fill words between the old mark and its deepest word, the sweep finds it
+static void deep_skip(void)
+{
+  fill(20);
+  stackmon_init(&m, stack, WORDS);
+  stack[30] = 0;
+
+  int checks = 0;
+  while (m.unused != 30 && checks < 1000) {
+    stackmon_check(&m);
+    checks++;
+  }
+  CHECK_EQ(m.unused, 30);
+  CHECK(checks <= FULL_SWEEP_CHECKS);
+
+  // The mark only moves down, even if the pattern is restored
+  stack[30] = STACKMON_FILL;
+  stackmon_check(&m);
+  CHECK_EQ(m.unused, 30);
+}
+
+// Random writes: after a full sweep the mark always matches a full scan
+static void random_use(void)
+{
+  srand(1);
+  for (int rep = 0; rep < 200; rep++) {
+    fill(rand() % 64);
+    stackmon_init(&m, stack, WORDS);
+    CHECK_EQ(m.unused, reference_unused());
+
+    for (int burst = 0; burst < 5; burst++) {
+      int writes = rand() % 4;
+      for (int w = 0; w < writes; w++)
+        stack[STACKMON_CANARY_WORDS + rand() % (WORDS - STACKMON_CANARY_WORDS)] = 0;
+
+      for (int i = 0; i < FULL_SWEEP_CHECKS; i++)
+        stackmon_check(&m);
+      CHECK_EQ(m.unused, reference_unused());
+    }
+    CHECK(stackmon_canary_ok(&m));
+  }
+}
+
+static void canary(void)
+{
+  fill(40);
+  stackmon_init(&m, stack, WORDS);
+  stack[STACKMON_CANARY_WORDS] = 0; // just above the guard is still fine
+  CHECK(stackmon_canary_ok(&m));
+  stack[STACKMON_CANARY_WORDS - 1] = 0;
+  CHECK(!stackmon_canary_ok(&m));
+  fill(40);
+  stack[0] = 0;
+  CHECK(!stackmon_canary_ok(&m));
+
+  // A stack smaller than the guard doesn't read past its end
+  uint32_t tiny[1] = { STACKMON_FILL };
+  stackmon_init(&m, tiny, 1);
+  CHECK(stackmon_canary_ok(&m));
+  stackmon_check(&m);
+  CHECK_EQ(stackmon_unused_bytes(&m), 4);
+
+  // A stack that is full from the limit up
+  fill(WORDS);
+  stackmon_init(&m, stack, WORDS);
+  stackmon_check(&m);
+  CHECK_EQ(m.unused, 0);
+}
+
+int main(void)
+{
+  initial_scan();
+  gradual_growth();
+  deep_skip();
+  random_use();
+  canary();
+  TEST_DONE();
+}
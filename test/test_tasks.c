@@ -0,0 +1,207 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include <string.h>
+#include "tasks.h"
+#include "test.h"
+
+// Fake clocks: tasks move them forward to pretend they took time
+static uint32_t msecs, ticks;
+
+static uint32_t get_msecs(void)
+{
+  return msecs;
+}
+
+static uint32_t get_ticks(void)
+{
+  return ticks & 0xffffff;
+}
+
+// The order tasks ran in, one letter per run
+static char trace[256];
+static int traced;
+
+static void note(char c)
+{
+  if (traced < (int) sizeof(trace) - 1)
+    trace[traced++] = c;
+  trace[traced] = '\0';
+}
+
+static void clear_trace(void)
+{
+  traced = 0;
+  trace[0] = '\0';
+}
+
+static uint32_t slowTicks, slowMsecs;
+
+static void fast(void) { note('f'); ticks += 10; }
+static void slow(void) { note('s'); ticks += slowTicks; msecs += slowMsecs; }
+static void other(void) { note('o'); }
+static void late(void) { note('l'); }
+
+// Calls tasks_run() once per 20 ms tick until end
+static void run_until(uint32_t end)
+{
+  while ((int32_t) (end - msecs) > 0) {
+    tasks_run();
+    note('|');
+    msecs += 20;
+  }
+}
+
+static void order_and_phase(void)
+{
+  // Listed out of priority order on purpose
+  task_t t[] = {
+    TASK("other", other, 100, 40, 5, 0),
+    TASK("fast", fast, 20, 0, 0, 0),
+    TASK("late", late, 100, 40, 5, 0),
+    TASK("slow", slow, 100, 0, 1, 0),
+  };
+
+  msecs = 0;
+  slowTicks = slowMsecs = 0;
+  tasks_init(t, 4, get_msecs, get_ticks, 0xffffff);
+  CHECK_EQ(tasks_count(), 4);
+  CHECK(strcmp(tasks_get(0)->name, "fast") == 0);
+  CHECK(strcmp(tasks_get(1)->name, "slow") == 0);
+  CHECK(strcmp(tasks_get(2)->name, "other") == 0); // equal priorities keep their order
+  CHECK(tasks_get(4) == NULL);
+
+  // The two phase 40 tasks land two ticks after slow, never on the same tick
+  clear_trace();
+  run_until(200);
+  CHECK(strcmp(trace, "fs|f|fol|f|f|fs|f|fol|f|f|") == 0);
+  CHECK_EQ(tasks_find("fast")->runs, 10);
+  CHECK_EQ(tasks_find("other")->runs, 2);
+  CHECK(tasks_find("nope") == NULL);
+  CHECK_EQ(tasks_total_missed(), 0);
+}
+
+static void stats(void)
+{
+  task_t t[] = {
+    TASK("fast", fast, 20, 0, 0, 5),
+    TASK("slow", slow, 100, 0, 1, 50),
+  };
+
+  msecs = 1000;
+  ticks = 0xffffff - 30; // the tick counter wraps during the test
+  slowMsecs = 0;
+  tasks_init(t, 2, get_msecs, get_ticks, 0xffffff);
+
+  for (int i = 0; i < 10; i++) {
+    slowTicks = i < 5 ? 40 : 70;
+    tasks_run();
+    msecs += 100;
+  }
+
+  const task_t *f = tasks_find("fast"), *s = tasks_find("slow");
+  CHECK_EQ(f->runs, 10);
+  CHECK_EQ(f->max_ticks, 10);
+  CHECK_EQ(tasks_avg_ticks(f), 10);
+  CHECK_EQ(f->overruns, 10); // over its budget of 5 every time
+  CHECK_EQ(f->missed, 36); // only polled every 100 ms, so 4 of its 5 periods were dropped each time after the first
+  CHECK_EQ(s->runs, 10);
+  CHECK_EQ(s->max_ticks, 70);
+  CHECK_EQ(tasks_avg_ticks(s), 55);
+  CHECK_EQ(s->overruns, 5);
+  CHECK_EQ(s->missed, 0);
+  CHECK_EQ(tasks_total_missed(), 36);
+
+  tasks_clear_stats();
+  CHECK_EQ(s->runs, 0);
+  CHECK_EQ(tasks_avg_ticks(s), 0);
+  CHECK_EQ(tasks_total_missed(), 0);
+}
+
+static void slow_task(void)
+{
+  task_t t[] = {
+    TASK("fast", fast, 20, 0, 0, 0),
+    TASK("slow", slow, 100, 0, 1, 0),
+    TASK("other", other, 20, 0, 2, 0),
+  };
+
+  msecs = 0;
+  slowTicks = 0;
+  slowMsecs = 50;
+  tasks_init(t, 3, get_msecs, get_ticks, 0xffffff);
+
+  // slow takes 50 ms: fast became due meanwhile but runs only once per call, other runs late and skips the
+  // periods it missed instead of running them all
+  clear_trace();
+  CHECK_EQ(tasks_run(), 3);
+  CHECK(strcmp(trace, "fso") == 0);
+  CHECK_EQ(tasks_find("fast")->missed, 0);
+  CHECK_EQ(tasks_find("other")->missed, 2);
+  CHECK_EQ(tasks_find("other")->next_due, 60);
+
+  // The next call catches fast up, its 20 ms slot is dropped
+  clear_trace();
+  CHECK_EQ(tasks_run(), 1);
+  CHECK(strcmp(trace, "f") == 0);
+  CHECK_EQ(tasks_find("fast")->missed, 1);
+
+  // And stay on their own grid afterwards
+  CHECK_EQ(tasks_find("fast")->next_due, 60);
+  CHECK_EQ(tasks_find("slow")->next_due, 100);
+}
+
+static void resync(void)
+{
+  task_t t[] = {
+    TASK("fast", fast, 20, 0, 0, 0),
+    TASK("other", other, 100, 40, 1, 0),
+  };
+
+  msecs = 0;
+  tasks_init(t, 2, get_msecs, get_ticks, 0xffffff);
+  tasks_run();
+
+  // Slowed down on purpose: after a resync everything runs once without counting misses
+  msecs = 1030;
+  tasks_resync();
+  clear_trace();
+  CHECK_EQ(tasks_run(), 2);
+  CHECK(strcmp(trace, "fo") == 0);
+  CHECK_EQ(tasks_total_missed(), 0);
+  CHECK_EQ(tasks_find("fast")->next_due, 1040);
+  CHECK_EQ(tasks_find("other")->next_due, 1040); // still on its 40 ms phase
+
+  // Nothing is due again before its slot
+  msecs = 1039;
+  CHECK_EQ(tasks_run(), 0);
+}
+
+// The millisecond clock wraps after 49 days
+static void msec_wrap(void)
+{
+  task_t t[] = {
+    TASK("fast", fast, 20, 0, 0, 0),
+    TASK("other", other, 100, 0, 1, 0),
+  };
+
+  msecs = UINT32_MAX - 50;
+  tasks_init(t, 2, get_msecs, get_ticks, 0xffffff);
+  run_until(UINT32_MAX - 50 + 400);
+  CHECK_EQ(tasks_find("fast")->runs, 20);
+  CHECK_EQ(tasks_find("other")->runs, 4);
+  CHECK_EQ(tasks_total_missed(), 0);
+}
+
+int main(void)
+{
+  order_and_phase();
+  stats();
+  slow_task();
+  resync();
+  msec_wrap();
+  TEST_DONE();
+}
@@ -0,0 +1,102 @@
+/*
+ * Bafang LCD SW102 Bluetooth firmware
+ *
+ * Released under the GPL License, Version 3
+ */
+
+#include "tripstats.h"
+#include "test.h"
+
+static tripstats_t t;
+
+static void feed(tripstats_sample_t s, uint32_t samples)
+{
+  for (uint32_t i = 0; i < samples; i++)
+    tripstats_update(&t, &s);
+}
+
+static void ride(void)
+{
+  tripstats_reset(&t);
+  CHECK_EQ(tripstats_average(&t.speed_x10), 0);
+  CHECK_EQ(tripstats_moving_sec(&t), 0);
+
+  // 10 minutes at 20km/h in level 2, 5 minutes at 30km/h in level 4, 2 minutes stopped with the motor at 100W
+  feed((tripstats_sample_t) { .speed_x10 = 200, .motor_power = 150, .human_power = 100, .cadence = 70,
+      .assist_level = 2, .power_x50 = 150 * 50 }, 6000);
+  feed((tripstats_sample_t) { .speed_x10 = 300, .motor_power = 400, .human_power = 160, .cadence = 80,
+      .assist_level = 4, .power_x50 = 400 * 50 }, 3000);
+  feed((tripstats_sample_t) { .speed_x10 = 10, .motor_power = 100, .cadence = 0,
+      .assist_level = 4, .power_x50 = 100 * 50 }, 1200);
+
+  CHECK_EQ(tripstats_moving_sec(&t), 900);
+  CHECK_EQ(tripstats_average(&t.speed_x10), 233); // stops don't count
+  CHECK_EQ(t.max_speed_x10, 300);
+  CHECK_EQ(tripstats_average(&t.motor_power), 233);
+  CHECK_EQ(t.max_motor_power, 400);
+  CHECK_EQ(tripstats_average(&t.human_power), 120);
+  CHECK_EQ(tripstats_average(&t.cadence), 73);
+
+  CHECK_EQ(t.level_ds[2], 6000);
+  CHECK_EQ(t.level_ds[4], 3000);
+  CHECK_EQ(energy_wh_x10(&t.level_energy[2]), 250); // 150W for 10 minutes
+  CHECK_EQ(energy_wh_x10(&t.level_energy[4]), 366); // 400W for 5 minutes and 100W for 2, rounded down
+}
+
+static void coasting_and_levels(void)
+{
+  tripstats_reset(&t);
+
+  // Moving without pedalling: no cadence samples, so the cadence average is of pedalling only
+  feed((tripstats_sample_t) { .speed_x10 = 250, .cadence = 0, .assist_level = 0 }, 100);
+  feed((tripstats_sample_t) { .speed_x10 = 250, .cadence = 90, .assist_level = 0 }, 100);
+  CHECK_EQ(tripstats_average(&t.cadence), 90);
+  CHECK_EQ(tripstats_moving_sec(&t), 20);
+
+  // Exactly 2km/h is moving, below it isn't
+  feed((tripstats_sample_t) { .speed_x10 = TRIPSTATS_MOVING_SPEED_X10 }, 10);
+  feed((tripstats_sample_t) { .speed_x10 = TRIPSTATS_MOVING_SPEED_X10 - 1 }, 10);
+  CHECK_EQ(tripstats_moving_sec(&t), 21);
+
+  // Levels beyond the table are counted in the last one
+  feed((tripstats_sample_t) { .speed_x10 = 200, .assist_level = 200 }, 10);
+  CHECK_EQ(t.level_ds[TRIPSTATS_LEVELS - 1], 10);
+}
+
+// Averages are rounded to the nearest
+static void rounding(void)
+{
+  tripstats_avg_t a = { .sum = 5, .count = 2 };
+  CHECK_EQ(tripstats_average(&a), 3);
+  a.sum = 4;
+  a.count = 3;
+  CHECK_EQ(tripstats_average(&a), 1);
+}
+
+// Past the overflow guard the sums halve with their counts and the average is kept
+static void long_trip(void)
+{
+  tripstats_reset(&t);
+  t.motor_power.sum = TRIPSTATS_SUM_LIMIT - 500;
+  t.motor_power.count = (TRIPSTATS_SUM_LIMIT - 500) / 500;
+
+  feed((tripstats_sample_t) { .speed_x10 = 200, .motor_power = 500 }, 10);
+  CHECK(t.motor_power.sum < TRIPSTATS_SUM_LIMIT);
+  CHECK_EQ(tripstats_average(&t.motor_power), 500);
+
+  // 60 hours at the highest power the motor reports never overflows
+  tripstats_reset(&t);
+  feed((tripstats_sample_t) { .speed_x10 = 999, .motor_power = UINT16_MAX }, 60UL * 36000);
+  CHECK(t.motor_power.sum <= TRIPSTATS_SUM_LIMIT + UINT16_MAX);
+  CHECK_EQ(tripstats_average(&t.motor_power), UINT16_MAX);
+  CHECK_EQ(tripstats_moving_sec(&t), 60UL * 3600);
+}
+
+int main(void)
+{
+  ride();
+  coasting_and_levels();
+  rounding();
+  long_trip();
+  TEST_DONE();
+}
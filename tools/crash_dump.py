@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+#
+# Bafang LCD SW102 Bluetooth firmware
+#
+# Released under the GPL License, Version 3
+#
+# Fetches the saved crash records over the BLE serial (Nordic UART) service
+# and prints them, with the code addresses symbolized against the firmware
+# ELF (using arm-none-eabi-addr2line).  See include/crashlog.h for the record
+# and packet format.  The firmware must be built with "make BLE_SERIAL=1".
+#
+# usage: crash_dump.py [--elf FILE] [--clear] [--save FILE | --load FILE] [device address or name]
+#   --elf FILE   firmware the crashes came from (default _build/nrf51822_sw102.out)
+#   --clear      erase the records on the display after the dump
+#   --save FILE  also write the raw records to FILE
+#   --load FILE  print records saved earlier instead of talking to a display
+#
+# (needs "pip install bleak" unless --load is used)
+
+import argparse
+import asyncio
+import os
+import struct
+import subprocess
+import sys
+
+NUS_RX = "6e400002-b5a3-f393-e0a9-e50e24dcca9e"  # we write commands here
+NUS_TX = "6e400003-b5a3-f393-e0a9-e50e24dcca9e"  # display sends notifications here
+
+STACK_WORDS = 16
+RECORD = struct.Struct("<19I12s%dI" % STACK_WORDS)
+FIELDS = ("magic seq id pc lr info file line r0 r1 r2 r3 r12 psr sp uptime_msec "
+          "uart_rx_ok uart_rx_bad stack_unused").split()
+
+FAULTS = {1: "softdevice", 2: "hardfault", 3: "nrf assert", 4: "stack overflow", 5: "missed tick",
+          6: "lost rx", 10: "gcc assert", 0x4001: "sdk error", 0x4002: "sdk assert"}
+
+
+class Dump:
+    def __init__(self):
+        self.records = {}
+        self.done = asyncio.Event()
+
+    def packet(self, pkt):
+        if pkt[0] == ord("C"):
+            buf = self.records.setdefault(pkt[1], bytearray(RECORD.size))
+            buf[pkt[2] * 4:pkt[2] * 4 + len(pkt) - 3] = pkt[3:]
+        elif pkt[0] == ord("E"):
+            self.done.set()
+
+
+def parse(raw):
+    values = RECORD.unpack(raw)
+    rec = dict(zip(FIELDS, values))
+    rec["version"] = values[len(FIELDS)].split(b"\0")[0].decode("ascii", "replace")
+    rec["stack"] = values[len(FIELDS) + 1:]
+    return rec
+
+
+class Elf:
+    """Just enough of an ELF32 reader to find the strings our file name pointers point at"""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, kind, flags, addr, offset, size = struct.unpack_from("<6I", self.data, shoff + i * shentsize)
+            if addr and kind != 8:  # SHT_NOBITS has nothing in the file
+                self.sections.append((addr, offset, size, flags & 4))  # SHF_EXECINSTR
+
+    def string(self, addr):
+        for start, offset, size, _ in self.sections:
+            if start <= addr < start + size:
+                end = self.data.index(b"\0", offset + addr - start)
+                return self.data[offset + addr - start:end].decode("ascii", "replace")
+        return None
+
+    def is_code(self, addr):
+        return any(start <= addr < start + size for start, _, size, code in self.sections if code)
+
+
+def symbolize(elf_path, addrs):
+    """Returns {addr: 'function at file:line'} using addr2line"""
+    addrs = sorted(set(a & ~1 for a in addrs))
+    if not addrs:
+        return {}
+    try:
+        out = subprocess.run(["arm-none-eabi-addr2line", "-f", "-p", "-C", "-e", elf_path] + ["0x%x" % a for a in addrs],
+                             capture_output=True, text=True, check=True).stdout.splitlines()
+    except (OSError, subprocess.CalledProcessError) as e:
+        print("warning: addr2line failed (%s), addresses are not symbolized" % e)
+        return {}
+    return dict(zip(addrs, out))
+
+
+def print_record(rec, elf, elf_path):
+    code = [rec["pc"], rec["lr"]]
+    if elf:
+        code += [w for w in rec["stack"] if w & 1 and elf.is_code(w & ~1)]  # thumb return addresses
+    syms = symbolize(elf_path, code) if elf else {}
+
+    def sym(addr):
+        s = syms.get(addr & ~1)
+        return "0x%08x %s" % (addr, s) if s else "0x%08x" % addr
+
+    print("crash #%d: %s (0x%x) after %.1fs, firmware %s" % (
+        rec["seq"], FAULTS.get(rec["id"], "fault"), rec["id"], rec["uptime_msec"] / 1000, rec["version"]))
+    if rec["file"]:
+        name = elf.string(rec["file"]) if elf else None
+        print("  at %s:%d" % (name or "0x%08x" % rec["file"], rec["line"]))
+    print("  info 0x%08x" % rec["info"])
+    print("  pc   " + sym(rec["pc"]))
+    print("  lr   " + sym(rec["lr"]))
+    if rec["id"] == 2:
+        print("  r0 %08x r1 %08x r2 %08x r3 %08x r12 %08x psr %08x" % tuple(rec[r] for r in "r0 r1 r2 r3 r12 psr".split()))
+    print("  uart rx %d ok / %d bad, %d bytes of stack never used" % (rec["uart_rx_ok"], rec["uart_rx_bad"], rec["stack_unused"]))
+    print("  stack at 0x%08x:" % rec["sp"])
+    for i, w in enumerate(rec["stack"]):
+        print("    +%02x %s" % (i * 4, sym(w) if (w & ~1) in syms else "0x%08x" % w))
+
+
+async def fetch(args):
+    from bleak import BleakClient, BleakScanner
+
+    device = args.device
+    if not device or ":" not in device:
+        device = await BleakScanner.find_device_by_name(device or "OS-EBike")
+        if device is None:
+            sys.exit("display not found")
+
+    dump = Dump()
+    async with BleakClient(device) as client:
+        await client.start_notify(NUS_TX, lambda _, data: dump.packet(data))
+        await client.write_gatt_char(NUS_RX, b"C")
+        await asyncio.wait_for(dump.done.wait(), 30)
+        if args.clear:
+            await client.write_gatt_char(NUS_RX, b"CC")
+
+    return [bytes(dump.records[i]) for i in sorted(dump.records)]
+
+
+def main(args):
+    if args.load:
+        with open(args.load, "rb") as f:
+            data = f.read()
+        raws = [data[i:i + RECORD.size] for i in range(0, len(data) - RECORD.size + 1, RECORD.size)]
+    else:
+        raws = asyncio.run(fetch(args))
+        if args.save:
+            with open(args.save, "wb") as f:
+                f.write(b"".join(raws))
+
+    elf = Elf(args.elf) if os.path.exists(args.elf) else None
+    if not elf:
+        print("warning: %s not found, addresses are not symbolized" % args.elf)
+
+    records = sorted((parse(r) for r in raws), key=lambda r: r["seq"], reverse=True)
+    if not records:
+        print("no crashes saved")
+    for rec in records:
+        print_record(rec, elf, args.elf)
+        print()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Dump and symbolize the SW102 crash log over BLE")
+    parser.add_argument("--elf", default=os.path.join(os.path.dirname(__file__), "..", "_build", "nrf51822_sw102.out"))
+    parser.add_argument("--clear", action="store_true")
+    parser.add_argument("--save")
+    parser.add_argument("--load")
+    parser.add_argument("device", nargs="?")
+    main(parser.parse_args())
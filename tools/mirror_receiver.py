@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+#
+# Bafang LCD SW102 Bluetooth firmware
+#
+# Released under the GPL License, Version 3
+#
+# Shows a live copy of the SW102 display in a terminal, using the screen
+# mirroring packets sent over the BLE serial (Nordic UART) service.
+# The firmware must be built with "make BLE_SERIAL=1".
+# See include/mirror.h for the packet format.
+#
+# usage: mirror_receiver.py [device address or name]   (needs "pip install bleak")
+
+import asyncio
+import sys
+
+from bleak import BleakClient, BleakScanner
+
+NUS_RX = "6e400002-b5a3-f393-e0a9-e50e24dcca9e"  # we write commands here
+NUS_TX = "6e400003-b5a3-f393-e0a9-e50e24dcca9e"  # display sends notifications here
+
+PAGES = 16
+WIDTH = 64
+HDR_RLE = 0x10
+
+
+def decode(pkt, fb):
+    """Apply one mirror packet to fb (bytearray of PAGES * WIDTH), same rules as mirror_decode()"""
+    if len(pkt) < 2:
+        return False
+    page, col = pkt[0] & 0x0F, pkt[1]
+    base = page * WIDTH
+    if pkt[0] & HDR_RLE:
+        if len(pkt) & 1:
+            return False
+        for i in range(2, len(pkt), 2):
+            run, val = pkt[i], pkt[i + 1]
+            if run == 0 or col + run > WIDTH:
+                return False
+            fb[base + col:base + col + run] = bytes([val]) * run
+            col += run
+    else:
+        data = pkt[2:]
+        if col + len(data) > WIDTH:
+            return False
+        fb[base + col:base + col + len(data)] = data
+    return True
+
+
+def pixel(fb, x, y):
+    return (fb[(y // 8) * WIDTH + x] >> (y & 7)) & 1
+
+
+def render(fb):
+    # two display rows per text line using half block characters
+    chars = {(0, 0): " ", (1, 0): "▀", (0, 1): "▄", (1, 1): "█"}
+    lines = []
+    for y in range(0, PAGES * 8, 2):
+        lines.append("".join(chars[(pixel(fb, x, y), pixel(fb, x, y + 1))] for x in range(WIDTH)))
+    return "\x1b[H" + "\n".join(lines)
+
+
+async def main(target):
+    device = target
+    if not target or ":" not in target:
+        device = await BleakScanner.find_device_by_name(target or "OS-EBike")
+        if device is None:
+            sys.exit("display not found")
+
+    fb = bytearray(PAGES * WIDTH)
+    dirty = asyncio.Event()
+
+    def on_packet(_, data):
+        if decode(data, fb):
+            dirty.set()
+
+    async with BleakClient(device) as client:
+        await client.start_notify(NUS_TX, on_packet)
+        await client.write_gatt_char(NUS_RX, b"M1")
+        print("\x1b[2J", end="")
+        try:
+            while True:
+                await dirty.wait()
+                dirty.clear()
+                print(render(fb), end="", flush=True)
+        finally:
+            await client.write_gatt_char(NUS_RX, b"M0")
+
+
+if __name__ == "__main__":
+    try:
+        asyncio.run(main(sys.argv[1] if len(sys.argv) > 1 else None))
+    except KeyboardInterrupt:
+        pass
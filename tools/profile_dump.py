@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+#
+# Bafang LCD SW102 Bluetooth firmware
+#
+# Released under the GPL License, Version 3
+#
+# Fetches the profiler data from a display built with "make PROFILE=1 BLE_SERIAL=1" over
+# the BLE serial (Nordic UART) service and prints per id stats plus a flame
+# chart style summary of the trace ring.  See include/profile.h for the
+# packet format.
+#
+# usage: profile_dump.py [--clear] [--collapsed FILE] [device address or name]
+#   --clear           clear the stats and trace on the display after the dump
+#   --collapsed FILE  also write the trace as collapsed stacks (for flamegraph.pl)
+#
+# (needs "pip install bleak")
+
+import argparse
+import asyncio
+import struct
+import sys
+from collections import defaultdict
+
+from bleak import BleakClient, BleakScanner
+
+NUS_RX = "6e400002-b5a3-f393-e0a9-e50e24dcca9e"  # we write commands here
+NUS_TX = "6e400003-b5a3-f393-e0a9-e50e24dcca9e"  # display sends notifications here
+
+RING_END = 0x80000000
+TIME_MASK = 0xFFFFFF
+
+
+class Dump:
+    def __init__(self):
+        self.names = {}
+        self.stats = {}
+        self.ring = []
+        self.expected = None
+        self.done = asyncio.Event()
+
+    def name(self, i):
+        return self.names.get(i, "id%d" % i)
+
+    def packet(self, pkt):
+        kind = chr(pkt[0])
+        if kind == "H":
+            self.expected = struct.unpack_from("<H", pkt, 1)[0]
+        elif kind == "N":
+            self.names[pkt[1]] = pkt[2:].decode("ascii", "replace")
+        elif kind == "S":
+            self.stats[pkt[1]] = struct.unpack_from("<4I", pkt, 2)
+        elif kind == "R":
+            self.ring.extend(struct.unpack_from("<%dI" % ((len(pkt) - 1) // 4), pkt, 1))
+        elif kind == "E":
+            self.done.set()
+
+
+def print_stats(dump):
+    print("%-26s %8s %8s %8s %8s %10s" % ("id", "count", "min", "mean", "max", "total us"))
+    rows = sorted(dump.stats.items(), key=lambda kv: -kv[1][3])
+    for i, (count, lo, hi, total) in rows:
+        if count:
+            print("%-26s %8d %8d %8d %8d %10d" % (dump.name(i), count, lo, total // count, hi, total))
+
+
+def trace_stacks(dump):
+    """Rebuild nesting from the begin/end marks, returns {stack tuple: self usecs}.
+
+    An ISR's marks land inside whatever it interrupted, so it shows up as a child of that code."""
+    selftime = defaultdict(int)
+    stack = []  # [id, start, child time]
+    last = None
+    t = 0
+    for entry in dump.ring:
+        stamp = entry & TIME_MASK
+        if last is not None:
+            t += (stamp - last) & TIME_MASK
+        last = stamp
+        i = (entry >> 24) & 0x7F
+
+        if not entry & RING_END:
+            stack.append([i, t, 0])
+            continue
+
+        # find the matching begin, anything opened after it without an end (trace started mid way) is dropped
+        for depth in range(len(stack) - 1, -1, -1):
+            if stack[depth][0] == i:
+                break
+        else:
+            continue  # its begin was before the start of the ring
+
+        del stack[depth + 1:]
+        _, start, child = stack.pop()
+        elapsed = t - start
+        key = tuple(dump.name(s[0]) for s in stack) + (dump.name(i),)
+        selftime[key] += elapsed - child
+        if stack:
+            stack[-1][2] += elapsed
+    return selftime
+
+
+def print_flame(selftime):
+    # total time per stack including children, printed as an indented tree with bars
+    totals = defaultdict(int)
+    for stack, us in selftime.items():
+        for n in range(1, len(stack) + 1):
+            totals[stack[:n]] += us
+    if not totals:
+        print("(trace is empty)")
+        return
+    widest = max(totals.values())
+
+    def children(prefix):
+        kids = [s for s in totals if len(s) == len(prefix) + 1 and s[:len(prefix)] == prefix]
+        return sorted(kids, key=lambda s: -totals[s])
+
+    def show(prefix):
+        for s in children(prefix):
+            bar = "#" * max(1, totals[s] * 40 // widest)
+            print("%-40s %9d us %s" % ("  " * (len(s) - 1) + s[-1], totals[s], bar))
+            show(s)
+
+    show(())
+
+
+async def main(args):
+    device = args.device
+    if not device or ":" not in device:
+        device = await BleakScanner.find_device_by_name(device or "OS-EBike")
+        if device is None:
+            sys.exit("display not found")
+
+    dump = Dump()
+    async with BleakClient(device) as client:
+        await client.start_notify(NUS_TX, lambda _, data: dump.packet(data))
+        await client.write_gatt_char(NUS_RX, b"P")
+        await asyncio.wait_for(dump.done.wait(), 60)
+        if args.clear:
+            await client.write_gatt_char(NUS_RX, b"PC")
+
+    if dump.expected is not None and dump.expected != len(dump.ring):
+        print("warning: expected %d trace entries, got %d" % (dump.expected, len(dump.ring)))
+
+    print_stats(dump)
+    print()
+    selftime = trace_stacks(dump)
+    print_flame(selftime)
+
+    if args.collapsed:
+        with open(args.collapsed, "w") as f:
+            for stack, us in sorted(selftime.items()):
+                f.write("%s %d\n" % (";".join(stack), us))
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Dump the SW102 profiler over BLE")
+    parser.add_argument("--clear", action="store_true")
+    parser.add_argument("--collapsed")
+    parser.add_argument("device", nargs="?")
+    asyncio.run(main(parser.parse_args()))